@@ -0,0 +1,268 @@
+#!/usr/bin/env python3
+# This file is part of TALISES.
+#
+# TALISES is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# TALISES is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Strong and weak scaling of talises on one machine
+
+Strong scaling runs the scenarios of this directory and synthetic 2D/3D harmonic traps of fixed size with every
+thread count. Weak scaling runs the synthetic traps with NX proportional to the number of threads. For every
+run the wall time of the start-up (reading, allocation, planning) and of each sequence is taken from the time
+stamps of the output lines of talises. The results are written to scaling.json and as tables with speed-up
+and parallel efficiency to scaling.md.
+
+Example:
+    python3 scaling.py --threads 1,2,4,8 --duration-scale 0.05 --no-output
+
+Only the python standard library is used, nothing is downloaded.
+"""
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import xml.etree.ElementTree as ET
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def find_binary(name, given):
+    """Path of a talises executable: given, in PATH or in ~/bin (EXECUTABLE_OUTPUT_PATH of the build)"""
+    for path in (given, shutil.which(name), os.path.expanduser(os.path.join("~", "bin", name))):
+        if path and os.path.isfile(path) and os.access(path, os.X_OK):
+            return os.path.abspath(path)
+    sys.exit("Could not find {}, use --{}".format(name, "talises" if name == "talises" else "gen-psi"))
+
+
+def is_initial(root):
+    """True for the xml files of gen_psi_0 (they define the initial wavefunction)"""
+    return any(child.tag.startswith("PSI_REAL_") for child in root)
+
+
+def rewrite_sequences(root, duration_scale, no_output):
+    """Shortens the sequences and switches off the output files"""
+    seq = root.find("SEQUENCE")
+    if seq is None:
+        return
+    for item in seq:
+        if no_output and "output_freq" in item.attrib:
+            item.set("output_freq", "none")
+        if duration_scale != 1.0 and item.text and item.text.strip():
+            try:
+                duration = float(item.text)
+            except ValueError:
+                continue
+            dt = float(item.get("dt", "0.001"))
+            nk = int(item.get("Nk", "100"))
+            item.text = repr(max(duration * duration_scale, dt * nk))
+
+
+def prepare(src, dst, args, grid=None):
+    """Copies a scenario to dst, applies the options and generates the initial wavefunctions
+
+    grid maps tags of section ALGORITHM (NX, NY, NZ) to new values for the synthetic scenarios.
+    Returns the names of the xml files which are run with talises.
+    """
+    os.makedirs(dst)
+    runs = []
+    for name in sorted(os.listdir(src)):
+        if not name.endswith(".xml"):
+            continue
+        tree = ET.parse(os.path.join(src, name))
+        root = tree.getroot()
+        if grid:
+            algo = root.find("ALGORITHM")
+            for tag, value in grid.items():
+                node = algo.find(tag) if algo is not None else None
+                if node is not None:
+                    node.text = str(value)
+        if is_initial(root):
+            tree.write(os.path.join(dst, name))
+            subprocess.run([args.gen_psi, name], cwd=dst, check=True, stdout=subprocess.DEVNULL)
+        else:
+            rewrite_sequences(root, args.duration_scale, args.no_output)
+            tree.write(os.path.join(dst, name))
+            runs.append(name)
+    if args.timeprop_only:
+        runs = [r for r in runs if r == "timeprop.xml"]
+    return runs
+
+
+def run_talises(binary, workdir, xml, threads):
+    """Runs talises and returns the wall times of the start-up and of each sequence"""
+    env = dict(os.environ, MY_NO_OF_THREADS=str(threads), OMP_NUM_THREADS=str(threads))
+    cmd = [binary, xml]
+    if shutil.which("stdbuf"):
+        # std::cout is synchronised with stdio, so line buffering gives the time stamps of the lines
+        cmd = ["stdbuf", "-oL"] + cmd
+
+    start = time.perf_counter()
+    proc = subprocess.Popen(cmd, cwd=workdir, env=env, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                            universal_newlines=True)
+    marks = []
+    steps = 0
+    for line in proc.stdout:
+        now = time.perf_counter() - start
+        if line.startswith("FYI: started new sequence"):
+            marks.append({"name": line.split()[-1], "start": now, "steps": 0})
+        elif line.startswith("done: seq") and marks:
+            # final progress report of a sequence: "done: seq <no> <name> t = <t> steps <done>/<total> ..."
+            words = line.split()
+            done = int(words[words.index("steps") + 1].split("/")[0])
+            marks[-1]["steps"] = done
+            steps += done
+    proc.wait()
+    wall = time.perf_counter() - start
+    if proc.returncode != 0:
+        print("  talises failed with exit code {} in {}".format(proc.returncode, workdir))
+
+    phases = [{"phase": "startup", "seconds": marks[0]["start"] if marks else wall}]
+    for i, mark in enumerate(marks):
+        end = marks[i + 1]["start"] if i + 1 < len(marks) else wall
+        phases.append({"phase": "sequence {} ({})".format(i + 1, mark["name"]), "seconds": end - mark["start"],
+                       "steps": mark["steps"]})
+    return {"wall": wall, "phases": phases, "time_steps": steps, "exit_code": proc.returncode}
+
+
+def synthetic_trap(dst_root, dim, nx, ny, nz):
+    """Writes a synthetic harmonic trap with two internal states (Rabi pulse, trap, Rabi pulse)"""
+    os.makedirs(dst_root)
+    coords = "xyz"[:dim]
+    grid = "".join("<N{0}>{1}</N{0}>".format(c.upper(), n) for c, n in zip(coords, (nx, ny, nz)))
+    grid += "".join("<{0}MIN>-10e-6</{0}MIN><{0}MAX>10e-6</{0}MAX>".format(c.upper()) for c in coords)
+    gauss = "*".join("exp(-0.25*({}/2e-6)^2)".format(c) for c in coords)
+    trap = "m/hbar/2*(2*pi*100)^2*(" + "+".join("{}^2".format(c) for c in coords) + ")"
+
+    for name, fname, psi in (("gauss.xml", "0.000_1.bin", gauss), ("zero.xml", "0.000_2.bin", "0")):
+        with open(os.path.join(dst_root, name), "w") as f:
+            f.write("<SIMULATION><DIM>{0}</DIM><FILENAME>{1}</FILENAME>"
+                    "<PSI_REAL_{0}D>{2}</PSI_REAL_{0}D><PSI_IMAG_{0}D>0</PSI_IMAG_{0}D>"
+                    "<CONSTANTS><N>1</N></CONSTANTS><ALGORITHM>{3}</ALGORITHM></SIMULATION>\n"
+                    .format(dim, fname, psi, grid))
+
+    pulse = ('<interact Nk="25" dt="0.2" output_freq="last" pn_freq="last" V_11_real="0" V_11_imag="0" '
+             'V_12_real="2*pi*5e3/2*cos(1e7*x)" V_12_imag="-2*pi*5e3/2*sin(1e7*x)" '
+             'V_22_real="-hbar*1e14/2/m" V_22_imag="0">50</interact>')
+    with open(os.path.join(dst_root, "timeprop.xml"), "w") as f:
+        f.write("<SIMULATION><N_THREADS>1</N_THREADS><DIM>{0}</DIM><INTERNAL_DIM>2</INTERNAL_DIM>"
+                "<FILENAME>0.000_1.bin</FILENAME><FILENAME_2>0.000_2.bin</FILENAME_2>"
+                "<CONSTANTS><m>1.44466899e-25</m><hbar>1.054571817e-34</hbar></CONSTANTS>"
+                "<ALGORITHM><M>1.44466899e-25</M><T_SCALE>1e-6</T_SCALE></ALGORITHM><SEQUENCE>{1}"
+                '<freeprop Nk="100" dt="2" output_freq="last" pn_freq="none" V_11_real="{2}" V_11_imag="0" '
+                'V_22_real="{2}" V_22_imag="0">2000</freeprop>{1}</SEQUENCE></SIMULATION>\n'
+                .format(dim, pulse, trap))
+
+
+def table(title, rows, base):
+    """Markdown table of a series of runs with speed-up and efficiency relative to base (a function of the run)"""
+    out = ["### " + title, "", "| threads | points | wall [s] | start-up [s] | speed-up | efficiency |",
+           "|--:|--:|--:|--:|--:|--:|"]
+    ref = rows[0]
+    for r in rows:
+        speedup, eff = base(ref, r)
+        out.append("| {} | {} | {:.3f} | {:.3f} | {:.2f} | {:.0%} |".format(
+            r["threads"], r["points"] or "", r["wall"], r["phases"][0]["seconds"], speedup, eff))
+    return "\n".join(out) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--talises", help="talises executable")
+    parser.add_argument("--gen-psi", help="gen_psi_0 executable")
+    parser.add_argument("--threads", default="1,2,4", help="comma separated thread counts")
+    parser.add_argument("--scenarios", default="", help="comma separated subdirectories (default all)")
+    parser.add_argument("--grid", default="128,256", help="points per direction of the synthetic 2D traps")
+    parser.add_argument("--grid-3d", default="32,64", help="points per direction of the synthetic 3D traps")
+    parser.add_argument("--weak", type=int, default=64, help="NX per thread of the weak scaling runs (0: none)")
+    parser.add_argument("--duration-scale", type=float, default=1.0, help="factor for the durations of the sequences")
+    parser.add_argument("--no-output", action="store_true", help="do not write wavefunction files")
+    parser.add_argument("--timeprop-only", action="store_true", help="only run timeprop.xml of each scenario")
+    parser.add_argument("--out", default=".", help="directory for scaling.json and scaling.md")
+    parser.add_argument("--keep", action="store_true", help="keep the working directories")
+    args = parser.parse_args()
+
+    args.talises = find_binary("talises", args.talises)
+    args.gen_psi = find_binary("gen_psi_0", args.gen_psi)
+    threads = [int(t) for t in args.threads.split(",") if t]
+    scenarios = [s for s in args.scenarios.split(",") if s] or sorted(
+        d for d in os.listdir(HERE) if os.path.isdir(os.path.join(HERE, d)))
+
+    work = tempfile.mkdtemp(prefix="talises_scaling_")
+    runs = []
+
+    def measure(series, src, grid=None, points=None, t_list=threads):
+        for t in t_list:
+            dst = os.path.join(work, "{}_{}".format(series.replace("/", "_"), t))
+            xmls = prepare(src, dst, args, grid)
+            for xml in xmls:
+                print("{:40s} {:16s} threads {:3d}".format(series, xml, t), flush=True)
+                res = run_talises(args.talises, dst, xml, t)
+                res.update(series=series, xml=xml, threads=t, points=points)
+                print("  wall {:.3f} s".format(res["wall"]), flush=True)
+                runs.append(res)
+            if not args.keep:
+                shutil.rmtree(dst)
+
+    try:
+        for name in scenarios:
+            measure(name, os.path.join(HERE, name))
+
+        synth = []
+        for n in [int(g) for g in args.grid.split(",") if g]:
+            synth.append((2, n, n, 1))
+        for n in [int(g) for g in args.grid_3d.split(",") if g]:
+            synth.append((3, n, n, n))
+        for dim, nx, ny, nz in synth:
+            src = os.path.join(work, "trap_{}d_{}".format(dim, nx))
+            synthetic_trap(src, dim, nx, ny, nz)
+            measure("strong/{}D_{}".format(dim, nx), src, points=nx * ny * nz)
+
+        if args.weak > 0:
+            for dim, n in ((2, 128), (3, 32)):
+                src = os.path.join(work, "trap_{}d_weak".format(dim))
+                synthetic_trap(src, dim, args.weak, n, n if dim == 3 else 1)
+                for t in threads:
+                    nx = args.weak * t
+                    grid = {"NX": nx}
+                    measure("weak/{}D".format(dim), src, grid, nx * n * (n if dim == 3 else 1), [t])
+    finally:
+        if not args.keep:
+            shutil.rmtree(work, ignore_errors=True)
+
+    os.makedirs(args.out, exist_ok=True)
+    with open(os.path.join(args.out, "scaling.json"), "w") as f:
+        json.dump({"talises": args.talises, "threads": threads, "runs": runs}, f, indent=2)
+
+    # strong scaling: speed-up T(1)/T(p), efficiency speed-up/p; weak scaling: efficiency T(1)/T(p)
+    strong = lambda ref, r: (ref["wall"] / r["wall"], ref["wall"] / r["wall"] * ref["threads"] / r["threads"])
+    weak = lambda ref, r: (ref["wall"] / r["wall"] * r["threads"] / ref["threads"], ref["wall"] / r["wall"])
+    md = ["# Scaling of talises", ""]
+    keys = []
+    for r in runs:
+        if (r["series"], r["xml"]) not in keys:
+            keys.append((r["series"], r["xml"]))
+    for series, xml in keys:
+        rows = sorted((r for r in runs if r["series"] == series and r["xml"] == xml), key=lambda r: r["threads"])
+        md.append(table("{} ({})".format(series, xml), rows, weak if series.startswith("weak/") else strong))
+    with open(os.path.join(args.out, "scaling.md"), "w") as f:
+        f.write("\n".join(md))
+    print("\n".join(md))
+
+
+if __name__ == "__main__":
+    main()
@@ -26,6 +26,7 @@
 #include "strtk.hpp"
 #include "CRT_shared.h"
 #include "cft_base.h"
+#include "field_alloc.h"
 #include "ParameterHandler.h"
 
 using namespace std;
@@ -52,8 +53,34 @@ public:
   void run_sequence();
 
   void Setup_Momentum( CPoint<dim>, const int comp=0 );
+  void Recenter_Frame();
+  CPoint<dim> Get_x_lab( const int );
+
+  void Check_Grid();
+  void Regrid( const long long (&)[3] );
   void Expval_Position( CPoint<dim> &, const int comp=0 );
   void Expval_Momentum( CPoint<dim> &, const int comp=0 );
+
+  /** Observables of the internal states (see Measure())
+    *
+    * Like Expval_Position() and Expval_Momentum() the moments are not normalised to the particle number.
+    */
+  struct observables
+  {
+    int mask; ///< observables which have been measured (combination of enum observable)
+    double N[no_int_states]; ///< particle number
+    CPoint<dim> x[no_int_states]; ///< first moment of the position
+    CPoint<dim> x2[no_int_states]; ///< second moment of the position along each direction
+    CPoint<dim> p[no_int_states]; ///< first moment of the wave number
+    CPoint<dim> p2[no_int_states]; ///< second moment of the wave number along each direction
+    double coherence[no_int_states][no_int_states][2]; ///< overlap <Psi_i|Psi_j> (real and imaginary part)
+    double E_kin; ///< kinetic energy of all states in rad/s
+    double E_pot; ///< potential energy of all states in rad/s
+    double E_int; ///< contact interaction energy in rad/s
+    double E; ///< total energy in rad/s
+    double mu; ///< chemical potential in rad/s
+  };
+  void Measure( const int, observables &, const int comp=-1 );
   void Save( double *, std::string );
   void Save( fftw_complex *, std::string );
   void Save_Phi( std::string, const int comp=0 );
@@ -78,6 +105,72 @@ protected:
   void Do_FT_Step_half();
   void Do_NL_Step();
 
+  void Sweep( const int, const int, const int, const std::vector<double> *, double * );
+  void Take_Momentum_Observables();
+  void Request_Observables();
+  void Print_Particle_Numbers();
+  void Write_Observables();
+  virtual void Potential_Energy( double &, double & );
+
+  /** Adds the density, the moments of the coordinates X and the overlaps of the states s0..s1-1 at point l to sum
+    *
+    * @param l Array index (point times m_stride)
+    * @param sum Sums of the observables in the order N, first moments, second moments and overlaps (see Sweep())
+    */
+  inline void Accumulate( fftw_complex * const *Psi, const int64_t l, const double *X, const int s0, const int s1, const int mask, double *sum ) const
+  {
+    const int S = no_int_states;
+    for ( int s=s0; s<s1; s++ )
+    {
+      const double den = Psi[s][l][0]*Psi[s][l][0] + Psi[s][l][1]*Psi[s][l][1];
+      sum[s] += den;
+      if ( mask & (obs_x|obs_p) )
+        for ( int a=0; a<dim; a++ )
+          sum[S+s*dim+a] += X[a]*den;
+      if ( mask & (obs_x2|obs_p2) )
+        for ( int a=0; a<dim; a++ )
+          sum[S*(1+dim)+s*dim+a] += X[a]*X[a]*den;
+      if ( mask & obs_coherence )
+      {
+        for ( int t=s+1; t<s1; t++ )
+        {
+          sum[S*(1+2*dim)+2*(s*S+t)] += Psi[s][l][0]*Psi[t][l][0] + Psi[s][l][1]*Psi[t][l][1];
+          sum[S*(1+2*dim)+2*(s*S+t)+1] += Psi[s][l][0]*Psi[t][l][1] - Psi[s][l][1]*Psi[t][l][0];
+        }
+      }
+    }
+  };
+
+  /** Adds the contact interaction \f$ \sum_j g_{ij} |\Psi_j(\vec{x}_l)|^2 \f$ of each internal state i to phi
+    *
+    * @param Psi Internal states of the wavefunction
+    * @param l Array index (point times m_stride)
+    * @param phi Potential of each internal state at point l
+    */
+  inline void Add_Interaction( fftw_complex * const *Psi, const int l, double *phi ) const
+  {
+    double density[no_int_states];
+    for ( int j=0; j<no_int_states; j++ )
+      density[j] = Psi[j][l][0]*Psi[j][l][0] + Psi[j][l][1]*Psi[j][l][1];
+    for ( int i=0; i<no_int_states; i++ )
+      for ( int j=0; j<no_int_states; j++ )
+        phi[i] += m_gs[no_int_states*i+j]*density[j];
+  };
+
+  /** Returns the contact interaction energy density \f$ \frac{1}{2} \sum_{ij} g_{ij} |\Psi_i(\vec{x}_l)|^2 |\Psi_j(\vec{x}_l)|^2 \f$
+    *
+    * @param Psi Internal states of the wavefunction
+    * @param l Array index (point times m_stride)
+    */
+  inline double Interaction_Energy( fftw_complex * const *Psi, const int l ) const
+  {
+    double phi[no_int_states] = {}, retval = 0;
+    Add_Interaction( Psi, l, phi );
+    for ( int i=0; i<no_int_states; i++ )
+      retval += 0.5*phi[i]*(Psi[i][l][0]*Psi[i][l][0] + Psi[i][l][1]*Psi[i][l][1]);
+    return retval;
+  };
+
   /// Object for reading from xml files
   ParameterHandler *m_params;
 
@@ -88,15 +181,109 @@ protected:
   double m_L;
   double m_T;
 
-  /// Exponential of the whole kinetic operator. See Init() for further information.
+  /// Exponential of the whole kinetic operator on a distributed grid. See Init() for further information.
   fftw_complex *m_full_step;
-  /// Exponential of half of the kinetic operator. See Init() for further information.
+  /// Exponential of half of the kinetic operator on a distributed grid. See Init() for further information.
   fftw_complex *m_half_step;
 
+  /// Kinetic tables of all time steps used so far on this grid
+  std::map<double,kinetic_table> m_kinetic;
+  /// Kinetic table of the current time step
+  const kinetic_table *m_kinetic_dt;
+
   void Init();
+  void Apply_Kinetic( const bool );
+  void Transform( const int, const int s0=0, const int s1=no_int_states );
+
+  /// Offset between two points of an internal state, no_int_states if the states are interleaved (LAYOUT=1)
+  int m_stride;
+  /// All internal states interleaved point by point (LAYOUT=1), else nullptr. See Allocate().
+  fftw_complex *m_interleaved;
+  /// Transforms of all internal states in m_interleaved at once
+  fftw_plan m_plan_forward;
+  fftw_plan m_plan_backward;
+
+  /// First value of internal state s, the value at point l is at index l*m_stride
+  fftw_complex *Field( const int s )
+  {
+    return ( m_interleaved != nullptr ) ? m_interleaved + s : m_fields[s]->Getp2In();
+  };
+
+  /** Contiguous copy of internal state s, e.g. for file IO
+    *
+    * This is the field itself unless the states are interleaved. Then the copy is made in the buffer of
+    * m_fields[0], it is valid until the next call and written back with Scatter().
+    */
+  fftw_complex *Gather( const int s )
+  {
+    fftw_complex *buf = m_fields[s]->Getp2In();
+    if ( m_interleaved == nullptr ) return buf;
+    const fftw_complex *Psi = m_interleaved + s;
+    #pragma omp parallel for
+    for ( int l=0; l<m_no_of_pts; l++ )
+    {
+      buf[l][0] = Psi[(size_t)l*no_int_states][0];
+      buf[l][1] = Psi[(size_t)l*no_int_states][1];
+    }
+    return buf;
+  };
+
+  /// Writes the copy of Gather() back to internal state s
+  void Scatter( const int s )
+  {
+    if ( m_interleaved == nullptr ) return;
+    const fftw_complex *buf = m_fields[s]->Getp2In();
+    fftw_complex *Psi = m_interleaved + s;
+    #pragma omp parallel for
+    for ( int l=0; l<m_no_of_pts; l++ )
+    {
+      Psi[(size_t)l*no_int_states][0] = buf[l][0];
+      Psi[(size_t)l*no_int_states][1] = buf[l][1];
+    }
+  };
   void Allocate();
   void LoadFiles();
 
+  void Init_Frame();
+  void Kick_Frame( CPoint<dim> & );
+  void Shift_Frame();
+  void Advance_Frame( const double );
+  void Update_Frame_Header();
+
+  /// Frame of reference in which the fields are propagated (see enum frame)
+  int m_frame_mode;
+  /// Lab position of the grid origin
+  CPoint<dim> m_frame_x;
+  /// Wave number removed from the fields by the Galilean boost
+  CPoint<dim> m_frame_k;
+  /// Acceleration of the frame in units of L/T^2 (trajectory frame only)
+  CPoint<dim> m_frame_a;
+  /// Grid shift which is carried out during the next kinetic step
+  CPoint<dim> m_frame_shift;
+
+  template <class D> void Remap_Grid( const D *, D *, const long long (&)[3], const long long (&)[3] );
+
+  /// Whether the grid is adapted to the extent of the fields (see Check_Grid())
+  bool m_regrid;
+  /// Width of the edge bands as a fraction of the number of points per direction
+  double m_regrid_edge;
+  /// Fraction of the particles in the edge bands above which the grid is extended
+  double m_regrid_grow;
+  /// Fraction of the particles in the outer quarters below which the grid is cropped
+  double m_regrid_shrink;
+  /// Upper and lower bound of the number of points per direction
+  long long m_regrid_max;
+  long long m_regrid_min;
+  /// Incremented by Regrid(), tables on the grid have to be rebuilt if it changes
+  int m_grid_id;
+
+  /// Observables written to observables.txt at each output (OBSERVABLES in section ALGORITHM)
+  int m_observables;
+  /// Momentum observables which are taken during the next kinetic step
+  int m_obs_request;
+  /// Momentum observables taken during the last kinetic step, valid until the fields are kicked or regridded
+  observables m_obs_k;
+
   bool m_potenial_initialized;
 
   virtual bool run_custom_sequence( const sequence_item & )=0;
@@ -112,6 +299,8 @@ protected:
     * \f]
     */
   std::array<double,no_int_states *no_int_states> m_gs;
+  /// True if any element of m_gs is nonzero
+  bool m_interacting;
 
   /** Array of internal states of the wavefunction
     *
@@ -121,7 +310,7 @@ protected:
   std::array<T *,no_int_states> m_fields;
 
   ///time independent external potentials
-  std::array<vector<double>,no_int_states> m_Potential;
+  std::array<arena_vector<double>,no_int_states> m_Potential;
 
   ///Map between String (name of functions) and StepFunction
   std::map<std::string,StepFunction> m_map_stepfcts;
@@ -144,9 +333,37 @@ CRT_Base<T,dim,no_int_states>::CRT_Base( ParameterHandler *params )
   Read_header(params->Get_simulation("FILENAME"),dim);
   assert( m_header.nDims == dim );
 
+  // Interleave the internal states point by point (LAYOUT=1 in section ALGORITHM)
+  m_stride = 1;
+  m_interleaved = nullptr;
+  if ( params->Get_Algorithm("LAYOUT",0) == 1 && no_int_states > 1 )
+  {
+    if ( params->Get_Algorithm("REGRID",0) != 0 || Local_Points_Bound() != size_t(m_header.nDimX*m_header.nDimY*m_header.nDimZ) )
+      std::cout << "FYI: LAYOUT=1 is not available with REGRID or on distributed grids, the internal states are stored separately\n";
+    else
+      m_stride = no_int_states;
+  }
+
+  // Fields, kinetic operators and potentials live in the persistent region of the arena, the evaluated
+  // Hamiltonian and the position factors of a sequence in the scratch region
+  if ( params->Get_Algorithm("ARENA",1) != 0 && params->Get_Algorithm("REGRID",0) == 0 )
+  {
+    size_t nNum = 0;
+    for ( auto seq : params->m_sequence )
+      nNum = std::max( nNum, 2*seq.V_real.size() );
+    const size_t N = Local_Points_Bound();
+    const size_t tables = params->Get_Algorithm("ARENA_TABLES",4);
+    // The full grid kinetic operators are only needed on a distributed grid
+    const size_t kinetic = ( N != size_t(m_header.nDimX*m_header.nDimY*m_header.nDimZ) ) ? 2 : 0;
+    // The interleaved states need the buffer of m_fields[0] as scratch in addition
+    const size_t fields = ( m_stride > 1 ) ? no_int_states+1 : no_int_states;
+    Solver_Arena().Reserve( N*((fields+kinetic)*sizeof(fftw_complex) + no_int_states*sizeof(double)) + 64*(2*no_int_states+3),
+                            N*(nNum+tables)*sizeof(double) + 64*(tables+1),
+                            params->Get_Algorithm("HUGEPAGES",2) );
+  }
+
   Allocate();
   LoadFiles();
-  Init();
 
   // Map between "half_step" and Do_FT_Step_half
   m_map_stepfcts["half_step"] = &Do_FT_Step_half_Wrapper;
@@ -168,6 +385,68 @@ CRT_Base<T,dim,no_int_states>::CRT_Base( ParameterHandler *params )
   }
 
   m_header.dt = params->Get_dt();
+  // Init_Frame() may already measure the initial states
+  m_observables = params->Get_Observables();
+  m_obs_request = 0;
+  m_obs_k.mask = 0;
+  Init();
+  Init_Frame();
+
+  //Read the contact interactions from xml
+  m_interacting = false;
+  for ( int i=0; i<no_int_states; i++ )
+  {
+    for ( int j=0; j<no_int_states; j++ )
+    {
+      m_gs[no_int_states*i+j] = params->Get_Interaction(i+1,j+1);
+      if ( m_gs[no_int_states*i+j] != 0 ) m_interacting = true;
+    }
+  }
+  if ( m_interacting ) std::cout << "FYI: contact interactions from section INTERACTIONS enabled\n";
+
+  m_regrid = ( params->Get_Algorithm("REGRID",0) != 0 );
+  m_regrid_edge = params->Get_Algorithm("REGRID_EDGE",0.05);
+  m_regrid_grow = params->Get_Algorithm("REGRID_GROW",1e-6);
+  m_regrid_shrink = params->Get_Algorithm("REGRID_SHRINK",1e-10);
+  m_regrid_max = params->Get_Algorithm("REGRID_MAX",8192);
+  m_regrid_min = params->Get_Algorithm("REGRID_MIN",32);
+  if ( m_regrid && m_distributed )
+  {
+    std::cout << "FYI: REGRID is not supported for grids distributed over MPI processes\n";
+    m_regrid = false;
+  }
+  m_grid_id = 0;
+
+  if ( m_observables != 0 && Get_Rank() == 0 )
+  {
+    std::ofstream file1( "observables.txt" );
+    file1 << "# t";
+    for ( int s=1; s<=no_int_states; s++ )
+    {
+      if ( m_observables & obs_N ) file1 << " N_" << s;
+      for ( int a=0; a<dim; a++ ) if ( m_observables & obs_x ) file1 << " x" << a+1 << "_" << s;
+      for ( int a=0; a<dim; a++ ) if ( m_observables & obs_x2 ) file1 << " xx" << a+1 << "_" << s;
+      for ( int a=0; a<dim; a++ ) if ( m_observables & obs_p ) file1 << " k" << a+1 << "_" << s;
+      for ( int a=0; a<dim; a++ ) if ( m_observables & obs_p2 ) file1 << " kk" << a+1 << "_" << s;
+    }
+    if ( m_observables & obs_coherence )
+      for ( int s=1; s<=no_int_states; s++ )
+        for ( int t=s+1; t<=no_int_states; t++ )
+          file1 << " re_" << s << t << " im_" << s << t;
+    if ( m_observables & obs_E ) file1 << " E_kin E_pot E_int E mu";
+    file1 << "\n";
+  }
+
+  if ( params->Get_Algorithm("NUMA_REPORT",0) != 0 )
+  {
+    if ( m_interleaved != nullptr )
+      Report_Pages( "fields", m_interleaved, sizeof(fftw_complex)*m_no_of_pts*no_int_states );
+    else
+      for ( int i=0; i<no_int_states; i++ )
+        Report_Pages( "field " + to_string(i+1), m_fields[i]->Getp2In(), sizeof(fftw_complex)*m_no_of_pts );
+    if ( m_full_step != nullptr )
+      Report_Pages( "kinetic operator", m_full_step, sizeof(fftw_complex)*m_no_of_pts_k );
+  }
 }
 
 /// Destructor
@@ -175,24 +454,58 @@ template <class T, int dim, int no_int_states>
 CRT_Base<T,dim,no_int_states>::~CRT_Base()
 {
   for ( int i=0; i<no_int_states; i++ )
-    delete m_fields[i];
-  fftw_free( m_full_step );
-  fftw_free( m_half_step );
+    if ( i == 0 || m_fields[i] != m_fields[0] ) delete m_fields[i];
+  if ( m_interleaved != nullptr )
+  {
+    fftw_destroy_plan( m_plan_forward );
+    fftw_destroy_plan( m_plan_backward );
+    Free_Buffer( m_interleaved );
+  }
+  if ( m_full_step != nullptr ) Free_Buffer( m_full_step );
+  if ( m_half_step != nullptr ) Free_Buffer( m_half_step );
 }
 
-/** Allocate m_fields, m_full_step and m_half_step
+/** Allocate m_fields, and m_full_step and m_half_step if the grid is distributed
+  *
+  * If the internal states are interleaved, all of them are stored in m_interleaved with the value of state s
+  * at point l at index l*no_int_states+s, and they are transformed together with one strided plan. All
+  * elements of m_fields then refer to a single field object, which provides the grid and whose own buffer is
+  * the scratch space of Gather() and Scatter().
   */
 template <class T, int dim, int no_int_states>
 void CRT_Base<T,dim,no_int_states>::Allocate()
 {
   for ( int i=0; i<no_int_states; i++ )
   {
+    if ( i > 0 && m_stride > 1 )
+    {
+      m_fields[i] = m_fields[0];
+      continue;
+    }
     m_fields[i] = new T( m_header );
     m_fields[i]->SetFix(false);
   }
+  Setup_Local( m_fields[0] );
 
-  m_full_step = (fftw_complex *)fftw_malloc( sizeof(fftw_complex)*m_no_of_pts );
-  m_half_step = (fftw_complex *)fftw_malloc( sizeof(fftw_complex)*m_no_of_pts );
+  if ( m_stride > 1 )
+  {
+    const int n[3] = { int(m_header.nDimX), int(m_header.nDimY), int(m_header.nDimZ) };
+    const int S = no_int_states;
+    m_interleaved = Alloc_Complex( int64_t(S)*m_no_of_pts );
+    m_plan_forward = fftw_plan_many_dft( dim, n, S, m_interleaved, nullptr, S, 1, m_interleaved, nullptr, S, 1, FFTW_FORWARD, FFTW_ESTIMATE );
+    m_plan_backward = fftw_plan_many_dft( dim, n, S, m_interleaved, nullptr, S, 1, m_interleaved, nullptr, S, 1, FFTW_BACKWARD, FFTW_ESTIMATE );
+    assert( m_plan_forward != nullptr );
+    assert( m_plan_backward != nullptr );
+    std::cout << "FYI: internal states interleaved\n";
+  }
+
+  m_full_step = m_half_step = nullptr;
+  m_kinetic_dt = nullptr;
+  if ( m_distributed )
+  {
+    m_full_step = Alloc_Complex( m_no_of_pts_k );
+    m_half_step = Alloc_Complex( m_no_of_pts_k );
+  }
 }
 
 /** Load initial wavefunctions from files
@@ -202,36 +515,16 @@ void CRT_Base<T,dim,no_int_states>::Allocate()
 template <class T, int dim, int no_int_states>
 void CRT_Base<T,dim,no_int_states>::LoadFiles()
 {
-  ifstream in;
-
   //File 1
-  in.open( m_params->Get_simulation("FILENAME"), ifstream::binary );
-  if ( in.is_open() )
-  {
-    in.seekg( sizeof(generic_header), ifstream::beg );
-    in.read( (char *)m_fields[0]->Getp2In(), sizeof(fftw_complex)*m_no_of_pts );
-    in.close();
-  }
-  else
-  {
-    throw string("Could not open file " + m_params->Get_simulation("FILENAME") + "\n");
-  }
+  Read_Field( m_params->Get_simulation("FILENAME"), m_fields[0]->Getp2In() );
+  Scatter(0);
 
   // File 2,...
   for ( int i=1; i<no_int_states; i++ )
   {
     string str = "FILENAME_" + to_string(i+1);
-    in.open( m_params->Get_simulation(str), ifstream::binary );
-    if ( in.is_open() )
-    {
-      in.seekg( sizeof(generic_header), ifstream::beg );
-      in.read( (char *)m_fields[i]->Getp2In(), sizeof(fftw_complex)*m_no_of_pts );
-      in.close();
-    }
-    else
-    {
-      throw string("Could not open file " + m_params->Get_simulation(str) + "\n");
-    }
+    Read_Field( m_params->Get_simulation(str), m_fields[i]->Getp2In() );
+    Scatter(i);
   }
 }
 
@@ -244,10 +537,27 @@ void CRT_Base<T,dim,no_int_states>::LoadFiles()
   * We call the solution of this exponential m_half_step.
   *
   * If we compute the whole kinetic operator we call this m_full_step
+  *
+  * Since \f$k^2 \alpha\f$ is a sum over the axes the exponential factorises into one factor per axis. Unless the
+  * grid is distributed (transposed in momentum space) only these factors are stored, for each time step in
+  * m_kinetic so that changing back to an earlier dt costs nothing, and multiplied in Apply_Kinetic().
   */
 template <class T, int dim, int no_int_states>
 void CRT_Base<T,dim,no_int_states>::Init()
 {
+  if ( !m_distributed )
+  {
+    const double dt = -m_header.dt;
+    auto it = m_kinetic.find(dt);
+    if ( it == m_kinetic.end() )
+    {
+      Fill_Kinetic_Table( m_kinetic[dt], dt, &m_alpha[0], dim );
+      it = m_kinetic.find(dt);
+    }
+    m_kinetic_dt = &it->second;
+    return;
+  }
+
   #pragma omp parallel
   {
     const double dt = -m_header.dt;
@@ -256,7 +566,7 @@ void CRT_Base<T,dim,no_int_states>::Init()
     CPoint<dim> k;
 
     #pragma omp for
-    for ( int i=0; i<m_no_of_pts; i++ )
+    for ( int i=0; i<m_no_of_pts_k; i++ )
     {
       k = m_fields[0]->Get_k(i);
       phi = dt*(k.scale(m_alpha)*k);
@@ -272,6 +582,12 @@ void CRT_Base<T,dim,no_int_states>::Init()
 template <class T, int dim, int no_int_states>
 void CRT_Base<T,dim,no_int_states>::Init_Potential()
 {
+  if ( m_regrid )
+  {
+    std::cout << "FYI: REGRID is not supported together with static potentials, the grid is kept fixed\n";
+    m_regrid = false;
+  }
+
   for ( auto &it : m_Potential )
   {
     it.resize(m_no_of_pts,0);
@@ -327,32 +643,139 @@ void CRT_Base<T,dim,no_int_states>::Do_NL_Step_Wrapper_one ( void *ptr, sequence
 {
 }
 
-/** Computes the full kinetic part
+/** Multiplies the fields in momentum space by the exponential of the kinetic operator
+  *
+  * On a local grid the factor of each point is the product of the factors of its axes (see Init()). The factor
+  * of the outer axes is formed once per row and the innermost axis is streamed, so apart from the fields only
+  * a few kilobytes of tables are read. Interleaved states share the factor of each point.
+  * @param half Half instead of full time step
   */
 template <class T, int dim, int no_int_states>
-void CRT_Base<T,dim,no_int_states>::Do_FT_Step_full()
+void CRT_Base<T,dim,no_int_states>::Apply_Kinetic( const bool half )
 {
-  //Fourier transform
-  for ( int c=0; c<no_int_states; c++ )
-    m_fields[c]->ft(-1);
+  if ( m_distributed )
+  {
+    const fftw_complex *E = half ? m_half_step : m_full_step;
+    double tmp1;
 
-  double tmp1;
+    for ( int i=0; i<no_int_states; i++ )
+    {
+      fftw_complex *Psi = m_fields[i]->Getp2In();
 
-  for ( int i=0; i<no_int_states; i++ )
+      #pragma omp parallel for private(tmp1)
+      for ( int l=0; l<m_no_of_pts_k; l++ )
+      {
+        tmp1 = Psi[l][0];
+        Psi[l][0] = Psi[l][0]*E[l][0] - Psi[l][1]*E[l][1];
+        Psi[l][1] = Psi[l][1]*E[l][0] + tmp1*E[l][1];
+      }
+    }
+    return;
+  }
+
+  const std::vector<double> *tab = half ? m_kinetic_dt->half : m_kinetic_dt->full;
+  if ( m_interleaved == nullptr )
   {
-    fftw_complex *Psi = m_fields[i]->Getp2In();
+    for ( int s=0; s<no_int_states; s++ )
+      Apply_Kinetic_Table( tab, dim, m_fields[s]->Getp2In() );
+    return;
+  }
 
-    #pragma omp parallel for private(tmp1)
-    for ( int l=0; l<m_no_of_pts; l++ )
+  const double *Ein = tab[dim-1].data();
+  const long long NI = m_axis_k[dim-1].size();
+  const long long rows = m_no_of_pts_k/NI;
+
+  if ( dim == 1 )
+  {
+    fftw_complex *Psi = m_interleaved;
+
+    #pragma omp parallel for
+    for ( long long l=0; l<NI; l++ )
     {
-      tmp1 = Psi[l][0];
-      Psi[l][0] = Psi[l][0]*m_full_step[l][0] - Psi[l][1]*m_full_step[l][1];
-      Psi[l][1] = Psi[l][1]*m_full_step[l][0] + tmp1*m_full_step[l][1];
+      for ( int s=0; s<no_int_states; s++ )
+      {
+        const double re = Psi[l*no_int_states+s][0], im = Psi[l*no_int_states+s][1];
+        Psi[l*no_int_states+s][0] = re*Ein[2*l] - im*Ein[2*l+1];
+        Psi[l*no_int_states+s][1] = im*Ein[2*l] + re*Ein[2*l+1];
+      }
     }
+    return;
   }
+
+  #pragma omp parallel for
+  for ( long long r=0; r<rows; r++ )
+  {
+    // factor of the outer axes
+    double fr, fi;
+    Kinetic_Row( tab, dim, r, fr, fi );
+
+    fftw_complex *Psi = m_interleaved + r*NI*no_int_states;
+    for ( long long l=0; l<NI; l++ )
+    {
+      const double er = fr*Ein[2*l] - fi*Ein[2*l+1];
+      const double ei = fr*Ein[2*l+1] + fi*Ein[2*l];
+      for ( int s=0; s<no_int_states; s++ )
+      {
+        const double re = Psi[l*no_int_states+s][0], im = Psi[l*no_int_states+s][1];
+        Psi[l*no_int_states+s][0] = re*er - im*ei;
+        Psi[l*no_int_states+s][1] = im*er + re*ei;
+      }
+    }
+  }
+}
+
+/** Transforms internal states into fourier space (isign=-1) or back into real space (isign=1)
+  *
+  * Interleaved states are always transformed together with the strided plans of Allocate(), followed by the
+  * same scaling as in the field objects.
+  * @param isign Direction of the transform
+  * @param s0 First internal state
+  * @param s1 Last internal state + 1
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Transform( const int isign, const int s0, const int s1 )
+{
+  if ( m_interleaved == nullptr )
+  {
+    for ( int s=s0; s<s1; s++ )
+      m_fields[s]->ft(isign);
+    return;
+  }
+
+  {
+    Phase_Scope timer( ph_fft );
+    fftw_execute( ( isign == -1 ) ? m_plan_forward : m_plan_backward );
+  }
+
+  Phase_Scope timer( ph_fix );
+  const double dx[3] = { m_header.dx, m_header.dy, m_header.dz };
+  const double dk[3] = { m_header.dkx, m_header.dky, m_header.dkz };
+  double fak = 1;
+  for ( int a=0; a<dim; a++ )
+    fak *= ( ( isign == -1 ) ? dx[a] : dk[a] )/sqrt(2.0*M_PI);
+
+  double *data = reinterpret_cast<double *>(m_interleaved);
+  const int64_t n = 2*int64_t(no_int_states)*m_no_of_pts;
+  #pragma omp parallel for
+  for ( int64_t i=0; i<n; i++ )
+    data[i] *= fak;
+}
+
+/** Computes the full kinetic part
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Do_FT_Step_full()
+{
+  Phase_Scope timer( ph_kinetic );
+  //Fourier transform
+  Transform(-1);
+  Take_Momentum_Observables();
+
+  Apply_Kinetic( false );
+  Shift_Frame();
   //Fourier transform back into real space
-  for ( int c=0; c<no_int_states; c++ )
-    m_fields[c]->ft(1);
+  Transform(1);
+  Advance_Frame( m_header.dt );
   //Increase time
   m_header.t += m_header.dt;
 }
@@ -362,79 +785,57 @@ void CRT_Base<T,dim,no_int_states>::Do_FT_Step_full()
 template <class T, int dim, int no_int_states>
 void CRT_Base<T,dim,no_int_states>::Do_FT_Step_half()
 {
+  Phase_Scope timer( ph_kinetic );
   //Fourier transform
-  for ( int c=0; c<no_int_states; c++ )
-    m_fields[c]->ft(-1);
-  double tmp1;
-
-  for ( int i=0; i<no_int_states; i++ )
-  {
-    fftw_complex *Psi = m_fields[i]->Getp2In();
-
-    #pragma omp parallel for private(tmp1)
-    for ( int l=0; l<m_no_of_pts; l++ )
-    {
-      tmp1 = Psi[l][0];
-      Psi[l][0] = Psi[l][0]*m_half_step[l][0] - Psi[l][1]*m_half_step[l][1];
-      Psi[l][1] = Psi[l][1]*m_half_step[l][0] + tmp1*m_half_step[l][1];
-    }
-  }
-
+  Transform(-1);
+  Take_Momentum_Observables();
+  Apply_Kinetic( true );
+  Shift_Frame();
   //Fourier transform back into real space
-  for ( int c=0; c<no_int_states; c++ )
-    m_fields[c]->ft(1);
+  Transform(1);
+  Advance_Frame( 0.5*m_header.dt );
   //Increase time
   m_header.t += 0.5*m_header.dt;
 }
 
-/** Solves the NL step including an external potential, if initialized
+/** Solves the NL step including an external potential, if initialized, and the contact interactions
+  *
+  * The interactions are given in rad/s like the potentials of the sequences.
   */
 template <class T, int dim, int no_int_states>
 void CRT_Base<T,dim,no_int_states>::Do_NL_Step()
 {
   const double dt = -m_header.dt;
+  const double dt_g = -m_header.dt*m_T;
 
   #pragma omp parallel
   {
-    double re1, im1, tmp1, phi[no_int_states];
+    double re1, im1, tmp1, phi[no_int_states], phi_g[no_int_states];
 
-    vector<fftw_complex *> Psi;
+    fftw_complex *Psi[no_int_states];
     for ( int i=0; i<no_int_states; i++ )
-      Psi.push_back(m_fields[i]->Getp2In());
+      Psi[i] = Field(i);
 
-    #pragma omp for
+    Phase_Scope timer( ph_nonlinear );
+    #pragma omp for nowait
     for ( int l=0; l<m_no_of_pts; l++ )
     {
+      const int lp = l*m_stride;
       for ( int i=0; i<no_int_states; i++ )
       {
-        if ( m_potenial_initialized )
-        {
-          phi[i] = m_Potential[i][l];
-        }
-        else
-        {
-          phi[i] = 0;
-        }
-    	double tmp_density = Psi[i][l][0]*Psi[i][l][0] + Psi[i][l][1]*Psi[i][l][1];
-    	if (tmp_density <= 0.0)
-    	{
-    		phi[i] += 0.0;
-    	} else
-    	{
-    		//phi[i] += -this->m_b*log( tmp_density );
-      	//phi[i] += this->m_gs[no_int_states*i]*tmp_density;
-    	}
-        phi[i] *= dt;
+        phi[i] = ( m_potenial_initialized ) ? dt*m_Potential[i][l] : 0;
+        phi_g[i] = 0;
       }
+      if ( m_interacting ) Add_Interaction( Psi, lp, phi_g );
 
       //exp(V)*Psi
       for ( int i=0; i<no_int_states; i++ )
       {
-        sincos( phi[i], &im1, &re1 );
+        sincos( phi[i] + dt_g*phi_g[i], &im1, &re1 );
 
-        tmp1 = Psi[i][l][0];
-        Psi[i][l][0] = Psi[i][l][0]*re1 - Psi[i][l][1]*im1;
-        Psi[i][l][1] = Psi[i][l][1]*re1 + tmp1*im1;
+        tmp1 = Psi[i][lp][0];
+        Psi[i][lp][0] = Psi[i][lp][0]*re1 - Psi[i][lp][1]*im1;
+        Psi[i][lp][1] = Psi[i][lp][1]*re1 + tmp1*im1;
       }
     }
   }
@@ -455,128 +856,433 @@ void CRT_Base<T,dim,no_int_states>::Setup_Momentum( CPoint<dim> px, const int co
     CPoint<dim> x;
     double re, im, re2, im2;
 
-    fftw_complex *Psi = m_fields[comp]->Getp2In();
+    fftw_complex *Psi = Field(comp);
 
     #pragma omp for
     for ( int l=0; l<m_no_of_pts; l++ )
     {
-      x = this->m_fields[comp]->Get_x(l);
+      const int lp = l*m_stride;
+      x = this->Get_x_lab(l);
       //exp(p*x)
       sincos(px*x,&im,&re);
 
-      re2 = Psi[l][0];
-      im2 = Psi[l][1];
-      Psi[l][0] = re2*re-im2*im;
-      Psi[l][1] = re2*im+im2*re;
+      re2 = Psi[lp][0];
+      im2 = Psi[lp][1];
+      Psi[lp][0] = re2*re-im2*im;
+      Psi[lp][1] = re2*im+im2*re;
     }
   }
+  m_obs_k.mask = 0;
 }
 
-/** Calculate the expectation value of the postion of an internal state
+/** Read the frame of reference from the xml file and set up the co-moving frame
   *
-  * @param retval Reference to a CPoint object in which the expectation value will be saved
-  * @param comp Compute the expectation value of the internal state comp
+  * The fields are stored relative to a frame with the lab position m_frame_x and the
+  * boost wave number m_frame_k, i.e.
+  * \f[
+  *   \Psi_{lab}(\vec{x}) = e^{i\theta} e^{i\vec{k}_0 (\vec{x}-\vec{X})} \Psi(\vec{x}-\vec{X}).
+  * \f]
+  * In the frame "comoving" \f$ \vec{X} \f$ and \f$ \vec{k}_0 \f$ follow the centre of mass of the fields (see Recenter_Frame()).
+  * In the frame "trajectory" they follow the classical trajectory given by the vector constants FRAME_V0 (m/s)
+  * and FRAME_A (m/s^2). If the initial file was written in a moving frame, the frame is continued. Such a file
+  * cannot be propagated in the lab frame, since its grid does not hold the lab frame coordinates.
   */
 template <class T, int dim, int no_int_states>
-void CRT_Base<T,dim,no_int_states>::Expval_Position( CPoint<dim> &retval, const int comp )
+void CRT_Base<T,dim,no_int_states>::Init_Frame()
 {
-  if ( comp<0 || comp>no_int_states ) throw std::string("Error in " + std::string(__func__) + ": comp out of bounds\n");
+  m_frame_mode = m_params->Get_Frame();
+  if ( m_frame_mode == frame::lab )
+  {
+    if ( m_header.nFuture[HDR_FRAME_MODE] != frame::lab )
+      throw std::string("Error in " + std::string(__func__) + ": the initial file was written in a moving frame, set FRAME in section ALGORITHM to continue it\n");
+    Update_Frame_Header();
+    m_header.dFuture[HDR_FRAME_PHASE] = 0;
+    return;
+  }
 
-  double res[dim] = {};
-  double *tmp;
-  #pragma omp parallel
+  bool bcontinue = ( m_header.nFuture[HDR_FRAME_MODE] != frame::lab );
+  if ( bcontinue )
   {
-    const int nthreads = omp_get_num_threads();
-    const int ithread = omp_get_thread_num();
+    for ( int i=0; i<dim; i++ )
+    {
+      m_frame_x[i] = m_header.dFuture[HDR_FRAME_X+i];
+      m_frame_k[i] = m_header.dFuture[HDR_FRAME_K+i];
+    }
+  }
+  else
+  {
+    m_header.dFuture[HDR_FRAME_PHASE] = 0;
+  }
 
-    double den;
-    CPoint<dim> x;
-    fftw_complex *Psi = m_fields[comp]->Getp2In();
+  if ( m_frame_mode == frame::trajectory )
+  {
+    std::vector<double> v0(dim,0), a(dim,0);
+    try
+    {
+      v0 = m_params->Get_VConstant("FRAME_V0");
+    }
+    catch (std::string &str) {}
+    try
+    {
+      a = m_params->Get_VConstant("FRAME_A");
+    }
+    catch (std::string &str) {}
+
+    if ( v0.size() < dim || a.size() < dim ) throw std::string("Error in " + std::string(__func__) + ": FRAME_V0 and FRAME_A need " + to_string(dim) + " components\n");
 
-    #pragma omp single
+    for ( int i=0; i<dim; i++ )
+      m_frame_a[i] = a[i]*m_T*m_T;
+
+    if ( !bcontinue )
     {
-      tmp = new double[dim*nthreads];
-      for (int i=0; i<(dim*nthreads); i++) tmp[i] = 0;
+      CPoint<dim> k0;
+      for ( int i=0; i<dim; i++ )
+        k0[i] = v0[i]*m_T/(2*m_alpha[i]);
+      Kick_Frame(k0);
     }
+  }
 
-    #pragma omp for
-    for ( int l=0; l<m_no_of_pts; l++ )
+  Update_Frame_Header();
+  Recenter_Frame();
+
+  std::cout << "FYI: frame offset   : " << m_frame_x << "\n";
+  std::cout << "FYI: frame momentum : " << m_frame_k << "\n";
+}
+
+/** Move the boost wave number of the frame by dk
+  *
+  * The wave number dk is removed from all internal states, so the lab frame wavefunction is not altered.
+  * @param dk Change of the boost wave number
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Kick_Frame( CPoint<dim> &dk )
+{
+  if ( dk == 0.0 ) return;
+
+  for ( int c=0; c<no_int_states; c++ )
+  {
+    fftw_complex *Psi = Field(c);
+
+    #pragma omp parallel
     {
-      x = m_fields[comp]->Get_x(l);
-      den = (Psi[l][0]*Psi[l][0]+Psi[l][1]*Psi[l][1]);
-      for (int i=0; i<dim; i++ )
-        tmp[ithread*dim+i] += x[i]*den;
+      CPoint<dim> x;
+      double re, im, tmp1;
+
+      #pragma omp for
+      for ( int l=0; l<m_no_of_pts; l++ )
+      {
+        const int lp = l*m_stride;
+        x = m_fields[c]->Get_x(l);
+        //exp(-dk*x)
+        sincos(-(dk*x),&im,&re);
+
+        tmp1 = Psi[lp][0];
+        Psi[lp][0] = Psi[lp][0]*re - Psi[lp][1]*im;
+        Psi[lp][1] = Psi[lp][1]*re + tmp1*im;
+      }
     }
+  }
+  m_frame_k += dk;
+  Update_Frame_Header();
+  m_obs_k.mask = 0;
+}
 
-    #pragma omp for
-    for (int i=0; i<dim; i++)
+/** Shift the grid by the pending offset m_frame_shift
+  *
+  * Must be called while all internal states are in momentum space. The shift is exact, since it is applied
+  * as the phase \f$ \exp(i\vec{k}\vec{\delta}) \f$.
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Shift_Frame()
+{
+  if ( m_frame_mode == frame::lab || m_frame_shift == 0.0 ) return;
+
+  for ( int c=0; c<no_int_states; c++ )
+  {
+    fftw_complex *Psi = Field(c);
+
+    #pragma omp parallel
     {
-      for (int t=0; t<nthreads; t++)
+      CPoint<dim> k;
+      double re, im, tmp1;
+
+      #pragma omp for
+      for ( int l=0; l<m_no_of_pts_k; l++ )
       {
-        res[i] += tmp[dim*t + i];
+        const int lp = l*m_stride;
+        k = m_fields[c]->Get_k(l);
+        //exp(k*shift)
+        sincos(k*m_frame_shift,&im,&re);
+
+        tmp1 = Psi[lp][0];
+        Psi[lp][0] = Psi[lp][0]*re - Psi[lp][1]*im;
+        Psi[lp][1] = Psi[lp][1]*re + tmp1*im;
       }
     }
   }
 
-  delete [] tmp;
+  m_header.dFuture[HDR_FRAME_PHASE] += m_frame_k*m_frame_shift;
+  m_frame_x += m_frame_shift;
+  m_frame_shift = 0.0;
+  Update_Frame_Header();
+}
+
+/** Move the frame along with the fields during a kinetic step of length tau
+  *
+  * In the boosted frame the kinetic operator reduces to \f$ \alpha k^2 \f$, the drift \f$ 2\alpha\vec{k}_0 \tau \f$
+  * and the Galilean phase are carried by the frame. For the frame "trajectory" the acceleration of the frame
+  * is applied as a momentum kick, which compensates the kick of the corresponding force in the potential step.
+  * @param tau Duration of the kinetic step
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Advance_Frame( const double tau )
+{
+  if ( m_frame_mode == frame::lab ) return;
+
+  for ( int i=0; i<dim; i++ )
+  {
+    double dx = 2*m_alpha[i]*m_frame_k[i]*tau + 0.5*m_frame_a[i]*tau*tau;
+    m_header.dFuture[HDR_FRAME_PHASE] += m_frame_k[i]*dx - m_alpha[i]*m_frame_k[i]*m_frame_k[i]*tau;
+    m_frame_x[i] += dx;
+  }
 
-  for (int i=0; i<dim; i++ )
-    retval[i] = m_ar*res[i];
+  if ( m_frame_mode == frame::trajectory )
+  {
+    CPoint<dim> dk;
+    for ( int i=0; i<dim; i++ )
+      dk[i] = m_frame_a[i]*tau/(2*m_alpha[i]);
+    Kick_Frame(dk);
+  }
+  Update_Frame_Header();
 }
 
-/** Calculate the expectation value of the momentum of an internal state
+/** Move the co-moving frame into the centre of mass of all internal states
   *
-  * @param retval Reference to a CPoint object in which the expectation value will be saved
-  * @param comp Compute the expectation value of the internal state comp
+  * The mean wave number is removed immediately, the grid shift is carried out during the next kinetic step.
   */
 template <class T, int dim, int no_int_states>
-void CRT_Base<T,dim,no_int_states>::Expval_Momentum( CPoint<dim> &retval, const int comp )
+void CRT_Base<T,dim,no_int_states>::Recenter_Frame()
 {
-  if ( comp<0 || comp>no_int_states ) throw std::string("Error in " + std::string(__func__) + ": comp out of bounds\n");
+  if ( m_frame_mode != frame::comoving ) return;
 
-  double res[dim] = {};
-  double *tmp;
-  m_fields[comp]->ft(-1);
-  #pragma omp parallel
+  CPoint<dim> sum_x, sum_k;
+  double N=0;
+
+  observables obs;
+  Measure( obs_N | obs_x | obs_p, obs );
+  for ( int c=0; c<no_int_states; c++ )
   {
-    const int nthreads = omp_get_num_threads();
-    const int ithread = omp_get_thread_num();
+    N += obs.N[c];
+    sum_x += obs.x[c];
+    sum_k += obs.p[c];
+  }
+  if ( N <= 0.0 ) return;
 
-    double den;
-    CPoint<dim> k;
-    fftw_complex *Psi = m_fields[comp]->Getp2In();
+  sum_x /= N;
+  sum_k /= N;
+
+  Kick_Frame(sum_k);
+  m_frame_shift = sum_x;
+}
 
-    #pragma omp single
+/** Write the state of the frame into the slots of m_header which are reserved for the frame
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Update_Frame_Header()
+{
+  m_header.nFuture[HDR_FRAME_MODE] = m_frame_mode;
+  for ( int i=0; i<dim; i++ )
+  {
+    m_header.dFuture[HDR_FRAME_X+i] = m_frame_x[i];
+    m_header.dFuture[HDR_FRAME_K+i] = m_frame_k[i];
+  }
+}
+
+/** Position of a grid point in the lab frame
+  *
+  * @param l Array index
+  */
+template <class T, int dim, int no_int_states>
+CPoint<dim> CRT_Base<T,dim,no_int_states>::Get_x_lab( const int l )
+{
+  CPoint<dim> x = m_fields[0]->Get_x(l);
+  x += m_frame_x;
+  return x;
+}
+
+/** Adapt the grid to the current extent of the fields
+  *
+  * For each direction the fraction of the particles within the edge bands (width REGRID_EDGE) and within the
+  * outer quarters of the grid is computed. The grid is extended to twice the number of points if the edge bands
+  * hold more than REGRID_GROW of the particles and cropped to half the number of points if the outer quarters
+  * hold less than REGRID_SHRINK. The spacing of the grid is never changed.
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Check_Grid()
+{
+  if ( !m_regrid ) return;
+
+  const long long N[3] = { m_header.nDimX, m_header.nDimY, m_header.nDimZ };
+  long long band[3];
+  for ( int a=0; a<3; a++ )
+    band[a] = std::max( 1LL, (long long)(m_regrid_edge*N[a]) );
+
+  double total=0, edge[3] = {}, outer[3] = {};
+
+  for ( int c=0; c<no_int_states; c++ )
+  {
+    fftw_complex *Psi = Field(c);
+
+    #pragma omp parallel for reduction(+:total,edge[:3],outer[:3])
+    for ( long long i=0; i<N[0]; i++ )
     {
-      tmp = new double[dim*nthreads];
-      for (int i=0; i<(dim*nthreads); i++) tmp[i] = 0;
+      for ( long long j=0; j<N[1]; j++ )
+      {
+        for ( long long k=0; k<N[2]; k++ )
+        {
+          const long long l = (k+N[2]*(j+N[1]*i))*m_stride;
+          const long long idx[3] = { i, j, k };
+          const double den = Psi[l][0]*Psi[l][0] + Psi[l][1]*Psi[l][1];
+          total += den;
+          for ( int a=0; a<dim; a++ )
+          {
+            if ( idx[a] < band[a] || idx[a] >= N[a]-band[a] ) edge[a] += den;
+            if ( idx[a] < N[a]/4 || idx[a] >= N[a]-N[a]/4 ) outer[a] += den;
+          }
+        }
+      }
     }
+  }
+  if ( total <= 0.0 ) return;
 
-    #pragma omp for
-    for ( int l=0; l<m_no_of_pts; l++ )
+  long long newN[3] = { N[0], N[1], N[2] };
+  bool bchange = false;
+  for ( int a=0; a<dim; a++ )
+  {
+    if ( edge[a] > m_regrid_grow*total && 2*N[a] <= m_regrid_max )
     {
-      k = m_fields[comp]->Get_k(l);
-      den = (Psi[l][0]*Psi[l][0]+Psi[l][1]*Psi[l][1]);
-      for (int i=0; i<dim; i++ )
-        tmp[ithread*dim+i] += k[i]*den;
+      newN[a] = 2*N[a];
+      bchange = true;
     }
+    else if ( outer[a] < m_regrid_shrink*total && N[a]/2 >= m_regrid_min && N[a]%4 == 0 )
+    {
+      newN[a] = N[a]/2;
+      bchange = true;
+    }
+  }
 
-    #pragma omp for
-    for (int i=0; i<dim; i++)
+  if ( bchange ) Regrid(newN);
+}
+
+/** Copy data between two grids of the same spacing which share the centre
+  *
+  * Points of dst outside of the src grid are set to zero, points of src outside of dst are dropped.
+  * @param src Data on the old grid
+  * @param dst Data on the new grid
+  * @param oldN Number of points per direction of the old grid
+  * @param newN Number of points per direction of the new grid
+  */
+template <class T, int dim, int no_int_states>
+template <class D>
+void CRT_Base<T,dim,no_int_states>::Remap_Grid( const D *src, D *dst, const long long (&oldN)[3], const long long (&newN)[3] )
+{
+  long long off[3];
+  for ( int a=0; a<3; a++ )
+    off[a] = newN[a]/2 - oldN[a]/2;
+
+  #pragma omp parallel for
+  for ( long long i=0; i<newN[0]; i++ )
+  {
+    for ( long long j=0; j<newN[1]; j++ )
     {
-      for (int t=0; t<nthreads; t++)
+      for ( long long k=0; k<newN[2]; k++ )
       {
-        res[i] += tmp[dim*t + i];
+        const long long l = k+newN[2]*(j+newN[1]*i);
+        const long long oi = i-off[0], oj = j-off[1], ok = k-off[2];
+        if ( oi < 0 || oi >= oldN[0] || oj < 0 || oj >= oldN[1] || ok < 0 || ok >= oldN[2] )
+          std::memset( &dst[l], 0, sizeof(D) );
+        else
+          std::memcpy( &dst[l], &src[ok+oldN[2]*(oj+oldN[1]*oi)], sizeof(D) );
       }
     }
   }
+}
+
+/** Change the number of points of the grid while keeping the spacing and the centre
+  *
+  * The fields are zero padded or cropped, the Fourier transforms are planned anew and the kinetic operators
+  * are rebuilt for the new grid. m_header describes the new grid afterwards. Static potentials of
+  * Setup_Potential() have no description they could be rebuilt from, Init_Potential() therefore switches
+  * REGRID off.
+  * @param newN New number of points per direction
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Regrid( const long long (&newN)[3] )
+{
+  if ( m_potenial_initialized ) throw std::string("Error in " + std::string(__func__) + ": static potentials cannot be moved to a new grid\n");
+
+  const long long oldN[3] = { m_header.nDimX, m_header.nDimY, m_header.nDimZ };
+  const double d[3] = { m_header.dx, m_header.dy, m_header.dz };
+  double *min[3] = { &m_header.xMin, &m_header.yMin, &m_header.zMin };
+  double *max[3] = { &m_header.xMax, &m_header.yMax, &m_header.zMax };
+  double *dk[3] = { &m_header.dkx, &m_header.dky, &m_header.dkz };
+
+  m_header.nDimX = newN[0];
+  m_header.nDimY = newN[1];
+  m_header.nDimZ = newN[2];
+  for ( int a=0; a<dim; a++ )
+  {
+    *min[a] -= double(newN[a]/2 - oldN[a]/2)*d[a];
+    *max[a] = *min[a] + double(newN[a])*d[a];
+    *dk[a] = 2*M_PI/(double(newN[a])*d[a]);
+  }
+  Setup_Grid(dim);
+
+  for ( int c=0; c<no_int_states; c++ )
+  {
+    T *field = new T( m_header );
+    field->SetFix(false);
+    Remap_Grid( m_fields[c]->Getp2In(), field->Getp2In(), oldN, newN );
+    delete m_fields[c];
+    m_fields[c] = field;
+  }
+
+  m_kinetic.clear();
+  Init();
+
+  m_grid_id++;
+  m_obs_k.mask = 0;
+  std::cout << "FYI: regrid to      : " << m_header.nDimX << " x " << m_header.nDimY << " x " << m_header.nDimZ << "\n";
+}
+
+/** Calculate the expectation value of the postion of an internal state
+  *
+  * @param retval Reference to a CPoint object in which the expectation value will be saved
+  * @param comp Compute the expectation value of the internal state comp
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Expval_Position( CPoint<dim> &retval, const int comp )
+{
+  if ( comp<0 || comp>=no_int_states ) throw std::string("Error in " + std::string(__func__) + ": comp out of bounds\n");
 
-  delete [] tmp;
+  observables obs;
+  Measure( obs_x, obs, comp );
+  retval = obs.x[comp];
+}
 
-  m_fields[comp]->ft(1);
+/** Calculate the expectation value of the momentum of an internal state
+  *
+  * @param retval Reference to a CPoint object in which the expectation value will be saved
+  * @param comp Compute the expectation value of the internal state comp
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Expval_Momentum( CPoint<dim> &retval, const int comp )
+{
+  if ( comp<0 || comp>=no_int_states ) throw std::string("Error in " + std::string(__func__) + ": comp out of bounds\n");
 
-  for (int i=0; i<dim; i++ )
-    retval[i] = m_ar_k*res[i];
+  observables obs;
+  Measure( obs_p, obs, comp );
+  retval = obs.p[comp];
 }
 
 /** Compute the number of particles of an internal state
@@ -586,16 +1292,276 @@ void CRT_Base<T,dim,no_int_states>::Expval_Momentum( CPoint<dim> &retval, const
 template <class T, int dim, int no_int_states>
 double CRT_Base<T,dim,no_int_states>::Get_Particle_Number( const int comp )
 {
-  if ( comp<0 || comp>no_int_states ) throw std::string("Error in " + std::string(__func__) + ": comp out of bounds\n");
+  if ( comp<0 || comp>=no_int_states ) throw std::string("Error in " + std::string(__func__) + ": comp out of bounds\n");
+
+  observables obs;
+  Measure( obs_N, obs, comp );
+  return obs.N[comp];
+}
+
+/** Measure a set of observables of all internal states (or of a single one)
+  *
+  * The observables in position space (N, x, x2, coherence) are reduced in one sweep over all internal states,
+  * as are the ones in momentum space (p, p2). The latter are taken from the last kinetic step if it has recorded
+  * them (see Request_Observables()), otherwise the fields are transformed once for the measurement.
+  * The energy is the sum of the kinetic energy, which is taken from the second moments of the wave number,
+  * and of the potential and interaction energies of Potential_Energy().
+  * @param mask Combination of enum observable
+  * @param obs Results, only the observables in mask are set
+  * @param comp Internal state to be measured or -1 for all states (overlaps and the energy need all states)
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Measure( const int mask, observables &obs, const int comp )
+{
+  if ( comp<-1 || comp>=no_int_states ) throw std::string("Error in " + std::string(__func__) + ": comp out of bounds\n");
+  Phase_Scope timer( ph_observables );
+
+  const int S = no_int_states;
+  const int s0 = ( comp < 0 ) ? 0 : comp;
+  const int s1 = ( comp < 0 ) ? S : comp+1;
+  const bool energy = ( mask & obs_E );
+  const int pos = (mask & (obs_N|obs_x|obs_x2|obs_coherence)) | ( energy ? obs_N : 0 );
+  const int mom = (mask & (obs_p|obs_p2)) | ( energy ? obs_p2 : 0 );
+  double sum[S*(1+2*dim)+2*S*S];
 
-  fftw_complex *Psi=m_fields[comp]->Getp2In();
-  double retval=0.0;
-  #pragma omp parallel for reduction(+:retval)
+  if ( energy && comp >= 0 ) throw std::string("Error in " + std::string(__func__) + ": the energy needs all internal states\n");
+  obs.mask = mask | pos | mom;
+
+  if ( pos != 0 )
+  {
+    Sweep( pos, s0, s1, m_axis_x, sum );
+    for ( int s=s0; s<s1; s++ )
+    {
+      obs.N[s] = m_ar*sum[s];
+      for ( int a=0; a<dim; a++ )
+      {
+        obs.x[s][a] = m_ar*sum[S+s*dim+a];
+        obs.x2[s][a] = m_ar*sum[S*(1+dim)+s*dim+a];
+      }
+      obs.coherence[s][s][0] = obs.N[s];
+      obs.coherence[s][s][1] = 0;
+      for ( int t=s+1; t<s1; t++ )
+      {
+        obs.coherence[s][t][0] = obs.coherence[t][s][0] = m_ar*sum[S*(1+2*dim)+2*(s*S+t)];
+        obs.coherence[s][t][1] = m_ar*sum[S*(1+2*dim)+2*(s*S+t)+1];
+        obs.coherence[t][s][1] = -obs.coherence[s][t][1];
+      }
+    }
+  }
+
+  if ( mom != 0 && (m_obs_k.mask & mom) == mom )
+  {
+    for ( int s=s0; s<s1; s++ )
+    {
+      obs.p[s] = m_obs_k.p[s];
+      obs.p2[s] = m_obs_k.p2[s];
+    }
+  }
+  else if ( mom != 0 )
+  {
+    Transform( -1, s0, s1 );
+    Sweep( mom, s0, s1, ( m_distributed ? nullptr : m_axis_k ), sum );
+    Transform( 1, s0, s1 );
+
+    for ( int s=s0; s<s1; s++ )
+    {
+      for ( int a=0; a<dim; a++ )
+      {
+        obs.p[s][a] = m_ar_k*sum[S+s*dim+a];
+        obs.p2[s][a] = m_ar_k*sum[S*(1+dim)+s*dim+a];
+      }
+    }
+  }
+
+  if ( !energy ) return;
+
+  double N = 0;
+  obs.E_kin = 0;
+  for ( int s=0; s<S; s++ )
+  {
+    N += obs.N[s];
+    for ( int a=0; a<dim; a++ )
+      obs.E_kin += m_alpha[a]*obs.p2[s][a]/m_T;
+  }
+  Potential_Energy( obs.E_pot, obs.E_int );
+  obs.E = obs.E_kin + obs.E_pot + obs.E_int;
+  obs.mu = ( N > 0 ) ? (obs.E_kin + obs.E_pot + 2*obs.E_int)/N : 0;
+}
+
+/** Computes the potential and the contact interaction energy in rad/s
+  *
+  * Uses the potentials of Setup_Potential() and the contact interactions of section INTERACTIONS.
+  * @param E_pot Potential energy of all internal states
+  * @param E_int Interaction energy
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Potential_Energy( double &E_pot, double &E_int )
+{
+  fftw_complex *Psi[no_int_states];
+  for ( int i=0; i<no_int_states; i++ )
+    Psi[i] = Field(i);
+
+  double pot = 0, inter = 0;
+  #pragma omp parallel for reduction(+:pot,inter)
   for ( int l=0; l<m_no_of_pts; l++ )
   {
-    retval += (Psi[l][0]*Psi[l][0] + Psi[l][1]*Psi[l][1]);
+    const int lp = l*m_stride;
+    if ( m_potenial_initialized )
+      for ( int i=0; i<no_int_states; i++ )
+        pot += m_Potential[i][l]*(Psi[i][lp][0]*Psi[i][lp][0] + Psi[i][lp][1]*Psi[i][lp][1]);
+    if ( m_interacting ) inter += Interaction_Energy( Psi, lp );
   }
-  return m_ar*retval;
+  double res[2] = { pot, inter };
+  Reduce_Sum( res, 2 );
+
+  E_pot = m_ar*res[0]/m_T;
+  E_int = m_ar*res[1];
+}
+
+/** Fused reduction over all local points of the internal states s0..s1-1
+  *
+  * The results are summed over all processes and stored in sum in the order: density of each state, first
+  * moments of each state and direction, second moments of each state and direction, overlaps of each pair of
+  * states (real and imaginary part at 2*(s*no_int_states+t) behind the second moments).
+  * @param mask Combination of enum observable, position and momentum moments share the same slots
+  * @param s0 First internal state
+  * @param s1 Last internal state + 1
+  * @param axis Coordinates along each direction (m_axis_x or m_axis_k), nullptr for coordinates from Get_k()
+  * @param sum Results, no_int_states*(1+2*dim)+2*no_int_states*no_int_states values
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Sweep( const int mask, const int s0, const int s1, const std::vector<double> *axis, double *sum )
+{
+  const int n = no_int_states*(1+2*dim) + 2*no_int_states*no_int_states;
+  double res[n] = {};
+
+  fftw_complex *Psi[no_int_states];
+  for ( int s=0; s<no_int_states; s++ )
+    Psi[s] = Field(s);
+  const int64_t st = m_stride;
+
+  if ( axis != nullptr )
+  {
+    const int64_t N0 = axis[0].size();
+    const int64_t N1 = ( dim > 1 ) ? axis[1].size() : 1;
+    const int64_t N2 = ( dim > 2 ) ? axis[2].size() : 1;
+    const double *A0 = axis[0].data(), *A1 = axis[1].data(), *A2 = axis[2].data();
+
+    #pragma omp parallel for collapse(2) reduction(+:res[:n])
+    for ( int64_t i=0; i<N0; i++ )
+    {
+      for ( int64_t j=0; j<N1; j++ )
+      {
+        double X[3] = { A0[i], 0, 0 };
+        if ( dim > 1 ) X[1] = A1[j];
+        for ( int64_t k=0; k<N2; k++ )
+        {
+          if ( dim > 2 ) X[2] = A2[k];
+          Accumulate( Psi, ((i*N1+j)*N2+k)*st, X, s0, s1, mask, res );
+        }
+      }
+    }
+  }
+  else
+  {
+    #pragma omp parallel for reduction(+:res[:n])
+    for ( int64_t l=0; l<m_no_of_pts_k; l++ )
+    {
+      CPoint<dim> k = m_fields[0]->Get_k(l);
+      double X[3] = {};
+      for ( int a=0; a<dim; a++ )
+        X[a] = k[a];
+      Accumulate( Psi, l*st, X, s0, s1, mask, res );
+    }
+  }
+
+  Reduce_Sum( res, n );
+  std::copy( res, res+n, sum );
+}
+
+/** Takes the momentum observables requested by Request_Observables() while the fields are in fourier space
+  *
+  * Called by the kinetic steps right after the forward transform. The kinetic step does not change
+  * \f$ |\Psi(\vec{k})|^2 \f$, so the results hold for the fields after the step.
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Take_Momentum_Observables()
+{
+  m_obs_k.mask = m_obs_request;
+  m_obs_request = 0;
+  if ( m_obs_k.mask == 0 ) return;
+  Phase_Scope timer( ph_observables );
+
+  const int S = no_int_states;
+  double sum[S*(1+2*dim)+2*S*S];
+  Sweep( m_obs_k.mask, 0, S, ( m_distributed ? nullptr : m_axis_k ), sum );
+
+  for ( int s=0; s<S; s++ )
+  {
+    for ( int a=0; a<dim; a++ )
+    {
+      m_obs_k.p[s][a] = m_ar_k*sum[S+s*dim+a];
+      m_obs_k.p2[s][a] = m_ar_k*sum[S*(1+dim)+s*dim+a];
+    }
+  }
+}
+
+/** Let the next kinetic step record the momentum observables needed after it
+  *
+  * These are the momenta in OBSERVABLES, the second moments for the kinetic energy and, in the co-moving
+  * frame, the momenta for Recenter_Frame().
+  * Called before the last half step of each output interval.
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Request_Observables()
+{
+  m_obs_request = m_observables & (obs_p|obs_p2);
+  if ( m_observables & obs_E ) m_obs_request |= obs_p2;
+  if ( m_frame_mode == frame::comoving ) m_obs_request |= obs_p;
+}
+
+/** Print the particle numbers of all internal states, measured in one sweep
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Print_Particle_Numbers()
+{
+  observables obs;
+  Measure( obs_N, obs );
+  std::ostringstream lines;
+  for ( int c=0; c<no_int_states; c++ )
+    lines << "N[" << c << "] = " << obs.N[c] << "\n";
+  Solver_Progress().Post( lines.str() );
+}
+
+/** Append the observables selected by OBSERVABLES in section ALGORITHM to observables.txt
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Write_Observables()
+{
+  if ( m_observables == 0 ) return;
+  Phase_Scope timer( ph_io );
+
+  observables obs;
+  Measure( m_observables, obs );
+  if ( Get_Rank() != 0 ) return;
+
+  std::ofstream file1( "observables.txt", std::ios::app );
+  file1 << m_header.t;
+  for ( int s=0; s<no_int_states; s++ )
+  {
+    if ( m_observables & obs_N ) file1 << " " << obs.N[s];
+    for ( int a=0; a<dim; a++ ) if ( m_observables & obs_x ) file1 << " " << obs.x[s][a];
+    for ( int a=0; a<dim; a++ ) if ( m_observables & obs_x2 ) file1 << " " << obs.x2[s][a];
+    for ( int a=0; a<dim; a++ ) if ( m_observables & obs_p ) file1 << " " << obs.p[s][a];
+    for ( int a=0; a<dim; a++ ) if ( m_observables & obs_p2 ) file1 << " " << obs.p2[s][a];
+  }
+  if ( m_observables & obs_coherence )
+    for ( int s=0; s<no_int_states; s++ )
+      for ( int t=s+1; t<no_int_states; t++ )
+        file1 << " " << obs.coherence[s][t][0] << " " << obs.coherence[s][t][1];
+  if ( m_observables & obs_E )
+    file1 << " " << obs.E_kin << " " << obs.E_pot << " " << obs.E_int << " " << obs.E << " " << obs.mu;
+  file1 << "\n";
 }
 
 /** Write an internal state to a binary file
@@ -608,13 +1574,7 @@ void CRT_Base<T,dim,no_int_states>::Save_Phi( std::string filename, const int co
 {
   if ( comp<0 || comp>no_int_states ) throw std::string("Error in " + std::string(__func__) + ": comp out of bounds\n");
 
-  char *header = reinterpret_cast<char *>(&m_header);
-  char *Psi = reinterpret_cast<char *>(m_fields[comp]->Getp2In());
-
-  ofstream file1( filename, ofstream::binary );
-  file1.write( header, sizeof(generic_header) );
-  file1.write( Psi, m_no_of_pts*sizeof(fftw_complex) );
-  file1.close();
+  Write_Field( filename, m_header, Gather(comp) );
 }
 
 /** Append an internal state to a binary file
@@ -627,17 +1587,7 @@ void CRT_Base<T,dim,no_int_states>::Append_Phi( std::string filename, const int
 {
   if ( comp<0 || comp>no_int_states ) throw std::string("Error in " + std::string(__func__) + ": comp out of bounds\n");
 
-  char *header = reinterpret_cast<char *>(&m_header);
-  char *Psi = reinterpret_cast<char *>(m_fields[comp]->Getp2In());
-
-  ofstream file1( filename, ofstream::binary | ofstream::app );
-  if (file1.fail()) {
-    cout << "File " << filename << " could not be opened. Failbit: " << file1.rdstate() << endl;
-    exit(EXIT_FAILURE);
-  }
-  file1.write( header, sizeof(generic_header) );
-  file1.write( Psi, m_no_of_pts*sizeof(fftw_complex) );
-  file1.close();
+  Write_Field( filename, m_header, Gather(comp), true );
 }
 
 /** Write an array of doubles to a binary file
@@ -668,13 +1618,7 @@ void CRT_Base<T,dim,no_int_states>::Save( double *data, std::string filename )
 template <class T, int dim, int no_int_states>
 void CRT_Base<T,dim,no_int_states>::Save( fftw_complex *data, std::string filename )
 {
-  char *header = reinterpret_cast<char *>(&m_header);
-  char *Psi = reinterpret_cast<char *>(data);
-
-  ofstream file1( filename, ofstream::binary );
-  file1.write( header, sizeof(generic_header) );
-  file1.write( Psi, m_no_of_pts*sizeof(fftw_complex) );
-  file1.close();
+  Write_Field( filename, m_header, data );
 }
 
 /** Run all the sequences defined in the xml file
@@ -713,6 +1657,7 @@ void CRT_Base<T,dim,no_int_states>::run_sequence()
   //Loop through all sequences
   for ( auto seq : m_params->m_sequence )
   {
+    Solver_Timers().Begin_Sequence( seq.name );
     if ( run_custom_sequence(seq) ) continue;
 
     if ( seq.name == "set_momentum" ) //Call Setup_Momentum
@@ -773,6 +1718,7 @@ void CRT_Base<T,dim,no_int_states>::run_sequence()
       std::remove(filename);
     }
 
+    Solver_Progress().Begin_Sequence( seq.name, seq_counter, (long long)Na*Nk, no_int_states*this->Get_Global_Points(), m_header.t );
     for ( int i=1; i<=Na; i++ )
     {
       (*half_step_fct)(this,seq);    // exp(T/2)
@@ -782,9 +1728,11 @@ void CRT_Base<T,dim,no_int_states>::run_sequence()
         (*full_step_fct)(this,seq);  // exp(T)
       }
       (*step_fct)(this,seq);         // exp(V)
+      this->Request_Observables();
       (*half_step_fct)(this,seq);    // exp(T/2)
 
-      std::cout << "t = " << to_string(m_header.t) << std::endl;
+      Solver_Progress().Step( Nk, m_header.t );
+      this->Write_Observables();
 
       if ( seq.output_freq == freq::each )
       {
@@ -806,14 +1754,17 @@ void CRT_Base<T,dim,no_int_states>::run_sequence()
 
       if ( seq.compute_pn_freq == freq::each )
       {
-        for ( int c=0; c<no_int_states; c++ )
-          std::cout << "N[" << c << "] = " << this->Get_Particle_Number(c) << std::endl;
+        this->Print_Particle_Numbers();
       }
 
       if ( seq.custom_freq == freq::each && m_custom_fct != nullptr )
       {
+        m_obs_k.mask = 0;
         (*m_custom_fct)(this,seq);
       }
+
+      this->Recenter_Frame();
+      this->Check_Grid();
     }
 
     if ( seq.output_freq == freq::last )
@@ -827,17 +1778,19 @@ void CRT_Base<T,dim,no_int_states>::run_sequence()
 
     if ( seq.compute_pn_freq == freq::last )
     {
-      for ( int c=0; c<no_int_states; c++ )
-        std::cout << "N[" << c << "] = " << this->Get_Particle_Number(c) << std::endl;
+      this->Print_Particle_Numbers();
     }
 
     if ( seq.custom_freq == freq::last && m_custom_fct != nullptr )
     {
+      m_obs_k.mask = 0;
       (*m_custom_fct)(this,seq);
     }
 
+    Solver_Progress().End_Sequence();
     seq_counter++;
   } // end of sequence loop
+  this->Write_Timers();
 }
 
 /// Defines Output for << operator for CRT_Base objects
@@ -23,10 +23,12 @@
 #include <array>
 
 #include "CRT_Base.h"
+#include "ExprSplitter.h"
 #include "ParameterHandler.h"
 #include "gsl/gsl_complex_math.h"
 #include "gsl/gsl_eigen.h"
 #include "gsl/gsl_blas.h"
+#include "herm_exp.h"
 #include "muParser.h"
 
 using namespace std;
@@ -51,26 +53,80 @@ protected:
   using CRT_Base<T,dim,no_int_states>::m_header;
   using CRT_Base<T,dim,no_int_states>::m_params;
   using CRT_Base<T,dim,no_int_states>::m_fields;
+  using CRT_Base<T,dim,no_int_states>::m_stride;
+  using CRT_Base<T,dim,no_int_states>::Field;
   using CRT_Base<T,dim,no_int_states>::m_custom_fct;
   using CRT_shared::m_no_of_pts;
 
   CPoint<dim> x;
   double t;
 
-  double psi_real_array[50];
-  double psi_imag_array[50];
+  double psi_real_array[no_int_states];
+  double psi_imag_array[no_int_states];
 
   bool position_dependent;
   bool time_dependent;
   bool nonlinear;
 
   mu::Parser* V_parser;
+  /// Results of V_parser for all points (or a single point if the Hamiltonian is position independent), lives in the scratch region of the arena
+  arena_vector<double,arena_scratch> m_V_eval;
+  /// Offset between the results of two points in m_V_eval as used by the last interaction step
+  int m_V_stride;
+  /// Whether the last interaction step used m_V_eval as the upper triangle of the matrix (or the diagonal only)
+  bool m_V_matrix;
+  /// Blocks of states coupled by the Hamiltonian of the sequence, see Numerical_Diagonalization()
+  coupling_graph m_coupling;
 
   static void Do_NL_Step_Wrapper(void *,sequence_item &);
   static void Numerical_Diagonalization_Wrapper(void *,sequence_item &);
 
   void Do_NL_Step();
   void Numerical_Diagonalization();
+  int Eval_Hamiltonian();
+  void Setup_Hamiltonian( const sequence_item & );
+  void Potential_Energy( double &, double & ) override;
+
+  void Setup_Separation( const sequence_item & );
+  void Tabulate_Separation();
+
+  /// Whether the Hamiltonian is evaluated in separated form (see Setup_Separation())
+  bool m_separable;
+  /// Whether m_V_eval holds the separated Hamiltonian of a time independent sequence
+  bool m_sep_cached;
+  /// Number of results of the Hamiltonian (real and imaginary parts of the matrix elements)
+  int m_sep_num;
+  /// Evaluates the time factors of all separated terms at once
+  mu::Parser *m_sep_parser;
+  /// Position factor of separated terms, either as a product of factors of single directions or on the full grid
+  struct sep_table
+  {
+    std::string expr; ///< position factor
+    bool full; ///< true if a factor depends on more than one direction
+    std::string axis[3]; ///< product of the factors of each direction (empty for 1)
+    arena_vector<double,arena_scratch> grid; ///< expr on the full grid (full tables only)
+    std::vector<double> axis_val[3]; ///< axis[a] along direction a (ones if axis[a] is empty)
+  };
+  /// Position factors of the separated terms
+  std::vector<sep_table> m_sep_tables;
+  /// Result index and table index (-1 if constant in space) of each separated term
+  std::vector<int> m_sep_result;
+  std::vector<int> m_sep_table;
+  /// m_grid_id at the time of the tabulation
+  int m_sep_grid_id;
+
+  void Setup_Gauge( const sequence_item & );
+  void Tabulate_Gauge();
+  void Gauge_Phases( const int64_t, double * ) const;
+
+  /// Whether the interaction step removes the plane wave phases of the couplings (see Setup_Gauge())
+  bool m_gauge;
+  /// Wave vector of each internal state, the coupling (i,j) carries the phase exp(i (q_i-q_j) x)
+  double m_gauge_q[no_int_states][3];
+  /// exp(i q_s x) along direction a for internal state s at [s][a], real and imaginary parts interleaved
+  std::vector<double> m_gauge_axis[no_int_states][3];
+  /// m_grid_id at the time of the tabulation
+  int m_gauge_grid_id;
 
   void UpdateParams();
 
@@ -91,6 +147,13 @@ CRT_Base_IF<T,dim,no_int_states>::CRT_Base_IF( ParameterHandler *params ) : CRT_
   this->m_map_stepfcts["freeprop"] = &Do_NL_Step_Wrapper;
   this->m_map_stepfcts["interact"] = &Numerical_Diagonalization_Wrapper;
 
+  m_separable = false;
+  m_gauge = false;
+  m_sep_parser = nullptr;
+  V_parser = nullptr;
+  m_V_stride = 0;
+  m_V_matrix = false;
+
   UpdateParams();
 }
 
@@ -98,6 +161,8 @@ CRT_Base_IF<T,dim,no_int_states>::CRT_Base_IF( ParameterHandler *params ) : CRT_
 template <class T, int dim, int no_int_states>
 CRT_Base_IF<T,dim,no_int_states>::~CRT_Base_IF()
 {
+  delete m_sep_parser;
+  delete V_parser;
 }
 
 /** Set values to interferometer variables from xml (m_params)
@@ -142,169 +207,573 @@ void CRT_Base_IF<T,dim,no_int_states>::Numerical_Diagonalization_Wrapper ( void
   self->Numerical_Diagonalization();
 }
 
-/** Solves the potential part without any external fields but
-  * gravity.
+/** Evaluates V_parser for all points and stores the results in m_V_eval
+  *
+  * The parser is not thread safe, hence this is done serially. Position independent and linear Hamiltonians are
+  * evaluated only once.
+  * @return Offset between the results of two successive points in m_V_eval (0 if evaluated only once)
   */
 template <class T, int dim, int no_int_states>
-void CRT_Base_IF<T,dim,no_int_states>::Do_NL_Step()
+int CRT_Base_IF<T,dim,no_int_states>::Eval_Hamiltonian()
 {
-  const double dt = -m_header.dt*this->Get_t_scale();
+  Phase_Scope timer( ph_potential );
   this->t = this->Get_t()*this->Get_t_scale();
-  double re1, im1, tmp1, phi[no_int_states];
 
-  int nNum = this->V_parser->GetNumResults();
-  vector<fftw_complex *> Psi;
-  //Vector for the components of the wavefunction
-  for ( int i=0; i<no_int_states; i++ )
-    Psi.push_back(m_fields[i]->Getp2In());
+  if ( m_gauge )
+  {
+    // H(0,t), the phases of the couplings are applied by Numerical_Diagonalization()
+    this->x = 0.0;
+    int nNum = this->V_parser->GetNumResults();
+    const double *V_ptr = this->V_parser->Eval(nNum);
+    m_V_eval.assign(V_ptr,V_ptr+nNum);
+    return 0;
+  }
 
-  if (this->nonlinear == true) //Calculate V(psi(r,t),r,t) at t for all r
+  if ( m_separable )
   {
-    for ( int l=0; l<this->m_no_of_pts; l++ )
+    const int nNum = m_sep_num;
+    if ( m_sep_grid_id != this->m_grid_id ) Tabulate_Separation();
+    if ( m_sep_cached ) return nNum;
+
+    int nF;
+    const double *F = m_sep_parser->Eval(nF);
+
+    m_V_eval.assign((size_t)m_no_of_pts*nNum,0.0);
+    double *V_eval = m_V_eval.data();
+    const long long NX = this->m_axis_x[0].size(), NY = this->m_axis_x[1].size(), NZ = this->m_axis_x[2].size();
+
+    #pragma omp parallel
     {
-        //vector<fftw_complex *> psi;
-        for ( int i=0; i<no_int_states; i++ )
+      for ( int k=0; k<nF; k++ )
+      {
+        const double f = F[k];
+        const int n = m_sep_result[k];
+
+        if ( m_sep_table[k] < 0 )
         {
-          //psi.push_back(m_fields[i]->Getp2In());
-          this->psi_real_array[i] = Psi[i][l][0];
-          this->psi_imag_array[i] = Psi[i][l][1];
+          #pragma omp for
+          for ( int l=0; l<this->m_no_of_pts; l++ )
+            V_eval[(size_t)l*nNum+n] += f;
+          continue;
         }
-        this->x = this->m_fields[0]->Get_x(l);
-        double *V_ptr = this->V_parser->Eval(nNum);
-        for ( int i=0; i<no_int_states; i++ )
+
+        const sep_table &table = m_sep_tables[m_sep_table[k]];
+        if ( table.full )
         {
-        double V_real = *(V_ptr+(2*i));
-        phi[i] = V_real*dt;
+          const double *P = table.grid.data();
+          #pragma omp for
+          for ( int l=0; l<this->m_no_of_pts; l++ )
+            V_eval[(size_t)l*nNum+n] += f*P[l];
+          continue;
         }
-      
-      //Compute exponential: exp(V)*Psi
+
+        // outer product of the factors of each direction
+        const double *Px = table.axis_val[0].data();
+        const double *Py = table.axis_val[1].data();
+        const double *Pz = table.axis_val[2].data();
+        #pragma omp for
+        for ( long long i=0; i<NX; i++ )
+        {
+          for ( long long j=0; j<NY; j++ )
+          {
+            const double fxy = f*Px[i]*Py[j];
+            double *row = V_eval + ((i*NY+j)*NZ)*nNum + n;
+            for ( long long l=0; l<NZ; l++ )
+              row[l*nNum] += fxy*Pz[l];
+          }
+        }
+      }
+    }
+    m_sep_cached = !this->time_dependent;
+    return nNum;
+  }
+
+  int nNum = this->V_parser->GetNumResults();
+  double *V_ptr = this->V_parser->Eval(nNum); // initializes nNum
+
+  if ( this->position_dependent == false && this->nonlinear == false ) //Calculate V(t) at t
+  {
+    m_V_eval.assign(V_ptr,V_ptr+nNum);
+    return 0;
+  }
+
+  m_V_eval.resize((size_t)m_no_of_pts*nNum);
+
+  vector<fftw_complex *> Psi;
+  for ( int i=0; i<no_int_states; i++ )
+    Psi.push_back(Field(i));
+
+  for ( int l=0; l<this->m_no_of_pts; l++ ) //Calculate V(psi(r,t),r,t) at t for all r
+  {
+    if ( this->nonlinear == true )
+    {
       for ( int i=0; i<no_int_states; i++ )
       {
-        sincos( phi[i], &im1, &re1 );
+        this->psi_real_array[i] = Psi[i][(size_t)l*m_stride][0];
+        this->psi_imag_array[i] = Psi[i][(size_t)l*m_stride][1];
+      }
+    }
+    this->x = this->Get_x_lab(l);
+    V_ptr = this->V_parser->Eval(nNum);
+    std::copy( V_ptr, V_ptr+nNum, &m_V_eval[(size_t)l*nNum] );
+  }
+  return nNum;
+}
+
+/** Tries to split the Hamiltonian of a sequence into terms \f$ F_k(t) P_k(\vec{x}) \f$
+  *
+  * If successful, the position factors \f$ P_k \f$ are tabulated once per sequence (see Tabulate_Separation())
+  * and only the scalar time factors \f$ F_k \f$ are evaluated in each step. Only linear Hamiltonians in
+  * the lab frame are separated, since the position of the grid changes in the other frames. The
+  * separation can be switched off with SEPARATE=0 in section ALGORITHM.
+  * @param seq Sequence whose Hamiltonian is separated
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Setup_Separation( const sequence_item &seq )
+{
+  m_separable = false;
+  m_sep_cached = false;
+  m_sep_tables.clear();
+  m_sep_result.clear();
+  m_sep_table.clear();
+  delete m_sep_parser;
+  m_sep_parser = nullptr;
+
+  // nothing of the previous sequence is left in the scratch region of the arena
+  arena_vector<double,arena_scratch>().swap(m_V_eval);
+  Solver_Arena().Reset_Scratch();
+
+  if ( !this->position_dependent || this->nonlinear || this->m_frame_mode != frame::lab ) return;
+  if ( m_params->Get_Algorithm("SEPARATE",1) == 0 ) return;
+
+  std::vector<std::string> elements;
+  for ( unsigned i=0; i<seq.V_real.size(); i++ )
+  {
+    elements.push_back(seq.V_real[i]);
+    elements.push_back(seq.V_imag[i]);
+  }
+
+  ExprSplitter splitter( m_params->m_map_constants );
+  std::map<std::string,int> tables;
+  std::string time_expression;
+
+  for ( unsigned n=0; n<elements.size(); n++ )
+  {
+    std::vector<separated_term> terms;
+    if ( !splitter.Separate( elements[n], terms ) )
+    {
+      m_sep_result.clear();
+      m_sep_table.clear();
+      m_sep_tables.clear();
+      return;
+    }
+
+    for ( auto term : terms )
+    {
+      int table = -1;
+      if ( !term.position_factors.empty() )
+      {
+        std::string P = "(" + term.position_factors[0] + ")";
+        for ( unsigned i=1; i<term.position_factors.size(); i++ )
+          P += "*(" + term.position_factors[i] + ")";
 
-        tmp1 = Psi[i][l][0];
-        Psi[i][l][0] = Psi[i][l][0]*re1 - Psi[i][l][1]*im1;
-        Psi[i][l][1] = Psi[i][l][1]*re1 + tmp1*im1;
+        auto it = tables.find(P);
+        if ( it == tables.end() )
+        {
+          it = tables.insert( std::make_pair( P, int(m_sep_tables.size()) ) ).first;
+
+          sep_table tab;
+          tab.expr = P;
+          tab.full = false;
+          for ( auto f : term.position_factors )
+          {
+            const int dep = splitter.Classify(f) & (dep_x|dep_y|dep_z);
+            const int a = ( dep == dep_x ) ? 0 : ( dep == dep_y ) ? 1 : 2;
+            if ( dep != dep_x && dep != dep_y && dep != dep_z )
+              tab.full = true;
+            else
+              tab.axis[a] += ( tab.axis[a].empty() ? "(" : "*(" ) + f + ")";
+          }
+          m_sep_tables.push_back(tab);
+        }
+        table = it->second;
       }
+      m_sep_result.push_back(n);
+      m_sep_table.push_back(table);
+      time_expression += ( time_expression.empty() ? "" : "," ) + term.time;
     }
   }
 
-  if ( (this->position_dependent == true) and (this->nonlinear == false)) //Calculate V(r,t) at t for all r
+  m_sep_parser = new mu::Parser;
+  for ( auto it : m_params->m_map_constants )
+    m_sep_parser->DefineConst(it.first, it.second);
+  m_sep_parser->DefineConst("pi", (double)M_PI);
+  m_sep_parser->DefineConst("e", (double)M_E);
+  m_sep_parser->DefineVar("t", &this->t);
+  m_sep_parser->SetExpr(time_expression);
+
+  m_sep_num = elements.size();
+  m_sep_grid_id = -1;
+  m_separable = true;
+
+  int no_full = 0;
+  for ( auto &tab : m_sep_tables )
+    if ( tab.full ) no_full++;
+  std::cout << "FYI: Hamiltonian separated into " << m_sep_result.size() << " terms with " << m_sep_tables.size() << " position factors (" << no_full << " not separable by direction)\n";
+}
+
+/** Tabulates the position factors of the separated Hamiltonian on the current grid
+  *
+  * Factors which are products of functions of single directions are tabulated along each direction only
+  * (NX+NY+NZ evaluations), the remaining ones on the full grid.
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Tabulate_Separation()
+{
+  const long long N[3] = { (long long)this->m_axis_x[0].size(), (long long)this->m_axis_x[1].size(), (long long)this->m_axis_x[2].size() };
+  int nNum;
+
+  mu::Parser parser;
+  for ( auto it : m_params->m_map_constants )
+    parser.DefineConst(it.first, it.second);
+  parser.DefineConst("pi", (double)M_PI);
+  parser.DefineConst("e", (double)M_E);
+  parser.DefineVar("x", &this->x[0]);
+  if (dim >= 2) parser.DefineVar("y", &this->x[1]);
+  if (dim == 3) parser.DefineVar("z", &this->x[2]);
+
+  // factors of single directions
+  for ( int a=0; a<3; a++ )
   {
-    for ( int l=0; l<this->m_no_of_pts; l++ )
+    std::vector<sep_table *> tabs;
+    std::string expression;
+    for ( auto &tab : m_sep_tables )
     {
-        this->x = this->m_fields[0]->Get_x(l);
-        double *V_ptr = this->V_parser->Eval(nNum);
-        for ( int i=0; i<no_int_states; i++ )
+      tab.axis_val[a].assign( N[a], 1.0 );
+      if ( tab.full || tab.axis[a].empty() || a >= dim ) continue;
+      expression += ( expression.empty() ? "" : "," ) + tab.axis[a];
+      tabs.push_back(&tab);
+    }
+    if ( tabs.empty() ) continue;
+
+    parser.SetExpr(expression);
+    for ( int i=0; i<dim; i++ )
+      this->x[i] = 0;
+    for ( long long i=0; i<N[a]; i++ )
+    {
+      this->x[a] = this->m_axis_x[a][i] + this->m_frame_x[a];
+      double *V_ptr = parser.Eval(nNum);
+      for ( unsigned k=0; k<tabs.size(); k++ )
+        tabs[k]->axis_val[a][i] = V_ptr[k];
+    }
+  }
+
+  // factors on the full grid
+  std::vector<sep_table *> tabs;
+  std::string expression;
+  for ( auto &tab : m_sep_tables )
+  {
+    tab.grid.clear();
+    if ( !tab.full ) continue;
+    expression += ( expression.empty() ? "" : "," ) + tab.expr;
+    tab.grid.resize(m_no_of_pts);
+    tabs.push_back(&tab);
+  }
+  if ( !tabs.empty() )
+  {
+    parser.SetExpr(expression);
+    long long l = 0;
+    for ( long long i=0; i<N[0]; i++ )
+      for ( long long j=0; j<N[1]; j++ )
+        for ( long long k=0; k<N[2]; k++, l++ )
         {
-          double V_real = *(V_ptr+(2*i));
-          phi[i] = V_real*dt;
+          const long long idx[3] = { i, j, k };
+          for ( int a=0; a<dim; a++ )
+            this->x[a] = this->m_axis_x[a][idx[a]] + this->m_frame_x[a];
+          double *V_ptr = parser.Eval(nNum);
+          for ( unsigned m=0; m<tabs.size(); m++ )
+            tabs[m]->grid[l] = V_ptr[m];
         }
-      
+  }
+
+  m_sep_grid_id = this->m_grid_id;
+  m_sep_cached = false;
+}
+
+/** Solves the diagonal potential part and the contact interactions
+  *
+  * The Hamiltonian strings are evaluated with Eval_Hamiltonian(), the contact interactions of section
+  * INTERACTIONS are added in the same pass which computes the exponentials.
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Do_NL_Step()
+{
+  const double dt = -m_header.dt*this->Get_t_scale();
+  const int stride = Eval_Hamiltonian();
+  const double *V_eval = m_V_eval.data();
+  m_V_stride = stride;
+  m_V_matrix = false;
+
+  fftw_complex *Psi[no_int_states];
+  for ( int i=0; i<no_int_states; i++ )
+    Psi[i] = Field(i);
+
+  #pragma omp parallel
+  {
+    double re1, im1, tmp1, phi[no_int_states];
+
+    Phase_Scope timer( ph_nonlinear );
+    #pragma omp for nowait
+    for ( int l=0; l<this->m_no_of_pts; l++ )
+    {
+      const int lp = l*m_stride;
+      const double *V = V_eval + (size_t)l*stride;
+      for ( int i=0; i<no_int_states; i++ )
+        phi[i] = V[2*i];
+      if ( this->m_interacting ) this->Add_Interaction( Psi, lp, phi );
+
       //Compute exponential: exp(V)*Psi
       for ( int i=0; i<no_int_states; i++ )
       {
-        sincos( phi[i], &im1, &re1 );
+        sincos( phi[i]*dt, &im1, &re1 );
 
-        tmp1 = Psi[i][l][0];
-        Psi[i][l][0] = Psi[i][l][0]*re1 - Psi[i][l][1]*im1;
-        Psi[i][l][1] = Psi[i][l][1]*re1 + tmp1*im1;
+        tmp1 = Psi[i][lp][0];
+        Psi[i][lp][0] = Psi[i][lp][0]*re1 - Psi[i][lp][1]*im1;
+        Psi[i][lp][1] = Psi[i][lp][1]*re1 + tmp1*im1;
       }
     }
   }
+}
+
+
+/** Computes the potential and the contact interaction energy in rad/s
+  *
+  * The Hamiltonian evaluated by the last interaction step is reused, it is only evaluated again if the grid
+  * has changed since. Hamiltonians which depend on psi are counted as potential energy.
+  * @param E_pot Expectation value of the Hamiltonian of the sequence
+  * @param E_int Energy of the contact interactions of section INTERACTIONS
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Potential_Energy( double &E_pot, double &E_int )
+{
+  if ( m_V_stride > 0 && m_V_eval.size() != (size_t)m_no_of_pts*m_V_stride ) m_V_stride = Eval_Hamiltonian();
+
+  const int stride = m_V_stride;
+  const bool matrix = m_V_matrix;
+  const bool gauge = m_gauge && matrix;
+  if ( gauge && m_gauge_grid_id != this->m_grid_id ) Tabulate_Gauge();
+  const double *V_eval = m_V_eval.empty() ? nullptr : m_V_eval.data();
 
-  if ( (this->position_dependent == false) and (this->nonlinear == false)) //Calculate V(t) at t
+  fftw_complex *Psi[no_int_states];
+  for ( int i=0; i<no_int_states; i++ )
+    Psi[i] = Field(i);
+
+  double pot = 0, inter = 0;
+  #pragma omp parallel for reduction(+:pot,inter)
+  for ( int l=0; l<m_no_of_pts; l++ )
   {
-    double *V_ptr = this->V_parser->Eval(nNum);
-    for ( int l=0; l<this->m_no_of_pts; l++ )
-    {    
-      for ( int i=0; i<no_int_states; i++ )
+    const int lp = l*m_stride;
+    if ( this->m_interacting ) inter += this->Interaction_Energy( Psi, lp );
+    if ( V_eval == nullptr ) continue;
+
+    const double *V = V_eval + (size_t)l*stride;
+    double P[2*no_int_states];
+    if ( gauge ) Gauge_Phases( l, P );
+    int m = 0;
+    for ( int i=0; i<no_int_states; i++ )
+    {
+      const double den = Psi[i][lp][0]*Psi[i][lp][0] + Psi[i][lp][1]*Psi[i][lp][1];
+      if ( !matrix )
       {
-        double V_real = *(V_ptr+(2*i));
-        phi[i] = V_real*dt;
+        pot += V[2*i]*den;
+        continue;
       }
-      
-      //Compute exponential: exp(V)*Psi
-      for ( int i=0; i<no_int_states; i++ )
+      for ( int j=i; j<no_int_states; j++, m++ )
       {
-        sincos( phi[i], &im1, &re1 );
-
-        tmp1 = Psi[i][l][0];
-        Psi[i][l][0] = Psi[i][l][0]*re1 - Psi[i][l][1]*im1;
-        Psi[i][l][1] = Psi[i][l][1]*re1 + tmp1*im1;
+        if ( i == j )
+        {
+          pot += V[2*m]*den;
+          continue;
+        }
+        // 2 Re( conj(Psi_i) H_ij Psi_j )
+        double re = Psi[i][lp][0]*Psi[j][lp][0] + Psi[i][lp][1]*Psi[j][lp][1];
+        double im = Psi[i][lp][0]*Psi[j][lp][1] - Psi[i][lp][1]*Psi[j][lp][0];
+        if ( gauge )
+        {
+          // H_ij(x) = H_ij(0) exp(i (q_i-q_j) x)
+          const double cr = P[2*i]*P[2*j] + P[2*i+1]*P[2*j+1];
+          const double ci = P[2*i+1]*P[2*j] - P[2*i]*P[2*j+1];
+          const double tmp = re*cr - im*ci;
+          im = re*ci + im*cr;
+          re = tmp;
+        }
+        pot += 2*(V[2*m]*re - V[2*m+1]*im);
       }
     }
   }
-}
+  double res[2] = { pot, inter };
+  this->Reduce_Sum( res, 2 );
 
+  E_pot = this->m_ar*res[0];
+  E_int = this->m_ar*res[1];
+}
 
 /** Solves the potential part in the presence of light fields with a numerical method
   *
   * In this function \f$ \exp(V)\Psi \f$ is calculated. The matrix exponential is computed
-  * with the help of a numerical diagonalisation which uses the gsl library
+  * with the help of a numerical diagonalisation which uses the gsl library. The contact interactions
+  * are added to the diagonal elements.
+  *
+  * If the Hamiltonian is the same for all points (independent of position and psi, without contact
+  * interactions), its exponential is computed once per step and applied with Apply_Matrix(). The same holds
+  * for plane wave couplings with GAUGE=1, whose phases are applied at each point (see Setup_Gauge()).
+  *
+  * If the off-diagonal elements of the Hamiltonian which are literal zeros split the states into several
+  * blocks, each block is propagated on its own (see coupling_graph). With PAIRWISE=1 in section ALGORITHM,
+  * blocks of more than two states are propagated with a symmetric product of the exponentials of the single
+  * couplings.
   */
 template <class T, int dim, int no_int_states>
 void CRT_Base_IF<T,dim,no_int_states>::Numerical_Diagonalization()
 {
-  this->t = this->Get_t()*this->Get_t_scale();
-  int nNum = this->V_parser->GetNumResults();
-  double *V_ptr = this->V_parser->Eval(nNum); // initializes nNum
-  const long long int N_V_eval = this->m_no_of_pts*no_int_states*nNum ;
-  double V_eval[N_V_eval];
-  vector<fftw_complex *> Psi;
+  const int stride = Eval_Hamiltonian();
+  const double *V_eval = m_V_eval.data();
+  m_V_stride = stride;
+  m_V_matrix = true;
+
+  fftw_complex *Psi[no_int_states];
   for ( int i=0; i<no_int_states; i++ )
-    Psi.push_back(m_fields[i]->Getp2In());
+    Psi[i] = Field(i);
 
-  if (this->nonlinear == true) //Calculate V(psi(r,t),r,t) at t for all r
+  if ( m_gauge )
   {
-    for ( int l=0; l<this->m_no_of_pts; l++ ) //TODO parallelizing this would be good
+    if ( m_gauge_grid_id != this->m_grid_id ) Tabulate_Gauge();
+    const double dt = -m_header.dt*this->Get_t_scale();
+    const int S = no_int_states;
+
+    herm_workspace U(S);
+    int m = 0;
+    for ( int i=0; i<S; i++ )
+      for ( int j=i; j<S; j++, m++ )
+        U.Set( 0, i, j, V_eval[2*m], V_eval[2*m+1] );
+    Exp_Hermitian( U, 1, dt );
+    double ur[S*S], ui[S*S];
+    for ( int e=0; e<S*S; e++ )
     {
-      //vector<fftw_complex *> psi;
-      for ( int i=0; i<no_int_states; i++ )
-      {
-        this->psi_real_array[i] = Psi[i][l][0];
-        this->psi_imag_array[i] = Psi[i][l][1];
-      }
-      this->x = this->m_fields[0]->Get_x(l);
-      V_ptr = this->V_parser->Eval(nNum);
-      for (int j=0; j<nNum; j++)
+      ur[e] = U.re[e*herm_block];
+      ui[e] = U.im[e*herm_block];
+    }
+
+    const int64_t NX = this->m_axis_x[0].size(), NY = this->m_axis_x[1].size(), NZ = this->m_axis_x[2].size();
+
+    #pragma omp parallel
+    {
+      double rr[S], ri[S], pr[S], pi[S], yr[S], yi[S];
+
+      Phase_Scope timer( ph_exp );
+      #pragma omp for collapse(2) schedule(static) nowait
+      for ( int64_t i=0; i<NX; i++ )
       {
-        V_eval[l*nNum+j] = *(V_ptr+(j));
+        for ( int64_t j=0; j<NY; j++ )
+        {
+          // phases of the outer directions
+          for ( int s=0; s<S; s++ )
+          {
+            const double *X = m_gauge_axis[s][0].data() + 2*i, *Y = m_gauge_axis[s][1].data() + 2*j;
+            rr[s] = X[0]*Y[0] - X[1]*Y[1];
+            ri[s] = X[0]*Y[1] + X[1]*Y[0];
+          }
+          for ( int64_t k=0; k<NZ; k++ )
+          {
+            const int64_t l = ((i*NY+j)*NZ+k)*m_stride;
+            // y = G Psi with G = diag(exp(-i q_s x))
+            for ( int s=0; s<S; s++ )
+            {
+              const double *Z = m_gauge_axis[s][2].data() + 2*k;
+              pr[s] = rr[s]*Z[0] - ri[s]*Z[1];
+              pi[s] = rr[s]*Z[1] + ri[s]*Z[0];
+              yr[s] = pr[s]*Psi[s][l][0] + pi[s]*Psi[s][l][1];
+              yi[s] = pr[s]*Psi[s][l][1] - pi[s]*Psi[s][l][0];
+            }
+            // Psi = G^+ U y
+            for ( int a=0; a<S; a++ )
+            {
+              double zr = 0, zi = 0;
+              for ( int b=0; b<S; b++ )
+              {
+                zr += ur[a*S+b]*yr[b] - ui[a*S+b]*yi[b];
+                zi += ur[a*S+b]*yi[b] + ui[a*S+b]*yr[b];
+              }
+              Psi[a][l][0] = pr[a]*zr - pi[a]*zi;
+              Psi[a][l][1] = pr[a]*zi + pi[a]*zr;
+            }
+          }
+        }
       }
     }
+    return;
   }
-  if ( (this->position_dependent == true) and (this->nonlinear == false)) //Calculate V(r,t) at t for all r
+
+  if ( stride == 0 && !this->m_interacting )
   {
-    for ( int l=0; l<this->m_no_of_pts; l++ ) //TODO parallelizing this would be good
+    const double dt = -m_header.dt*this->Get_t_scale();
+    const int nChunks = (m_no_of_pts + herm_apply - 1)/herm_apply;
+
+    herm_workspace U(no_int_states);
+    int m = 0;
+    for ( int i=0; i<no_int_states; i++ )
+      for ( int j=i; j<no_int_states; j++, m++ )
+        U.Set( 0, i, j, V_eval[2*m], V_eval[2*m+1] );
+    Exp_Hermitian( U, 1, dt );
+
+    #pragma omp parallel
     {
-      this->x = this->m_fields[0]->Get_x(l);
-      V_ptr = this->V_parser->Eval(nNum);
-      for (int j=0; j<nNum; j++)
+      std::vector<double> out;
+
+      Phase_Scope timer( ph_exp );
+      #pragma omp for schedule(static) nowait
+      for ( int c=0; c<nChunks; c++ )
       {
-        V_eval[l*nNum+j] = *(V_ptr+(j));
+        const int l0 = c*herm_apply;
+        Apply_Matrix( U, Psi, m_stride, l0, std::min( herm_apply, m_no_of_pts-l0 ), out );
       }
     }
+    return;
   }
-  if ( (this->position_dependent == false) and (this->nonlinear == false)) //Calculate V(t) at t
+
+  if ( m_coupling.sparse )
   {
-    V_ptr = this->V_parser->Eval(nNum);
-    for ( int l=0; l<this->m_no_of_pts; l++ ) //TODO parallelizing this would be good
+    const double dt = -m_header.dt*this->Get_t_scale();
+    const int nBlocks = (m_no_of_pts + herm_block - 1)/herm_block;
+
+    #pragma omp parallel
     {
-      for (int j=0; j<nNum; j++)
+      std::vector<herm_workspace> ws = m_coupling.Workspaces();
+      double phi[herm_block*no_int_states];
+
+      Phase_Scope timer( ph_exp );
+      #pragma omp for schedule(static) nowait
+      for ( int blk=0; blk<nBlocks; blk++ )
       {
-        V_eval[l*nNum+j] = *(V_ptr+(j));
+        const int l0 = blk*herm_block;
+        const int count = std::min( herm_block, m_no_of_pts-l0 );
+        if ( this->m_interacting )
+        {
+          std::fill( phi, phi+herm_block*no_int_states, 0.0 );
+          for ( int b=0; b<count; b++ )
+            this->Add_Interaction( Psi, (l0+b)*m_stride, phi+b*no_int_states );
+        }
+        m_coupling.Propagate( Psi, m_stride, l0, count, V_eval, stride, this->m_interacting ? phi : nullptr, dt, ws );
       }
     }
+    return;
   }
+
   #pragma omp parallel
   {
 	  double re1, im1;
     const double dt = -m_header.dt*this->Get_t_scale();
 
-    //vector<fftw_complex *> Psi;
-    //for ( int i=0; i<no_int_states; i++ )
-    //  Psi.push_back(m_fields[i]->Getp2In());
-
     gsl_matrix_complex *A = gsl_matrix_complex_calloc(no_int_states,no_int_states);
     gsl_matrix_complex *B = gsl_matrix_complex_calloc(no_int_states,no_int_states);
     gsl_eigen_hermv_workspace *w = gsl_eigen_hermv_alloc(no_int_states);
@@ -313,19 +782,25 @@ void CRT_Base_IF<T,dim,no_int_states>::Numerical_Diagonalization()
     gsl_vector_complex *Psi_2 = gsl_vector_complex_alloc(no_int_states);
     gsl_matrix_complex *evec = gsl_matrix_complex_alloc(no_int_states,no_int_states);
 
-    #pragma omp for
+    Phase_Scope timer( ph_exp );
+    #pragma omp for nowait
     for ( int l=0; l<this->m_no_of_pts; l++ )
     {
       gsl_matrix_complex_set_zero(A);
       gsl_matrix_complex_set_zero(B);
 
+      const int lp = l*m_stride;
+      const double *V = V_eval + (size_t)l*stride;
+      double phi[no_int_states] = {};
+      if ( this->m_interacting ) this->Add_Interaction( Psi, lp, phi );
+
       int m = 0;
       for ( int i=0; i<no_int_states; i++ )
       {
         for ( int j=i; j<no_int_states; j++ )
         {
-          double V_real = V_eval[l*nNum+2*m];
-          double V_imag = V_eval[l*nNum+2*m+1];
+          double V_real = V[2*m];
+          double V_imag = V[2*m+1];
           if (i != j) //nondiagonal elements
           {
             gsl_matrix_complex_set(A,i,j, {V_real,V_imag});
@@ -333,7 +808,7 @@ void CRT_Base_IF<T,dim,no_int_states>::Numerical_Diagonalization()
           }
           else
           { //diagonal elements
-            gsl_matrix_complex_set(A,i,i, {V_real,0});
+            gsl_matrix_complex_set(A,i,i, {V_real+phi[i],0});
           }
           m += 1;
         }
@@ -357,7 +832,7 @@ void CRT_Base_IF<T,dim,no_int_states>::Numerical_Diagonalization()
 
       for ( int i=0; i<no_int_states; i++)
       {
-        gsl_vector_complex_set(Psi_1,i, {Psi[i][l][0],Psi[i][l][1]});
+        gsl_vector_complex_set(Psi_1,i, {Psi[i][lp][0],Psi[i][lp][1]});
       }
 
       // H_new * Psi
@@ -365,8 +840,8 @@ void CRT_Base_IF<T,dim,no_int_states>::Numerical_Diagonalization()
 
       for ( int i=0; i<no_int_states; i++)
       {
-        Psi[i][l][0] = gsl_vector_complex_get(Psi_2,i).dat[0];
-        Psi[i][l][1] = gsl_vector_complex_get(Psi_2,i).dat[1];
+        Psi[i][lp][0] = gsl_vector_complex_get(Psi_2,i).dat[0];
+        Psi[i][lp][1] = gsl_vector_complex_get(Psi_2,i).dat[1];
       }
     }
     gsl_matrix_complex_free(A);
@@ -379,6 +854,329 @@ void CRT_Base_IF<T,dim,no_int_states>::Numerical_Diagonalization()
   }
 }
 
+/** Defines the Hamiltonian of a sequence in V_parser
+  *
+  * Finds the variables the Hamiltonian depends on, tries to separate it (see Setup_Separation()) and
+  * finds the coupled blocks of states of an interact sequence (see Numerical_Diagonalization()).
+  * @param seq Sequence whose Hamiltonian is set up
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Setup_Hamiltonian( const sequence_item &seq )
+{
+  /* Definitions for the Hamiltonian parser */
+  delete this->V_parser;
+  this->V_parser = new mu::Parser; // Parser in heap
+  /** Read in Hamiltonian strings from XML */
+  std::string V_expression = "";
+  V_expression += seq.V_real[0];
+  V_expression += ",";
+  V_expression += seq.V_imag[0];
+  for (int i = 1; i<seq.V_real.size(); i++)
+  {
+    V_expression += ",";
+    V_expression += seq.V_real[i];
+    V_expression += ",";
+    V_expression += seq.V_imag[i];
+  }
+
+
+  /* Set Hamiltonian to evaluate dependencies*/
+  this->V_parser->SetExpr(V_expression);
+  // Get the map with the used variables
+  const std::map<std::__cxx11::basic_string<char>, double*> variables =  this->V_parser->GetUsedVar();
+  // Get the number of variables 
+  std::map<std::__cxx11::basic_string<char>, double*>::const_iterator item = variables.begin();
+  // Query the variables
+  position_dependent = false;
+  time_dependent = false;
+  nonlinear = false;
+
+  for (; item!=variables.end(); ++item)
+  {
+    if ((item->first == "x" ) or (item->first == "y" ) or (item->first == "z" ))
+    {
+      position_dependent = true;
+      //cout << "Name: " << item->first << " Address: [0x" << item->second << "]\n";
+    }
+    if (item->first == "t")
+    {
+      time_dependent = true;
+      //cout << "Name: " << item->first << " Address: [0x" << item->second << "]\n";
+    }
+    if (item->first.rfind("psi_", 0) == 0) 
+    {
+      nonlinear = true;
+      //cout << "Name: " << item->first << " Address: [0x" << item->second << "]\n";
+    }
+  }
+  /* Define Variables and Constants*/
+  // self-defined constants
+  std::map<std::string, double>::iterator it = this->m_params->m_map_constants.begin();
+  while(it != this->m_params->m_map_constants.end())
+  {
+    this->V_parser->DefineConst(it->first, (double)it->second);
+    it++;
+  }
+  // constants
+  this->V_parser->DefineConst("pi", (double)M_PI);
+  this->V_parser->DefineConst("e", (double)M_E);
+  // variables
+  if (time_dependent == true) {this->V_parser->DefineVar("t", &this->t);}
+  if (position_dependent == true) 
+  {
+    this->V_parser->DefineVar("x", &this->x[0]);
+    if (dim >=2) {this->V_parser->DefineVar("y", &this->x[1]);}
+    if (dim == 3) {this->V_parser->DefineVar("z", &this->x[2]);}
+  }
+
+  if (nonlinear == true)
+  {
+    for (int i = 0; i < this->m_fields.size(); i++)
+    {
+      std::string tmp_str = "psi_";
+      tmp_str += std::to_string(i+1);
+      tmp_str += "_real";
+      this->V_parser->DefineVar(tmp_str, &this->psi_real_array[i] );
+      tmp_str = "psi_";
+      tmp_str += std::to_string(i+1);
+      tmp_str += "_imag";
+      this->V_parser->DefineVar(tmp_str, &this->psi_imag_array[i] );
+    }
+  }
+
+  // Set the final Hamiltonian
+  this->V_parser->SetExpr(V_expression);
+  Setup_Separation(seq);
+  if ( seq.name == "interact" ) m_coupling.Setup( seq.V_real, seq.V_imag, no_int_states, m_params->Get_Algorithm("PAIRWISE",0) != 0 );
+  Setup_Gauge(seq);
+}
+
+/** Tries to write the Hamiltonian of an interact sequence as \f$ H(\vec{x},t) = G^\dagger(\vec{x}) H_0(t) G(\vec{x}) \f$
+  *
+  * Couplings by plane waves, e.g. the Raman and Bragg couplings
+  * \f$ H_{ij} = A(t) \exp(i(\vec{K}_{ij}\vec{x} + \omega t)) \f$, make the Hamiltonian position dependent,
+  * although it is only the position independent \f$ H_0(t) = H(\vec{0},t) \f$ in the frame of
+  * \f$ G = \mathrm{diag}(\exp(-i\vec{q}_s\vec{x})) \f$ with \f$ \vec{q}_i - \vec{q}_j = \vec{K}_{ij} \f$. The
+  * exponential \f$ G^\dagger \exp(i\,dt\,H_0) G \f$ then needs one matrix exponential per step instead of
+  * one per point (see Numerical_Diagonalization()). The fields stay in the lab frame, so observables and
+  * output are not affected.
+  *
+  * Enabled with GAUGE=1 in section ALGORITHM. The wave vectors are found from the phases of the couplings
+  * between neighbouring points at the start, a third, two thirds and the end of the sequence. The form of the
+  * Hamiltonian is verified at these times on a sample of the grid points. Not available with contact
+  * interactions, in moving frames and on distributed grids.
+  * @param seq Sequence whose Hamiltonian is set up
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Setup_Gauge( const sequence_item &seq )
+{
+  m_gauge = false;
+  if ( seq.name != "interact" || m_params->Get_Algorithm("GAUGE",0) == 0 ) return;
+  if ( !this->position_dependent || this->nonlinear ) return;
+  if ( this->m_interacting || this->m_frame_mode != frame::lab || this->m_distributed )
+  {
+    std::cout << "FYI: GAUGE=1 is not available with contact interactions, moving frames or distributed grids\n";
+    return;
+  }
+
+  const int S = no_int_states;
+  const int nNum = S*(S+1);
+  const double d[3] = { m_header.dx, m_header.dy, m_header.dz };
+
+  double max_duration = 0;
+  for ( auto duration : seq.duration )
+    max_duration = std::max( max_duration, duration );
+
+  auto eval = [&]( const double *pos, std::vector<double> &V )
+  {
+    for ( int a=0; a<dim; a++ )
+      this->x[a] = pos[a];
+    int n = nNum;
+    const double *V_ptr = this->V_parser->Eval(n);
+    V.assign( V_ptr, V_ptr+n );
+  };
+
+  // wave vector of each upper triangle element m at K[3*m+a], found[m] if its phase has been measured
+  std::vector<double> K( 3*nNum/2, 0.0 ), V0, V1;
+  std::vector<bool> found( nNum/2, false );
+  const double origin[3] = {};
+  const double t_backup = this->t;
+  const int nSamples = std::min( (int64_t)m_no_of_pts, (int64_t)4096 );
+  bool valid = true;
+
+  for ( int pass=0; pass<2 && valid; pass++ )
+  {
+    for ( int f=0; f<4 && valid; f++ )
+    {
+      this->t = (this->Get_t() + f*max_duration/3)*this->Get_t_scale();
+      eval( origin, V0 );
+      double scale = 0;
+      for ( auto v : V0 )
+        scale = std::max( scale, std::fabs(v) );
+
+      // first pass: phases between the origin and its neighbours along each direction
+      if ( pass == 0 )
+      {
+        for ( int a=0; a<dim; a++ )
+        {
+          double pos[3] = {};
+          pos[a] = d[a];
+          eval( pos, V1 );
+          for ( int i=0, m=0; i<S; i++ )
+          {
+            for ( int j=i; j<S; j++, m++ )
+            {
+              if ( i == j || found[m] || V0[2*m]*V0[2*m]+V0[2*m+1]*V0[2*m+1] <= 1e-16*scale*scale ) continue;
+              // arg( V1 conj(V0) )
+              const double re = V1[2*m]*V0[2*m] + V1[2*m+1]*V0[2*m+1];
+              const double im = V1[2*m+1]*V0[2*m] - V1[2*m]*V0[2*m+1];
+              K[3*m+a] = std::atan2( im, re )/d[a];
+              if ( a == dim-1 ) found[m] = true;
+            }
+          }
+        }
+        continue;
+      }
+
+      // second pass: H(x) = G^+(x) H(0) G(x) on a sample of the points
+      const int64_t step = m_no_of_pts/nSamples;
+      for ( int p=0; p<nSamples && valid; p++ )
+      {
+        const int64_t l = p*step + (int64_t(p)*131)%step;
+        CPoint<dim> xl = this->Get_x_lab(l);
+        double pos[3] = {};
+        for ( int a=0; a<dim; a++ )
+          pos[a] = xl[a];
+        eval( pos, V1 );
+        for ( int i=0, m=0; i<S; i++ )
+        {
+          for ( int j=i; j<S; j++, m++ )
+          {
+            double er = V0[2*m], ei = ( i == j ) ? 0.0 : V0[2*m+1];
+            if ( i != j )
+            {
+              double phase = 0, c, sn;
+              for ( int a=0; a<dim; a++ )
+                phase += K[3*m+a]*pos[a];
+              sincos( phase, &sn, &c );
+              const double tr = er*c - ei*sn;
+              ei = er*sn + ei*c;
+              er = tr;
+            }
+            const double im1 = ( i == j ) ? 0.0 : V1[2*m+1];
+            if ( std::fabs(V1[2*m]-er) + std::fabs(im1-ei) > 1e-8*scale ) valid = false;
+          }
+        }
+      }
+    }
+
+    // every coupling of the graph needs a wave vector
+    if ( pass == 0 )
+      for ( auto &blk : m_coupling.couplings )
+        for ( auto &c : blk )
+          if ( !found[c.e] ) valid = false;
+  }
+  this->t = t_backup;
+
+  // wave vectors of the states, the first state of each block is at rest
+  for ( int s=0; s<S; s++ )
+    for ( int a=0; a<3; a++ )
+      m_gauge_q[s][a] = 0;
+  for ( size_t k=0; k<m_coupling.blocks.size() && valid; k++ )
+  {
+    std::vector<bool> known( S, false );
+    known[m_coupling.blocks[k][0]] = true;
+    for ( int sweep=0; sweep<S && valid; sweep++ )
+    {
+      for ( auto &c : m_coupling.couplings[k] )
+      {
+        if ( known[c.i] && !known[c.j] )
+        {
+          for ( int a=0; a<dim; a++ )
+            m_gauge_q[c.j][a] = m_gauge_q[c.i][a] - K[3*c.e+a];
+          known[c.j] = true;
+        }
+        else if ( known[c.j] && !known[c.i] )
+        {
+          for ( int a=0; a<dim; a++ )
+            m_gauge_q[c.i][a] = m_gauge_q[c.j][a] + K[3*c.e+a];
+          known[c.i] = true;
+        }
+        else if ( known[c.i] && known[c.j] )
+        {
+          // closed loops must not leave a phase
+          for ( int a=0; a<dim; a++ )
+            if ( std::fabs( m_gauge_q[c.i][a] - m_gauge_q[c.j][a] - K[3*c.e+a] ) > 1e-9*(std::fabs(K[3*c.e+a]) + 1/d[a]) ) valid = false;
+        }
+      }
+    }
+  }
+
+  if ( !valid )
+  {
+    std::cout << "FYI: GAUGE=1 found no plane wave couplings in sequence " << seq.name << "\n";
+    return;
+  }
+
+  m_gauge = true;
+  m_separable = false;
+  Tabulate_Gauge();
+  std::cout << "FYI: plane wave couplings removed by a gauge transform, wave vectors of the internal states:";
+  for ( int s=0; s<S; s++ )
+  {
+    std::cout << " (";
+    for ( int a=0; a<dim; a++ )
+      std::cout << ( a > 0 ? "," : "" ) << m_gauge_q[s][a];
+    std::cout << ")";
+  }
+  std::cout << "\n";
+}
+
+/// Tabulates exp(i q_s x) along each direction for the gauge transform (see Setup_Gauge())
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Tabulate_Gauge()
+{
+  for ( int s=0; s<no_int_states; s++ )
+  {
+    for ( int a=0; a<3; a++ )
+    {
+      const std::vector<double> &X = this->m_axis_x[a];
+      const double q = ( a < dim ) ? m_gauge_q[s][a] : 0;
+      const double x0 = ( a < dim ) ? this->m_frame_x[a] : 0;
+      std::vector<double> &tab = m_gauge_axis[s][a];
+      tab.resize( 2*X.size() );
+      for ( size_t i=0; i<X.size(); i++ )
+        sincos( q*(X[i]+x0), &tab[2*i+1], &tab[2*i] );
+    }
+  }
+  m_gauge_grid_id = this->m_grid_id;
+}
+
+/** Computes exp(i q_s x) of each internal state s at a point (see Setup_Gauge())
+  *
+  * @param l Point
+  * @param P Real and imaginary part of the phase of each state
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Gauge_Phases( const int64_t l, double *P ) const
+{
+  const int64_t NY = this->m_axis_x[1].size(), NZ = this->m_axis_x[2].size();
+  const int64_t idx[3] = { l/(NY*NZ), (l/NZ)%NY, l%NZ };
+  for ( int s=0; s<no_int_states; s++ )
+  {
+    double re = 1, im = 0;
+    for ( int a=0; a<dim; a++ )
+    {
+      const double *E = m_gauge_axis[s][a].data() + 2*idx[a];
+      const double tmp = re*E[0] - im*E[1];
+      im = re*E[1] + im*E[0];
+      re = tmp;
+    }
+    P[2*s] = re;
+    P[2*s+1] = im;
+  }
+}
+
 /** Run all the sequences defined in the xml file
   *
   * For furher information about the sequences see sequence_item
@@ -415,6 +1213,7 @@ void CRT_Base_IF<T,dim,no_int_states>::run_sequence()
 
   for ( auto seq : m_params->m_sequence )
   {
+    Solver_Timers().Begin_Sequence( seq.name );
     if ( run_custom_sequence(seq) )
     {
       seq_counter++;
@@ -431,88 +1230,7 @@ void CRT_Base_IF<T,dim,no_int_states>::run_sequence()
     int Nk = seq.Nk;
     int Na = subN / seq.Nk;
 
-    /* Definitions for the Hamiltonian parser */
-    this->V_parser = new mu::Parser; // Parser in heap
-    /** Read in Hamiltonian strings from XML */
-    std::string V_expression = "";
-    V_expression += seq.V_real[0];
-    V_expression += ",";
-    V_expression += seq.V_imag[0];
-    for (int i = 1; i<seq.V_real.size(); i++)
-    {
-      V_expression += ",";
-      V_expression += seq.V_real[i];
-      V_expression += ",";
-      V_expression += seq.V_imag[i];
-    }
-
-
-    /* Set Hamiltonian to evaluate dependencies*/
-    this->V_parser->SetExpr(V_expression);
-    // Get the map with the used variables
-    const std::map<std::__cxx11::basic_string<char>, double*> variables =  this->V_parser->GetUsedVar();
-    // Get the number of variables 
-    std::map<std::__cxx11::basic_string<char>, double*>::const_iterator item = variables.begin();
-    // Query the variables
-    position_dependent = false;
-    time_dependent = false;
-    nonlinear = false;
-
-    for (; item!=variables.end(); ++item)
-    {
-      if ((item->first == "x" ) or (item->first == "y" ) or (item->first == "z" ))
-      {
-        position_dependent = true;
-        //cout << "Name: " << item->first << " Address: [0x" << item->second << "]\n";
-      }
-      if (item->first == "t")
-      {
-        time_dependent = true;
-        //cout << "Name: " << item->first << " Address: [0x" << item->second << "]\n";
-      }
-      if (item->first.rfind("psi_", 0) == 0) 
-      {
-        nonlinear = true;
-        //cout << "Name: " << item->first << " Address: [0x" << item->second << "]\n";
-      }
-    }
-    /* Define Variables and Constants*/
-    // self-defined constants
-    std::map<std::string, double>::iterator it = this->m_params->m_map_constants.begin();
-    while(it != this->m_params->m_map_constants.end())
-    {
-      this->V_parser->DefineConst(it->first, (double)it->second);
-      it++;
-    }
-    // constants
-    this->V_parser->DefineConst("pi", (double)M_PI);
-    this->V_parser->DefineConst("e", (double)M_E);
-    // variables
-    if (time_dependent == true) {this->V_parser->DefineVar("t", &this->t);}
-    if (position_dependent == true) 
-    {
-      this->V_parser->DefineVar("x", &this->x[0]);
-      if (dim >=2) {this->V_parser->DefineVar("y", &this->x[1]);}
-      if (dim == 3) {this->V_parser->DefineVar("z", &this->x[2]);}
-    }
-
-    if (nonlinear == true)
-    {
-      for (int i = 0; i < this->m_fields.size(); i++)
-      {
-        std::string tmp_str = "psi_";
-        tmp_str += std::to_string(i+1);
-        tmp_str += "_real";
-        this->V_parser->DefineVar(tmp_str, &this->psi_real_array[i] );
-        tmp_str = "psi_";
-        tmp_str += std::to_string(i+1);
-        tmp_str += "_imag";
-        this->V_parser->DefineVar(tmp_str, &this->psi_imag_array[i] );
-      }
-    }
-
-    // Set the final Hamiltonian
-    this->V_parser->SetExpr(V_expression);
+    Setup_Hamiltonian(seq);
 
     /* for debugging parser
     // Get the map with the used variables
@@ -581,6 +1299,7 @@ void CRT_Base_IF<T,dim,no_int_states>::run_sequence()
       std::remove(filename);
     }
 
+      Solver_Progress().Begin_Sequence( seq.name, seq_counter, (long long)Na*Nk, no_int_states*this->Get_Global_Points(), m_header.t );
       for ( int i=1; i<=Na; i++ )
       {
         (*half_step_fct)(this,seq);
@@ -590,9 +1309,11 @@ void CRT_Base_IF<T,dim,no_int_states>::run_sequence()
           (*full_step_fct)(this,seq);
         }
         (*step_fct)(this,seq);
+        this->Request_Observables();
         (*half_step_fct)(this,seq);
 
-        std::cout << "t = " << to_string(m_header.t) << std::endl;
+        Solver_Progress().Step( Nk, m_header.t );
+        this->Write_Observables();
 
         if ( seq.output_freq == freq::each )
         {
@@ -614,14 +1335,17 @@ void CRT_Base_IF<T,dim,no_int_states>::run_sequence()
 
         if ( seq.compute_pn_freq == freq::each )
         {
-          for ( int c=0; c<no_int_states; c++ )
-            std::cout << "N[" << c << "] = " << this->Get_Particle_Number(c) << std::endl;
+          this->Print_Particle_Numbers();
         }
 
         if ( seq.custom_freq == freq::each && m_custom_fct != nullptr )
         {
+          this->m_obs_k.mask = 0;
           (*m_custom_fct)(this,seq);
         }
+
+        this->Recenter_Frame();
+        this->Check_Grid();
       }
 
       if (seq.output_freq == freq::last )
@@ -635,16 +1359,18 @@ void CRT_Base_IF<T,dim,no_int_states>::run_sequence()
 
       if ( seq.compute_pn_freq == freq::last )
       {
-        for ( int c=0; c<no_int_states; c++ )
-          std::cout << "N[" << c << "] = " << this->Get_Particle_Number(c) << std::endl;
+        this->Print_Particle_Numbers();
       }
 
       if ( seq.custom_freq == freq::last && m_custom_fct != nullptr )
       {
+        this->m_obs_k.mask = 0;
         (*m_custom_fct)(this,seq);
       }
 
+    Solver_Progress().End_Sequence();
     seq_counter++;
   } // end of sequence loop
+  this->Write_Timers();
 }
 #endif
@@ -0,0 +1,947 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#include <ostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "strtk.hpp"
+#include "CRT_shared.h"
+#include "field_alloc.h"
+#include "ExprSplitter.h"
+#include "ParameterHandler.h"
+#include "herm_exp.h"
+#include "muParser.h"
+
+using namespace std;
+
+#ifndef __class_CRT_Ensemble__
+#define __class_CRT_Ensemble__
+
+/** Template class for the simultaneous propagation of an ensemble of simulations in <B>dim</B> dimensions
+  *
+  * The members of the ensemble differ in the values of the parameters of section ENSEMBLE, e.g.
+  * \code <ENSEMBLE><Delta>-1000,0,1000</Delta></ENSEMBLE> \endcode
+  * runs the sequences three times with the given values of Delta in the Hamiltonians. Several parameters with the
+  * same number of values are varied together. All members start from the initial files and share the grid,
+  * the kinetic tables and the tabulated position factors of the Hamiltonian. The wavefunctions of all members and
+  * internal states are stored in one array and transformed with a single batched fftw plan.
+  *
+  * Without section ENSEMBLE the class runs a single simulation. As the number of internal states is only
+  * known at runtime, this is used for more internal states than the compile-time instantiations of
+  * CRT_Base_IF provide (see TALISES_STATIC_STATES in talises.cpp).
+  */
+template <int dim>
+class CRT_Ensemble : public CRT_shared
+{
+public:
+  CRT_Ensemble( ParameterHandler * );
+  virtual ~CRT_Ensemble();
+
+  void run_sequence();
+
+  double Get_Particle_Number( const int, const int );
+  void Save_Phi( std::string, const int, const int );
+  void Append_Phi( std::string, const int, const int );
+
+protected:
+  void Init();
+  void LoadFiles();
+  void Define_Constants( mu::Parser & );
+  void Setup_Parser( const sequence_item & );
+  void Setup_Separation( const sequence_item & );
+
+  void Do_FT_Step( const double );
+  void Do_NL_Step();
+  void Numerical_Diagonalization();
+  int Eval_Hamiltonian( const int );
+  void Load_Hamiltonian( herm_workspace &, const int, const double *, const double * );
+
+  CPoint<dim> Get_x( const int );
+
+  /// Wavefunction of internal state s of member m
+  fftw_complex *Field( const int s, const int m )
+  {
+    return m_psi + ((size_t)m*m_no_int_states + s)*m_no_of_pts;
+  };
+
+  /// Object for reading from xml files
+  ParameterHandler *m_params;
+
+  /// Dimensionless scaling factor for the kinetic part in n dimensions
+  CPoint<dim> m_alpha;
+
+  double m_M;
+  double m_T;
+
+  int m_no_int_states;
+  /// Number of members of the ensemble (1 without section ENSEMBLE)
+  int m_no_members;
+  /// False for a single simulation, the output is then named like the one of CRT_Base_IF
+  bool m_ensemble;
+  /// Names of the parameters of the ensemble and their values for each member
+  std::vector<std::string> m_names;
+  std::vector<std::vector<double>> m_values;
+  /// Parameters of the member which is evaluated by the parsers
+  std::vector<double> m_member;
+
+  /// Wavefunctions of all members and internal states, see Field()
+  fftw_complex *m_psi;
+  /// Batched transforms of all wavefunctions
+  fftw_plan m_forward_plan;
+  fftw_plan m_backward_plan;
+  /// Kinetic tables including the normalisation of the transforms for all time steps used so far
+  std::map<double,kinetic_table> m_kinetic;
+  /// Kinetic table of the current time step
+  const kinetic_table *m_kinetic_dt;
+
+  mu::Parser *m_parser;
+  CPoint<dim> m_x;
+  double m_t;
+  std::vector<double> m_psi_real;
+  std::vector<double> m_psi_imag;
+  bool m_position_dependent;
+  bool m_time_dependent;
+  bool m_nonlinear;
+  /// Results of m_parser for all points of a member (or a single point if the Hamiltonian is position independent)
+  std::vector<double> m_V_eval;
+
+  /// Whether the Hamiltonian is evaluated in separated form (see CRT_Base_IF::Setup_Separation())
+  bool m_separable;
+  int m_sep_num;
+  /// Evaluates the factors of all separated terms which depend on t and the parameters of the ensemble
+  mu::Parser *m_sep_parser;
+  /// Position factors of the separated terms on the grid, shared by all members
+  std::vector<std::vector<double>> m_sep_tables;
+  /// Result index and table index (-1 if constant in space) of each separated term
+  std::vector<int> m_sep_result;
+  std::vector<int> m_sep_table;
+
+  /// Blocks of states coupled by the Hamiltonian of the sequence (see CRT_Base_IF::Numerical_Diagonalization())
+  coupling_graph m_coupling;
+
+  /// Contact interactions g_ij (see CRT_Base::m_gs)
+  std::vector<double> m_gs;
+  bool m_interacting;
+};
+
+/** Constructor
+  *
+  * Reads the parameters of the ensemble, allocates the wavefunctions of all members and plans the batched transforms.
+  * @param params Pointer to ParameterHandler object to read from xml files
+  */
+template <int dim>
+CRT_Ensemble<dim>::CRT_Ensemble( ParameterHandler *params )
+{
+  m_params = params;
+  m_parser = nullptr;
+  m_sep_parser = nullptr;
+  m_separable = false;
+
+  Read_header(params->Get_simulation("FILENAME"),dim);
+  assert( m_header.nDims == dim );
+
+  m_no_int_states = std::stoi(params->Get_simulation("INTERNAL_DIM"));
+  m_no_members = params->Get_Ensemble_Size();
+  m_ensemble = ( m_no_members > 0 );
+  if ( !m_ensemble ) m_no_members = 1;
+  for ( auto it : params->m_map_ensemble )
+  {
+    m_names.push_back(it.first);
+    m_values.push_back(it.second);
+  }
+  m_member.assign( m_names.size(), 0.0 );
+  m_psi_real.assign( m_no_int_states, 0.0 );
+  m_psi_imag.assign( m_no_int_states, 0.0 );
+
+  m_T = m_params->Get_t_scale();
+  m_M = m_params->Get_M();
+  double hbar = 1.054571817e-34;
+  for ( int i=0; i<dim; i++ )
+    m_alpha[i] = hbar*m_T/(2*m_M);
+
+  m_header.T_scale = m_T;
+  m_header.dt = params->Get_dt();
+
+  m_interacting = false;
+  for ( int i=0; i<m_no_int_states; i++ )
+  {
+    for ( int j=0; j<m_no_int_states; j++ )
+    {
+      m_gs.push_back( params->Get_Interaction(i+1,j+1) );
+      if ( m_gs.back() != 0 ) m_interacting = true;
+    }
+  }
+
+  if ( params->Get_Frame() != frame::lab || params->Get_Algorithm("REGRID",0) != 0 )
+    std::cout << "FYI: FRAME and REGRID are ignored by the ensemble engine\n";
+  if ( m_header.nFuture[HDR_FRAME_MODE] != frame::lab )
+    throw std::string("Error: the initial file was written in a moving frame, which the ensemble engine cannot continue\n");
+
+  const size_t size = (size_t)m_no_of_pts*m_no_int_states*m_no_members;
+  if ( params->Get_Algorithm("ARENA",1) != 0 )
+    Solver_Arena().Reserve( size*sizeof(fftw_complex) + 64, 0, params->Get_Algorithm("HUGEPAGES",2) );
+  m_psi = Alloc_Complex( size );
+  m_kinetic_dt = nullptr;
+
+  int n[3] = { int(m_header.nDimX), int(m_header.nDimY), int(m_header.nDimZ) };
+  m_forward_plan = fftw_plan_many_dft( dim, n, m_no_int_states*m_no_members, m_psi, nullptr, 1, m_no_of_pts, m_psi, nullptr, 1, m_no_of_pts, FFTW_FORWARD, FFTW_ESTIMATE );
+  m_backward_plan = fftw_plan_many_dft( dim, n, m_no_int_states*m_no_members, m_psi, nullptr, 1, m_no_of_pts, m_psi, nullptr, 1, m_no_of_pts, FFTW_BACKWARD, FFTW_ESTIMATE );
+  assert( m_forward_plan != nullptr );
+  assert( m_backward_plan != nullptr );
+
+  LoadFiles();
+  Init();
+
+  if ( !m_ensemble )
+  {
+    std::cout << "FYI: " << m_no_int_states << " internal states with the runtime-sized engine\n";
+    return;
+  }
+
+  // Values of the parameters of each member
+  if ( Get_Rank() == 0 )
+  {
+    std::ofstream file1( "ensemble.txt" );
+    file1 << "# member";
+    for ( auto name : m_names )
+      file1 << " " << name;
+    file1 << "\n";
+    for ( int m=0; m<m_no_members; m++ )
+    {
+      file1 << m+1;
+      for ( unsigned p=0; p<m_names.size(); p++ )
+        file1 << " " << m_values[p][m];
+      file1 << "\n";
+    }
+  }
+
+  std::cout << "FYI: ensemble of " << m_no_members << " members\n";
+}
+
+/// Destructor
+template <int dim>
+CRT_Ensemble<dim>::~CRT_Ensemble()
+{
+  fftw_destroy_plan( m_forward_plan );
+  fftw_destroy_plan( m_backward_plan );
+  Free_Buffer( m_psi );
+  delete m_parser;
+  delete m_sep_parser;
+}
+
+/** Load the initial wavefunctions into all members
+  */
+template <int dim>
+void CRT_Ensemble<dim>::LoadFiles()
+{
+  for ( int s=0; s<m_no_int_states; s++ )
+  {
+    string str = ( s == 0 ) ? "FILENAME" : "FILENAME_" + to_string(s+1);
+    Read_Field( m_params->Get_simulation(str), Field(s,0) );
+    for ( int m=1; m<m_no_members; m++ )
+      std::memcpy( Field(s,m), Field(s,0), sizeof(fftw_complex)*m_no_of_pts );
+  }
+}
+
+/** Position of grid point l
+  *
+  * @param l Array index
+  */
+template <int dim>
+CPoint<dim> CRT_Ensemble<dim>::Get_x( const int l )
+{
+  const long long NY = m_axis_x[1].size(), NZ = m_axis_x[2].size();
+  const long long idx[3] = { l/(NY*NZ), (l/NZ)%NY, l%NZ };
+
+  CPoint<dim> retval;
+  for ( int a=0; a<dim; a++ )
+    retval[a] = m_axis_x[a][idx[a]];
+  return retval;
+}
+
+/** The exponential of the kinetic operator shared by all members
+  *
+  * The factors of the axes are tabulated once per time step (see CRT_shared::Fill_Kinetic_Table()). The transforms
+  * are not normalised, hence the table of x contains the factor 1/N of the backward transform.
+  */
+template <int dim>
+void CRT_Ensemble<dim>::Init()
+{
+  const double dt = -m_header.dt;
+  auto it = m_kinetic.find(dt);
+  if ( it == m_kinetic.end() )
+  {
+    Fill_Kinetic_Table( m_kinetic[dt], dt, &m_alpha[0], dim, 0, 1.0/double(m_no_of_pts) );
+    it = m_kinetic.find(dt);
+  }
+  m_kinetic_dt = &it->second;
+}
+
+/** Compute the kinetic part for all members and internal states
+  *
+  * @param frac Fraction of dt (1 or 0.5)
+  */
+template <int dim>
+void CRT_Ensemble<dim>::Do_FT_Step( const double frac )
+{
+  Phase_Scope timer( ph_kinetic );
+
+  {
+    Phase_Scope fft( ph_fft );
+    fftw_execute( m_forward_plan );
+  }
+
+  Apply_Kinetic_Table( ( frac == 1.0 ) ? m_kinetic_dt->full : m_kinetic_dt->half, dim, m_psi, m_no_int_states*m_no_members );
+
+  {
+    Phase_Scope fft( ph_fft );
+    fftw_execute( m_backward_plan );
+  }
+  m_header.t += frac*m_header.dt;
+}
+
+/// Define the constants of the xml file except the parameters of the ensemble
+template <int dim>
+void CRT_Ensemble<dim>::Define_Constants( mu::Parser &parser )
+{
+  for ( auto it : m_params->m_map_constants )
+    if ( m_params->m_map_ensemble.count(it.first) == 0 )
+      parser.DefineConst(it.first, it.second);
+  parser.DefineConst("pi", (double)M_PI);
+  parser.DefineConst("e", (double)M_E);
+}
+
+/** Define the Hamiltonian of a sequence in m_parser
+  *
+  * The parameters of the ensemble are variables of the parser, which are set to the values of a member before
+  * the evaluation (see Eval_Hamiltonian()).
+  */
+template <int dim>
+void CRT_Ensemble<dim>::Setup_Parser( const sequence_item &seq )
+{
+  std::string V_expression = seq.V_real[0] + "," + seq.V_imag[0];
+  for ( unsigned i=1; i<seq.V_real.size(); i++ )
+    V_expression += "," + seq.V_real[i] + "," + seq.V_imag[i];
+
+  delete m_parser;
+  m_parser = new mu::Parser;
+  m_parser->SetExpr(V_expression);
+
+  m_position_dependent = false;
+  m_time_dependent = false;
+  m_nonlinear = false;
+  for ( auto item : m_parser->GetUsedVar() )
+  {
+    if ( item.first == "x" || item.first == "y" || item.first == "z" ) m_position_dependent = true;
+    if ( item.first == "t" ) m_time_dependent = true;
+    if ( item.first.rfind("psi_", 0) == 0 ) m_nonlinear = true;
+  }
+
+  Define_Constants(*m_parser);
+  for ( unsigned p=0; p<m_names.size(); p++ )
+    m_parser->DefineVar(m_names[p], &m_member[p]);
+  m_parser->DefineVar("t", &m_t);
+  m_parser->DefineVar("x", &m_x[0]);
+  if ( dim >= 2 ) m_parser->DefineVar("y", &m_x[1]);
+  if ( dim == 3 ) m_parser->DefineVar("z", &m_x[2]);
+  for ( int i=0; i<m_no_int_states; i++ )
+  {
+    m_parser->DefineVar("psi_" + std::to_string(i+1) + "_real", &m_psi_real[i]);
+    m_parser->DefineVar("psi_" + std::to_string(i+1) + "_imag", &m_psi_imag[i]);
+  }
+  m_parser->SetExpr(V_expression);
+
+  Setup_Separation(seq);
+}
+
+/** Tries to split the Hamiltonian of a sequence into terms \f$ F_k(t,p) P_k(\vec{x}) \f$
+  *
+  * p are the parameters of the ensemble. The position factors are tabulated once per sequence for all members,
+  * only the scalar factors \f$ F_k \f$ are evaluated for each member and step.
+  * @param seq Sequence whose Hamiltonian is separated
+  */
+template <int dim>
+void CRT_Ensemble<dim>::Setup_Separation( const sequence_item &seq )
+{
+  m_separable = false;
+  m_sep_tables.clear();
+  m_sep_result.clear();
+  m_sep_table.clear();
+  delete m_sep_parser;
+  m_sep_parser = nullptr;
+
+  if ( !m_position_dependent || m_nonlinear || m_params->Get_Algorithm("SEPARATE",1) == 0 ) return;
+
+  std::vector<std::string> elements;
+  for ( unsigned i=0; i<seq.V_real.size(); i++ )
+  {
+    elements.push_back(seq.V_real[i]);
+    elements.push_back(seq.V_imag[i]);
+  }
+
+  std::map<std::string,double> constants;
+  for ( auto it : m_params->m_map_constants )
+    if ( m_params->m_map_ensemble.count(it.first) == 0 )
+      constants.insert(it);
+
+  ExprSplitter splitter( constants, m_names );
+  std::map<std::string,int> tables;
+  std::vector<std::string> table_exprs;
+  std::string time_expression;
+
+  for ( unsigned n=0; n<elements.size(); n++ )
+  {
+    std::vector<separated_term> terms;
+    if ( !splitter.Separate( elements[n], terms ) )
+    {
+      m_sep_result.clear();
+      m_sep_table.clear();
+      return;
+    }
+
+    for ( auto term : terms )
+    {
+      int table = -1;
+      if ( !term.position_factors.empty() )
+      {
+        std::string P = "(" + term.position_factors[0] + ")";
+        for ( unsigned i=1; i<term.position_factors.size(); i++ )
+          P += "*(" + term.position_factors[i] + ")";
+
+        auto it = tables.find(P);
+        if ( it == tables.end() )
+        {
+          it = tables.insert( std::make_pair( P, int(table_exprs.size()) ) ).first;
+          table_exprs.push_back(P);
+        }
+        table = it->second;
+      }
+      m_sep_result.push_back(n);
+      m_sep_table.push_back(table);
+      time_expression += ( time_expression.empty() ? "" : "," ) + term.time;
+    }
+  }
+
+  // position factors on the grid
+  if ( !table_exprs.empty() )
+  {
+    std::string expression = table_exprs[0];
+    for ( unsigned i=1; i<table_exprs.size(); i++ )
+      expression += "," + table_exprs[i];
+
+    mu::Parser parser;
+    Define_Constants(parser);
+    parser.DefineVar("x", &m_x[0]);
+    if ( dim >= 2 ) parser.DefineVar("y", &m_x[1]);
+    if ( dim == 3 ) parser.DefineVar("z", &m_x[2]);
+    parser.SetExpr(expression);
+
+    int nNum;
+    m_sep_tables.assign( table_exprs.size(), std::vector<double>(m_no_of_pts) );
+    for ( int l=0; l<m_no_of_pts; l++ )
+    {
+      m_x = Get_x(l);
+      double *V_ptr = parser.Eval(nNum);
+      for ( unsigned k=0; k<table_exprs.size(); k++ )
+        m_sep_tables[k][l] = V_ptr[k];
+    }
+  }
+
+  m_sep_parser = new mu::Parser;
+  Define_Constants(*m_sep_parser);
+  for ( unsigned p=0; p<m_names.size(); p++ )
+    m_sep_parser->DefineVar(m_names[p], &m_member[p]);
+  m_sep_parser->DefineVar("t", &m_t);
+  m_sep_parser->SetExpr(time_expression);
+
+  m_sep_num = elements.size();
+  m_separable = true;
+  std::cout << "FYI: Hamiltonian separated into " << m_sep_result.size() << " terms with " << m_sep_tables.size() << " position factors shared by all members\n";
+}
+
+/** Evaluates the Hamiltonian of member m for all points and stores the results in m_V_eval
+  *
+  * @param m Member of the ensemble
+  * @return Offset between the results of two successive points in m_V_eval (0 if evaluated only once)
+  */
+template <int dim>
+int CRT_Ensemble<dim>::Eval_Hamiltonian( const int m )
+{
+  Phase_Scope timer( ph_potential );
+  m_t = m_header.t*m_T;
+  for ( unsigned p=0; p<m_names.size(); p++ )
+    m_member[p] = m_values[p][m];
+
+  if ( m_separable )
+  {
+    const int nNum = m_sep_num;
+    int nF;
+    const double *F = m_sep_parser->Eval(nF);
+
+    m_V_eval.assign((size_t)m_no_of_pts*nNum,0.0);
+    double *V_eval = m_V_eval.data();
+
+    #pragma omp parallel
+    {
+      for ( int k=0; k<nF; k++ )
+      {
+        const double f = F[k];
+        const int n = m_sep_result[k];
+
+        if ( m_sep_table[k] < 0 )
+        {
+          #pragma omp for
+          for ( int l=0; l<m_no_of_pts; l++ )
+            V_eval[(size_t)l*nNum+n] += f;
+          continue;
+        }
+
+        const double *P = m_sep_tables[m_sep_table[k]].data();
+        #pragma omp for
+        for ( int l=0; l<m_no_of_pts; l++ )
+          V_eval[(size_t)l*nNum+n] += f*P[l];
+      }
+    }
+    return nNum;
+  }
+
+  int nNum;
+  double *V_ptr = m_parser->Eval(nNum);
+
+  if ( !m_position_dependent && !m_nonlinear )
+  {
+    m_V_eval.assign(V_ptr,V_ptr+nNum);
+    return 0;
+  }
+
+  m_V_eval.resize((size_t)m_no_of_pts*nNum);
+  for ( int l=0; l<m_no_of_pts; l++ )
+  {
+    if ( m_nonlinear )
+    {
+      for ( int i=0; i<m_no_int_states; i++ )
+      {
+        m_psi_real[i] = Field(i,m)[l][0];
+        m_psi_imag[i] = Field(i,m)[l][1];
+      }
+    }
+    m_x = Get_x(l);
+    V_ptr = m_parser->Eval(nNum);
+    std::copy( V_ptr, V_ptr+nNum, &m_V_eval[(size_t)l*nNum] );
+  }
+  return nNum;
+}
+
+/** Solves the diagonal potential part and the contact interactions for all members
+  */
+template <int dim>
+void CRT_Ensemble<dim>::Do_NL_Step()
+{
+  const double dt = -m_header.dt*m_T;
+  const int S = m_no_int_states;
+
+  for ( int m=0; m<m_no_members; m++ )
+  {
+    const int stride = Eval_Hamiltonian(m);
+    const double *V_eval = m_V_eval.data();
+
+    std::vector<fftw_complex *> Psi;
+    for ( int i=0; i<S; i++ )
+      Psi.push_back( Field(i,m) );
+
+    #pragma omp parallel
+    {
+      double re1, im1, tmp1;
+      std::vector<double> phi(S), density(S);
+
+      Phase_Scope timer( ph_nonlinear );
+      #pragma omp for nowait
+      for ( int l=0; l<m_no_of_pts; l++ )
+      {
+        const double *V = V_eval + (size_t)l*stride;
+        for ( int i=0; i<S; i++ )
+          phi[i] = V[2*i];
+        if ( m_interacting )
+        {
+          for ( int j=0; j<S; j++ )
+            density[j] = Psi[j][l][0]*Psi[j][l][0] + Psi[j][l][1]*Psi[j][l][1];
+          for ( int i=0; i<S; i++ )
+            for ( int j=0; j<S; j++ )
+              phi[i] += m_gs[S*i+j]*density[j];
+        }
+
+        for ( int i=0; i<S; i++ )
+        {
+          sincos( phi[i]*dt, &im1, &re1 );
+
+          tmp1 = Psi[i][l][0];
+          Psi[i][l][0] = Psi[i][l][0]*re1 - Psi[i][l][1]*im1;
+          Psi[i][l][1] = Psi[i][l][1]*re1 + tmp1*im1;
+        }
+      }
+    }
+  }
+}
+
+/** Stores the Hamiltonian of one point in a block of Exp_Hermitian()
+  *
+  * @param ws Workspace of the block
+  * @param b Point in the block
+  * @param V Matrix elements (pairs of real and imaginary part of the upper triangle)
+  * @param phi Contact interactions added to the diagonal (may be nullptr)
+  */
+template <int dim>
+void CRT_Ensemble<dim>::Load_Hamiltonian( herm_workspace &ws, const int b, const double *V, const double *phi )
+{
+  const int S = m_no_int_states;
+
+  int e = 0;
+  for ( int i=0; i<S; i++ )
+  {
+    for ( int j=i; j<S; j++ )
+    {
+      if ( i != j )
+        ws.Set( b, i, j, V[2*e], V[2*e+1] );
+      else
+        ws.Set( b, i, i, V[2*e] + ( phi ? phi[i] : 0.0 ), 0.0 );
+      e++;
+    }
+  }
+}
+
+/** Solves the potential part in the presence of light fields for all members
+  *
+  * See CRT_Base_IF::Numerical_Diagonalization(). The exponentials are computed for blocks of herm_block
+  * consecutive points at once (see herm_exp.h). If the Hamiltonian of a member is the same for all points,
+  * its exponential is computed only once and applied with Apply_Matrix(). Hamiltonians which split into blocks are propagated with
+  * coupling_graph::Propagate().
+  */
+template <int dim>
+void CRT_Ensemble<dim>::Numerical_Diagonalization()
+{
+  const double dt = -m_header.dt*m_T;
+  const int S = m_no_int_states;
+  const int nBlocks = (m_no_of_pts + herm_block - 1)/herm_block;
+
+  for ( int m=0; m<m_no_members; m++ )
+  {
+    const int stride = Eval_Hamiltonian(m);
+    const double *V_eval = m_V_eval.data();
+    const bool uniform = ( stride == 0 && !m_interacting );
+
+    std::vector<fftw_complex *> Psi;
+    for ( int i=0; i<S; i++ )
+      Psi.push_back( Field(i,m) );
+
+    if ( uniform )
+    {
+      const int nChunks = (m_no_of_pts + herm_apply - 1)/herm_apply;
+
+      herm_workspace U(S);
+      Load_Hamiltonian( U, 0, V_eval, nullptr );
+      Exp_Hermitian( U, 1, dt );
+
+      #pragma omp parallel
+      {
+        std::vector<double> out;
+
+        Phase_Scope timer( ph_exp );
+        #pragma omp for schedule(static) nowait
+        for ( int c=0; c<nChunks; c++ )
+        {
+          const int l0 = c*herm_apply;
+          Apply_Matrix( U, Psi.data(), 1, l0, std::min( herm_apply, m_no_of_pts-l0 ), out );
+        }
+      }
+      continue;
+    }
+
+    if ( m_coupling.sparse )
+    {
+      #pragma omp parallel
+      {
+        std::vector<herm_workspace> ws = m_coupling.Workspaces();
+        std::vector<double> phi(herm_block*S), density(S);
+
+        Phase_Scope timer( ph_exp );
+        #pragma omp for schedule(static) nowait
+        for ( int blk=0; blk<nBlocks; blk++ )
+        {
+          const int l0 = blk*herm_block;
+          const int count = std::min( herm_block, m_no_of_pts-l0 );
+          if ( m_interacting )
+          {
+            std::fill( phi.begin(), phi.end(), 0.0 );
+            for ( int b=0; b<count; b++ )
+            {
+              for ( int j=0; j<S; j++ )
+                density[j] = Psi[j][l0+b][0]*Psi[j][l0+b][0] + Psi[j][l0+b][1]*Psi[j][l0+b][1];
+              for ( int i=0; i<S; i++ )
+                for ( int j=0; j<S; j++ )
+                  phi[b*S+i] += m_gs[S*i+j]*density[j];
+            }
+          }
+          m_coupling.Propagate( Psi.data(), 1, l0, count, V_eval, stride, m_interacting ? phi.data() : nullptr, dt, ws );
+        }
+      }
+      continue;
+    }
+
+    #pragma omp parallel
+    {
+      herm_workspace ws(S);
+      std::vector<double> phi(S), density(S), in(2*S);
+
+      Phase_Scope timer( ph_exp );
+      #pragma omp for schedule(static) nowait
+      for ( int blk=0; blk<nBlocks; blk++ )
+      {
+        const int l0 = blk*herm_block;
+        const int count = std::min( herm_block, m_no_of_pts-l0 );
+
+        ws.Set_Zero();
+        for ( int b=0; b<count; b++ )
+        {
+          const int l = l0+b;
+          std::fill( phi.begin(), phi.end(), 0.0 );
+          if ( m_interacting )
+          {
+            for ( int j=0; j<S; j++ )
+              density[j] = Psi[j][l][0]*Psi[j][l][0] + Psi[j][l][1]*Psi[j][l][1];
+            for ( int i=0; i<S; i++ )
+              for ( int j=0; j<S; j++ )
+                phi[i] += m_gs[S*i+j]*density[j];
+          }
+          Load_Hamiltonian( ws, b, V_eval + (size_t)l*stride, phi.data() );
+        }
+        Exp_Hermitian( ws, count, dt );
+
+        for ( int b=0; b<count; b++ )
+        {
+          const int l = l0+b;
+
+          for ( int i=0; i<S; i++ )
+          {
+            in[2*i] = Psi[i][l][0];
+            in[2*i+1] = Psi[i][l][1];
+          }
+          for ( int i=0; i<S; i++ )
+          {
+            double re = 0, im = 0;
+            for ( int j=0; j<S; j++ )
+            {
+              const size_t e = (size_t)(i*S+j)*herm_block + b;
+              re += ws.re[e]*in[2*j] - ws.im[e]*in[2*j+1];
+              im += ws.re[e]*in[2*j+1] + ws.im[e]*in[2*j];
+            }
+            Psi[i][l][0] = re;
+            Psi[i][l][1] = im;
+          }
+        }
+      }
+    }
+  }
+}
+
+/** Compute the number of particles of an internal state of a member
+  *
+  * @param s Internal state
+  * @param m Member of the ensemble
+  */
+template <int dim>
+double CRT_Ensemble<dim>::Get_Particle_Number( const int s, const int m )
+{
+  Phase_Scope timer( ph_observables );
+  fftw_complex *Psi = Field(s,m);
+  double retval=0.0;
+  #pragma omp parallel for reduction(+:retval)
+  for ( int l=0; l<m_no_of_pts; l++ )
+    retval += (Psi[l][0]*Psi[l][0] + Psi[l][1]*Psi[l][1]);
+  return m_ar*retval;
+}
+
+/** Write an internal state of a member to a binary file
+  *
+  * The index of the member (starting at 1) is stored in nFuture[HDR_ENSEMBLE_MEMBER] of the header.
+  * @param filename
+  * @param s Internal state
+  * @param m Member of the ensemble
+  */
+template <int dim>
+void CRT_Ensemble<dim>::Save_Phi( std::string filename, const int s, const int m )
+{
+  generic_header header = m_header;
+  header.nFuture[HDR_ENSEMBLE_MEMBER] = m_ensemble ? m+1 : 0;
+
+  Write_Field( filename, header, Field(s,m) );
+}
+
+/** Append an internal state of a member to a binary file
+  *
+  * @param filename
+  * @param s Internal state
+  * @param m Member of the ensemble
+  */
+template <int dim>
+void CRT_Ensemble<dim>::Append_Phi( std::string filename, const int s, const int m )
+{
+  generic_header header = m_header;
+  header.nFuture[HDR_ENSEMBLE_MEMBER] = m_ensemble ? m+1 : 0;
+
+  Write_Field( filename, header, Field(s,m), true );
+}
+
+/** Run all the sequences defined in the xml file for all members
+  *
+  * Output files are named like the ones of CRT_Base_IF with the member appended, e.g. Seq_1_2_3.bin for
+  * sequence 1, internal state 2 and member 3. The parameters of the members are listed in ensemble.txt.
+  * A single simulation uses the names of CRT_Base_IF.
+  */
+template <int dim>
+void CRT_Ensemble<dim>::run_sequence()
+{
+  char filename[1024];
+  int seq_counter=1;
+
+  std::cout << "FYI: Found " << m_params->m_sequence.size() << " sequences." << std::endl;
+
+  for ( auto seq : m_params->m_sequence )
+  {
+    Solver_Timers().Begin_Sequence( seq.name );
+    if ( seq.name == "set_momentum" )
+    {
+      std::vector<std::string> vec;
+      strtk::parse(seq.content,",",vec);
+      CPoint<dim> P;
+      for ( int i=0; i<dim; i++ )
+        P[i] = stod(vec[i]);
+
+      for ( int m=0; m<m_no_members; m++ )
+      {
+        fftw_complex *Psi = Field(seq.comp,m);
+
+        #pragma omp parallel for
+        for ( int l=0; l<m_no_of_pts; l++ )
+        {
+          double re, im, tmp1;
+          CPoint<dim> x = Get_x(l);
+          sincos( P*x, &im, &re );
+          tmp1 = Psi[l][0];
+          Psi[l][0] = Psi[l][0]*re - Psi[l][1]*im;
+          Psi[l][1] = Psi[l][1]*re + tmp1*im;
+        }
+      }
+      std::cout << "FYI: momentum set for component " << seq.comp << "\n";
+      seq_counter++;
+      continue;
+    }
+
+    if ( seq.name != "interact" && seq.name != "freeprop" )
+    {
+      std::cerr << "Critical Error: Invalid sequence name " << seq.name << " for ensembles\n";
+      exit(EXIT_FAILURE);
+    }
+
+    double max_duration = 0;
+    for ( unsigned i = 0; i < seq.duration.size(); i++)
+      if (seq.duration[i] > max_duration )
+        max_duration = seq.duration[i];
+
+    int subN = int(max_duration / seq.dt);
+    int Nk = seq.Nk;
+    int Na = subN / seq.Nk;
+
+    Setup_Parser(seq);
+    if ( seq.name == "interact" ) m_coupling.Setup( seq.V_real, seq.V_imag, m_no_int_states, m_params->Get_Algorithm("PAIRWISE",0) != 0 );
+
+    std::cout << "FYI: started new sequence " << seq.name << "\n";
+    std::cout << "FYI: sequence no : " << seq_counter << "\n";
+    std::cout << "FYI: duration    : " << max_duration << "\n";
+    std::cout << "FYI: dt          : " << seq.dt << "\n";
+
+    if ( this->Get_dt() != seq.dt )
+      this->Set_dt(seq.dt);
+
+    for ( int s=0; s<m_no_int_states; s++ )
+      for ( int m=0; m<m_no_members; m++ )
+      {
+        if ( m_ensemble )
+          sprintf( filename, "Seq_%d_%d_%d.bin", seq_counter, s+1, m+1 );
+        else
+          sprintf( filename, "Seq_%d_%d.bin", seq_counter, s+1 );
+        std::remove(filename);
+      }
+
+    Solver_Progress().Begin_Sequence( seq.name, seq_counter, (long long)Na*Nk, m_no_int_states*m_no_members*Get_Global_Points(), m_header.t );
+    for ( int i=1; i<=Na; i++ )
+    {
+      Do_FT_Step(0.5);
+      for ( int j=1; j<=Nk; j++ )
+      {
+        if ( seq.name == "interact" )
+          Numerical_Diagonalization();
+        else
+          Do_NL_Step();
+        Do_FT_Step( ( j == Nk ) ? 0.5 : 1.0 );
+      }
+
+      Solver_Progress().Step( Nk, m_header.t );
+
+      for ( int s=0; s<m_no_int_states; s++ )
+      {
+        for ( int m=0; m<m_no_members; m++ )
+        {
+          if ( seq.output_freq == freq::each || ( seq.output_freq == freq::last && i == Na ) )
+          {
+            if ( m_ensemble )
+              sprintf( filename, "%.3f_%d_%d.bin", this->Get_t(), s+1, m+1 );
+            else
+              sprintf( filename, "%.3f_%d.bin", this->Get_t(), s+1 );
+            Save_Phi( filename, s, m );
+          }
+          if ( seq.output_freq == freq::packed )
+          {
+            if ( m_ensemble )
+              sprintf( filename, "Seq_%d_%d_%d.bin", seq_counter, s+1, m+1 );
+            else
+              sprintf( filename, "Seq_%d_%d.bin", seq_counter, s+1 );
+            Append_Phi( filename, s, m );
+          }
+          if ( seq.compute_pn_freq == freq::each || ( seq.compute_pn_freq == freq::last && i == Na ) )
+          {
+            std::ostringstream line;
+            if ( m_ensemble )
+              line << "N[" << s << "][" << m+1 << "] = " << Get_Particle_Number(s,m) << "\n";
+            else
+              line << "N[" << s << "] = " << Get_Particle_Number(s,m) << "\n";
+            Solver_Progress().Post( line.str() );
+          }
+        }
+      }
+    }
+    Solver_Progress().End_Sequence();
+    seq_counter++;
+  }
+  Write_Timers();
+}
+#endif
@@ -0,0 +1,699 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#include <ostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <complex>
+#include <vector>
+#include <map>
+
+#include "strtk.hpp"
+#include "CRT_shared.h"
+#include "cft_base.h"
+#include "field_alloc.h"
+#include "ParameterHandler.h"
+#include "gsl/gsl_complex_math.h"
+#include "gsl/gsl_eigen.h"
+#include "gsl/gsl_blas.h"
+#include "muParser.h"
+
+using namespace std;
+
+#ifndef __class_CRT_Lattice__
+#define __class_CRT_Lattice__
+
+/** Template class for the propagation of momentum families in <B>dim</B> dimensions
+  *
+  * Each internal state s is represented by the momentum orders n = -LATTICE_ORDERS ... LATTICE_ORDERS
+  * \f[
+  *   \Psi_s(\vec{x}) = \sum_n e^{i(k_0 + nK)x} \phi_{s,n}(\vec{x}),
+  * \f]
+  * where K (LATTICE_K) is the momentum transfer of the light field along x and k_0 (LATTICE_K0) an offset.
+  * The envelopes \f$ \phi_{s,n} \f$ live on the grid of the initial files, which only needs to resolve the cloud and
+  * not the optical lattice. The Hamiltonian of the xml sequences is evaluated over one period \f$ 2\pi/K \f$ around
+  * every grid point and decomposed into the harmonics \f$ e^{imKx} \f$ with \f$ |m| \le \f$ LATTICE_HARMONICS,
+  * which couple the order n of state j to the order n+m of state i.
+  */
+template <class T, int dim>
+class CRT_Lattice : public CRT_shared
+{
+public:
+  CRT_Lattice( ParameterHandler * );
+  virtual ~CRT_Lattice();
+
+  void run_sequence();
+
+  double Get_Particle_Number( const int, const int );
+  void Save_Phi( std::string, const int, const int );
+  void Append_Phi( std::string, const int, const int );
+
+protected:
+  void Init();
+  void LoadFiles();
+  void Setup_Parser( const sequence_item & );
+
+  void Do_FT_Step( const double );
+  void Do_Lattice_Step();
+  void Eval_Harmonics( const int, std::complex<double> * );
+  void Build_Hamiltonian( const std::complex<double> *, gsl_matrix_complex * );
+
+  /// Index of the envelope of state s and order n in m_fields
+  int Field_Index( const int s, const int n ) const
+  {
+    return s*m_no_orders + n + m_max_order;
+  };
+
+  /// Object for reading from xml files
+  ParameterHandler *m_params;
+
+  /// Dimensionless scaling factor for the kinetic part in n dimensions
+  CPoint<dim> m_alpha;
+
+  double m_M;
+  double m_T;
+
+  int m_no_int_states;
+  /// Largest momentum order |n|
+  int m_max_order;
+  /// Number of momentum orders per internal state
+  int m_no_orders;
+  /// Largest harmonic |m| of the couplings
+  int m_harmonics;
+  /// Number of samples per lattice period
+  int m_samples;
+  /// Momentum transfer of one order along x
+  double m_lattice_k;
+  /// Wave number offset of the momentum family along x
+  double m_lattice_k0;
+
+  /// Envelopes, see Field_Index()
+  std::vector<T *> m_fields;
+  /// Exponential of the whole and half kinetic operator for each order on a distributed grid
+  std::vector<fftw_complex *> m_full_step;
+  std::vector<fftw_complex *> m_half_step;
+  /// Kinetic tables of each order for all time steps used so far on a local grid
+  std::map<double,std::vector<kinetic_table>> m_kinetic;
+  /// Kinetic tables of the current time step
+  const std::vector<kinetic_table> *m_kinetic_dt;
+
+  mu::Parser *m_parser;
+  CPoint<dim> m_x;
+  double m_t;
+  bool m_position_dependent;
+  bool m_time_dependent;
+
+  /// Internal states (i,j) of the matrix elements evaluated by m_parser
+  std::vector<std::pair<int,int>> m_elements;
+  /// Cached exponentials of the Hamiltonian for time independent sequences
+  std::vector<std::complex<double>> m_exp_cache;
+  bool m_exp_cached;
+};
+
+/** Constructor
+  *
+  * Reads the lattice parameters from the ALGORITHM section and loads the initial files into the order n=0.
+  * @param params Pointer to ParameterHandler object to read from xml files
+  */
+template <class T, int dim>
+CRT_Lattice<T,dim>::CRT_Lattice( ParameterHandler *params )
+{
+  m_params = params;
+  m_parser = nullptr;
+  m_exp_cached = false;
+  m_kinetic_dt = nullptr;
+
+  Read_header(params->Get_simulation("FILENAME"),dim);
+  assert( m_header.nDims == dim );
+
+  m_no_int_states = std::stoi(params->Get_simulation("INTERNAL_DIM"));
+  m_max_order = params->Get_Algorithm("LATTICE_ORDERS",3);
+  m_no_orders = 2*m_max_order+1;
+  m_harmonics = params->Get_Algorithm("LATTICE_HARMONICS",1);
+  m_samples = 4*m_harmonics+2;
+  m_lattice_k = params->Get_Algorithm("LATTICE_K",0);
+  m_lattice_k0 = params->Get_Algorithm("LATTICE_K0",0);
+
+  if ( m_lattice_k == 0.0 ) throw std::string("Error: LATTICE_K is required in section ALGORITHM for the lattice engine.\n");
+
+  m_T = m_params->Get_t_scale();
+  m_M = m_params->Get_M();
+  double hbar = 1.054571817e-34;
+  for ( int i=0; i<dim; i++ )
+    m_alpha[i] = hbar*m_T/(2*m_M);
+
+  m_header.T_scale = m_T;
+  m_header.dt = params->Get_dt();
+
+  if ( params->Get_Algorithm("ARENA",1) != 0 )
+  {
+    const size_t N = Local_Points_Bound();
+    const int nTab = ( N != size_t(m_header.nDimX*m_header.nDimY*m_header.nDimZ) ) ? 2 : 0;
+    Solver_Arena().Reserve( N*(m_no_int_states+nTab)*m_no_orders*sizeof(fftw_complex) + 64*(m_no_int_states+nTab)*m_no_orders, 0,
+                            params->Get_Algorithm("HUGEPAGES",2) );
+  }
+
+  for ( int f=0; f<m_no_int_states*m_no_orders; f++ )
+  {
+    m_fields.push_back( new T( m_header ) );
+    m_fields.back()->SetFix(false);
+  }
+  Setup_Local( m_fields[0] );
+  for ( int n=0; n<m_no_orders && m_distributed; n++ )
+  {
+    m_full_step.push_back( Alloc_Complex( m_no_of_pts_k ) );
+    m_half_step.push_back( Alloc_Complex( m_no_of_pts_k ) );
+  }
+
+  LoadFiles();
+  Init();
+
+  std::cout << "FYI: lattice engine with " << m_no_orders << " orders of K = " << m_lattice_k << " per internal state\n";
+}
+
+/// Destructor
+template <class T, int dim>
+CRT_Lattice<T,dim>::~CRT_Lattice()
+{
+  for ( auto f : m_fields )
+    delete f;
+  for ( unsigned n=0; n<m_full_step.size(); n++ )
+  {
+    Free_Buffer( m_full_step[n] );
+    Free_Buffer( m_half_step[n] );
+  }
+  delete m_parser;
+}
+
+/** Load the initial wavefunctions into the order n=0 of each internal state
+  */
+template <class T, int dim>
+void CRT_Lattice<T,dim>::LoadFiles()
+{
+  for ( int s=0; s<m_no_int_states; s++ )
+  {
+    string str = ( s == 0 ) ? "FILENAME" : "FILENAME_" + to_string(s+1);
+    Read_Field( m_params->Get_simulation(str), m_fields[Field_Index(s,0)]->Getp2In() );
+  }
+}
+
+/** The exponential of the kinetic operator for each momentum order
+  *
+  * The order n is shifted by \f$ k_0 + nK \f$ along x:
+  * \f[
+  *   \exp \left(-i\Delta t \alpha (\vec{k} + (k_0 + nK)\vec{e}_x)^2 \right)
+  * \f]
+  * On a local grid the exponential factorises into one table per axis and order, which are kept for each time
+  * step (see CRT_shared::Fill_Kinetic_Table()). Only distributed grids store it for every point.
+  */
+template <class T, int dim>
+void CRT_Lattice<T,dim>::Init()
+{
+  if ( !m_distributed )
+  {
+    const double dt = -m_header.dt;
+    auto it = m_kinetic.find(dt);
+    if ( it == m_kinetic.end() )
+    {
+      std::vector<kinetic_table> &tab = m_kinetic[dt];
+      tab.resize(m_no_orders);
+      for ( int n=0; n<m_no_orders; n++ )
+        Fill_Kinetic_Table( tab[n], dt, &m_alpha[0], dim, m_lattice_k0 + double(n-m_max_order)*m_lattice_k );
+      it = m_kinetic.find(dt);
+    }
+    m_kinetic_dt = &it->second;
+    return;
+  }
+
+  for ( int n=0; n<m_no_orders; n++ )
+  {
+    const double kn = m_lattice_k0 + double(n-m_max_order)*m_lattice_k;
+    fftw_complex *full = m_full_step[n];
+    fftw_complex *half = m_half_step[n];
+
+    #pragma omp parallel
+    {
+      const double dt = -m_header.dt;
+      double phi;
+      CPoint<dim> k;
+
+      #pragma omp for
+      for ( int i=0; i<m_no_of_pts_k; i++ )
+      {
+        k = m_fields[0]->Get_k(i);
+        k[0] += kn;
+        phi = dt*(k.scale(m_alpha)*k);
+
+        sincos( 0.5*phi, &half[i][1], &half[i][0] );
+        sincos( phi, &full[i][1], &full[i][0] );
+      }
+    }
+  }
+}
+
+/** Compute the kinetic part for all envelopes
+  *
+  * @param frac Fraction of dt (1 or 0.5)
+  */
+template <class T, int dim>
+void CRT_Lattice<T,dim>::Do_FT_Step( const double frac )
+{
+  Phase_Scope timer( ph_kinetic );
+  for ( int s=0; s<m_no_int_states; s++ )
+  {
+    for ( int n=0; n<m_no_orders; n++ )
+    {
+      T *field = m_fields[Field_Index(s,n-m_max_order)];
+
+      field->ft(-1);
+      fftw_complex *Psi = field->Getp2In();
+
+      if ( !m_distributed )
+      {
+        const kinetic_table &tab = (*m_kinetic_dt)[n];
+        Apply_Kinetic_Table( ( frac == 1.0 ) ? tab.full : tab.half, dim, Psi );
+        field->ft(1);
+        continue;
+      }
+
+      fftw_complex *step = ( frac == 1.0 ) ? m_full_step[n] : m_half_step[n];
+
+      #pragma omp parallel for
+      for ( int l=0; l<m_no_of_pts_k; l++ )
+      {
+        double tmp1 = Psi[l][0];
+        Psi[l][0] = Psi[l][0]*step[l][0] - Psi[l][1]*step[l][1];
+        Psi[l][1] = Psi[l][1]*step[l][0] + tmp1*step[l][1];
+      }
+      field->ft(1);
+    }
+  }
+  m_header.t += frac*m_header.dt;
+}
+
+/** Define the Hamiltonian of a sequence in m_parser
+  *
+  * The matrix elements are evaluated as pairs of real and imaginary part in the same order as for CRT_Base_IF.
+  */
+template <class T, int dim>
+void CRT_Lattice<T,dim>::Setup_Parser( const sequence_item &seq )
+{
+  m_elements.clear();
+  if ( seq.name == "interact" )
+  {
+    for ( int i=0; i<m_no_int_states; i++ )
+      for ( int j=i; j<m_no_int_states; j++ )
+        m_elements.push_back( std::make_pair(i,j) );
+  }
+  else
+  {
+    for ( int i=0; i<m_no_int_states; i++ )
+      m_elements.push_back( std::make_pair(i,i) );
+  }
+
+  std::string V_expression = seq.V_real[0] + "," + seq.V_imag[0];
+  for ( unsigned i=1; i<seq.V_real.size(); i++ )
+    V_expression += "," + seq.V_real[i] + "," + seq.V_imag[i];
+
+  delete m_parser;
+  m_parser = new mu::Parser;
+  m_parser->SetExpr(V_expression);
+
+  m_position_dependent = false;
+  m_time_dependent = false;
+  for ( auto item : m_parser->GetUsedVar() )
+  {
+    if ( item.first == "x" || item.first == "y" || item.first == "z" ) m_position_dependent = true;
+    if ( item.first == "t" ) m_time_dependent = true;
+    if ( item.first.rfind("psi_", 0) == 0 ) throw std::string("Error: the lattice engine does not support nonlinear Hamiltonians.\n");
+  }
+
+  for ( auto it : m_params->m_map_constants )
+    m_parser->DefineConst(it.first, it.second);
+  m_parser->DefineConst("pi", (double)M_PI);
+  m_parser->DefineConst("e", (double)M_E);
+  m_parser->DefineVar("t", &m_t);
+  m_parser->DefineVar("x", &m_x[0]);
+  if ( dim >= 2 ) m_parser->DefineVar("y", &m_x[1]);
+  if ( dim == 3 ) m_parser->DefineVar("z", &m_x[2]);
+  m_parser->SetExpr(V_expression);
+
+  m_exp_cached = false;
+}
+
+/** Decompose the matrix elements at grid point l into the harmonics of the lattice
+  *
+  * \f[
+  *   c_m(\vec{x}_l) = \frac{1}{Q} \sum_q V(\vec{x}_l + \xi_q \vec{e}_x) e^{-imK(x_l+\xi_q)}
+  * \f]
+  * Hamiltonians which do not depend on the position only have the harmonic c_0 = V.
+  * @param l Array index
+  * @param c Harmonics, c[e*(2H+1)+m+H] for matrix element e
+  */
+template <class T, int dim>
+void CRT_Lattice<T,dim>::Eval_Harmonics( const int l, std::complex<double> *c )
+{
+  const int H = m_harmonics;
+  const int nE = m_elements.size();
+  const double period = 2*M_PI/fabs(m_lattice_k);
+  int nNum;
+
+  for ( int i=0; i<nE*(2*H+1); i++ )
+    c[i] = 0;
+
+  CPoint<dim> x0 = m_fields[0]->Get_x(l);
+
+  // A Hamiltonian without x has no harmonics besides m=0
+  if ( !m_position_dependent )
+  {
+    m_x = x0;
+    double *V_ptr = m_parser->Eval(nNum);
+    for ( int e=0; e<nE; e++ )
+      c[e*(2*H+1)+H] = std::complex<double>( V_ptr[2*e], ( m_elements[e].first == m_elements[e].second ) ? 0.0 : V_ptr[2*e+1] );
+    return;
+  }
+
+  for ( int q=0; q<m_samples; q++ )
+  {
+    m_x = x0;
+    m_x[0] += period*double(q)/double(m_samples);
+    double *V_ptr = m_parser->Eval(nNum);
+
+    for ( int e=0; e<nE; e++ )
+    {
+      std::complex<double> V( V_ptr[2*e], ( m_elements[e].first == m_elements[e].second ) ? 0.0 : V_ptr[2*e+1] );
+      for ( int m=-H; m<=H; m++ )
+        c[e*(2*H+1)+m+H] += V*std::polar( 1.0/double(m_samples), -double(m)*m_lattice_k*m_x[0] );
+    }
+  }
+}
+
+/** Assemble the Hamiltonian of all states and orders from the harmonics
+  *
+  * @param c Harmonics from Eval_Harmonics()
+  * @param A Hermitian matrix of dimension m_no_int_states*m_no_orders
+  */
+template <class T, int dim>
+void CRT_Lattice<T,dim>::Build_Hamiltonian( const std::complex<double> *c, gsl_matrix_complex *A )
+{
+  const int H = m_harmonics;
+  gsl_matrix_complex_set_zero(A);
+
+  for ( unsigned e=0; e<m_elements.size(); e++ )
+  {
+    const int i = m_elements[e].first;
+    const int j = m_elements[e].second;
+
+    for ( int n=-m_max_order; n<=m_max_order; n++ )
+    {
+      for ( int n2=-m_max_order; n2<=m_max_order; n2++ )
+      {
+        const int m = n-n2;
+        if ( abs(m) > H ) continue;
+        const std::complex<double> v = c[e*(2*H+1)+m+H];
+        gsl_matrix_complex_set(A,Field_Index(i,n),Field_Index(j,n2), {v.real(),v.imag()});
+        if ( i != j )
+          gsl_matrix_complex_set(A,Field_Index(j,n2),Field_Index(i,n), {v.real(),-v.imag()});
+      }
+    }
+  }
+}
+
+/** Solves the potential part for all states and orders
+  *
+  * The harmonics are evaluated serially with the parser, the matrix exponentials are computed in parallel
+  * with a numerical diagonalisation. Position independent Hamiltonians are exponentiated once, time independent
+  * ones once per sequence.
+  */
+template <class T, int dim>
+void CRT_Lattice<T,dim>::Do_Lattice_Step()
+{
+  const int D = m_no_int_states*m_no_orders;
+  const int nH = m_elements.size()*(2*m_harmonics+1);
+  const int nP = ( m_position_dependent ) ? m_no_of_pts : 1;
+  const double dt = -m_header.dt*m_T;
+  m_t = m_header.t*m_T;
+
+  if ( !m_exp_cached )
+  {
+    std::vector<std::complex<double>> c(nP*nH);
+    {
+      Phase_Scope timer( ph_potential );
+      for ( int l=0; l<nP; l++ )
+        Eval_Harmonics( l, &c[l*nH] );
+    }
+
+    m_exp_cache.resize(nP*D*D);
+
+    #pragma omp parallel
+    {
+      double re1, im1;
+      gsl_matrix_complex *A = gsl_matrix_complex_calloc(D,D);
+      gsl_matrix_complex *B = gsl_matrix_complex_calloc(D,D);
+      gsl_eigen_hermv_workspace *w = gsl_eigen_hermv_alloc(D);
+      gsl_vector *eval = gsl_vector_alloc(D);
+      gsl_matrix_complex *evec = gsl_matrix_complex_alloc(D,D);
+
+      Phase_Scope timer( ph_exp );
+      #pragma omp for nowait
+      for ( int l=0; l<nP; l++ )
+      {
+        Build_Hamiltonian( &c[l*nH], A );
+        gsl_eigen_hermv(A,eval,evec,w);
+
+        gsl_matrix_complex_set_zero(B);
+        for ( int i=0; i<D; i++ )
+        {
+          sincos( dt*gsl_vector_get(eval,i), &im1, &re1 );
+          gsl_matrix_complex_set(B,i,i, {re1,im1});
+        }
+        gsl_blas_zgemm(CblasNoTrans,CblasConjTrans,GSL_COMPLEX_ONE,B,evec,GSL_COMPLEX_ZERO,A);
+        gsl_blas_zgemm(CblasNoTrans,CblasNoTrans,GSL_COMPLEX_ONE,evec,A,GSL_COMPLEX_ZERO,B);
+
+        for ( int i=0; i<D; i++ )
+          for ( int j=0; j<D; j++ )
+          {
+            gsl_complex z = gsl_matrix_complex_get(B,i,j);
+            m_exp_cache[(l*D+i)*D+j] = std::complex<double>( GSL_REAL(z), GSL_IMAG(z) );
+          }
+      }
+      gsl_matrix_complex_free(A);
+      gsl_matrix_complex_free(B);
+      gsl_eigen_hermv_free(w);
+      gsl_vector_free(eval);
+      gsl_matrix_complex_free(evec);
+    }
+    m_exp_cached = !m_time_dependent;
+  }
+
+  std::vector<fftw_complex *> Psi;
+  for ( int f=0; f<D; f++ )
+    Psi.push_back( m_fields[f]->Getp2In() );
+
+  #pragma omp parallel
+  {
+    std::vector<std::complex<double>> in(D);
+
+    Phase_Scope timer( ph_exp );
+    #pragma omp for nowait
+    for ( int l=0; l<m_no_of_pts; l++ )
+    {
+      const std::complex<double> *U = &m_exp_cache[( m_position_dependent ? l : 0 )*D*D];
+      for ( int f=0; f<D; f++ )
+        in[f] = std::complex<double>( Psi[f][l][0], Psi[f][l][1] );
+      for ( int i=0; i<D; i++ )
+      {
+        std::complex<double> sum = 0;
+        for ( int j=0; j<D; j++ )
+          sum += U[i*D+j]*in[j];
+        Psi[i][l][0] = sum.real();
+        Psi[i][l][1] = sum.imag();
+      }
+    }
+  }
+}
+
+/** Compute the number of particles of an internal state in a momentum order
+  *
+  * @param s Internal state
+  * @param n Momentum order
+  */
+template <class T, int dim>
+double CRT_Lattice<T,dim>::Get_Particle_Number( const int s, const int n )
+{
+  Phase_Scope timer( ph_observables );
+  fftw_complex *Psi = m_fields[Field_Index(s,n)]->Getp2In();
+  double retval=0.0;
+  #pragma omp parallel for reduction(+:retval)
+  for ( int l=0; l<m_no_of_pts; l++ )
+    retval += (Psi[l][0]*Psi[l][0] + Psi[l][1]*Psi[l][1]);
+  Reduce_Sum( &retval, 1 );
+  return m_ar*retval;
+}
+
+/** Write the envelope of an internal state in a momentum order to a binary file
+  *
+  * The wave number of the order along x is stored in dFuture[HDR_LATTICE_K] of the header.
+  * @param filename
+  * @param s Internal state
+  * @param n Momentum order
+  */
+template <class T, int dim>
+void CRT_Lattice<T,dim>::Save_Phi( std::string filename, const int s, const int n )
+{
+  generic_header header = m_header;
+  header.dFuture[HDR_LATTICE_K] = m_lattice_k0 + double(n)*m_lattice_k;
+
+  Write_Field( filename, header, m_fields[Field_Index(s,n)]->Getp2In() );
+}
+
+/** Append the envelope of an internal state in a momentum order to a binary file
+  *
+  * @param filename
+  * @param s Internal state
+  * @param n Momentum order
+  */
+template <class T, int dim>
+void CRT_Lattice<T,dim>::Append_Phi( std::string filename, const int s, const int n )
+{
+  generic_header header = m_header;
+  header.dFuture[HDR_LATTICE_K] = m_lattice_k0 + double(n)*m_lattice_k;
+
+  Write_Field( filename, header, m_fields[Field_Index(s,n)]->Getp2In(), true );
+}
+
+/** Run all the sequences defined in the xml file
+  *
+  * Output files are named like the ones of CRT_Base_IF with the momentum order appended,
+  * e.g. Seq_1_2_-1.bin for sequence 1, internal state 2 and order -1.
+  */
+template <class T, int dim>
+void CRT_Lattice<T,dim>::run_sequence()
+{
+  char filename[1024];
+  int seq_counter=1;
+
+  std::cout << "FYI: Found " << m_params->m_sequence.size() << " sequences." << std::endl;
+
+  for ( auto seq : m_params->m_sequence )
+  {
+    Solver_Timers().Begin_Sequence( seq.name );
+    if ( seq.name == "set_momentum" )
+    {
+      std::vector<std::string> vec;
+      strtk::parse(seq.content,",",vec);
+      CPoint<dim> P;
+      for ( int i=0; i<dim; i++ )
+        P[i] = stod(vec[i]);
+
+      for ( int n=-m_max_order; n<=m_max_order; n++ )
+      {
+        fftw_complex *Psi = m_fields[Field_Index(seq.comp,n)]->Getp2In();
+
+        #pragma omp parallel for
+        for ( int l=0; l<m_no_of_pts; l++ )
+        {
+          double re, im, tmp1;
+          CPoint<dim> x = m_fields[0]->Get_x(l);
+          sincos( P*x, &im, &re );
+          tmp1 = Psi[l][0];
+          Psi[l][0] = Psi[l][0]*re - Psi[l][1]*im;
+          Psi[l][1] = Psi[l][1]*re + tmp1*im;
+        }
+      }
+      std::cout << "FYI: momentum set for component " << seq.comp << "\n";
+      seq_counter++;
+      continue;
+    }
+
+    if ( seq.name != "interact" && seq.name != "freeprop" )
+    {
+      std::cerr << "Critical Error: Invalid sequence name " << seq.name << " for the lattice engine\n";
+      exit(EXIT_FAILURE);
+    }
+
+    double max_duration = 0;
+    for ( unsigned i = 0; i < seq.duration.size(); i++)
+      if (seq.duration[i] > max_duration )
+        max_duration = seq.duration[i];
+
+    int subN = int(max_duration / seq.dt);
+    int Nk = seq.Nk;
+    int Na = subN / seq.Nk;
+
+    Setup_Parser(seq);
+
+    std::cout << "FYI: started new sequence " << seq.name << "\n";
+    std::cout << "FYI: sequence no : " << seq_counter << "\n";
+    std::cout << "FYI: duration    : " << max_duration << "\n";
+    std::cout << "FYI: dt          : " << seq.dt << "\n";
+
+    if ( this->Get_dt() != seq.dt )
+      this->Set_dt(seq.dt);
+
+    for ( int s=0; s<m_no_int_states; s++ )
+      for ( int n=-m_max_order; n<=m_max_order; n++ )
+      {
+        sprintf( filename, "Seq_%d_%d_%d.bin", seq_counter, s+1, n );
+        std::remove(filename);
+      }
+
+    Solver_Progress().Begin_Sequence( seq.name, seq_counter, (long long)Na*Nk, m_no_int_states*m_no_orders*Get_Global_Points(), m_header.t );
+    for ( int i=1; i<=Na; i++ )
+    {
+      Do_FT_Step(0.5);
+      for ( int j=2; j<=Nk; j++ )
+      {
+        Do_Lattice_Step();
+        Do_FT_Step(1.0);
+      }
+      Do_Lattice_Step();
+      Do_FT_Step(0.5);
+
+      Solver_Progress().Step( Nk, m_header.t );
+
+      for ( int s=0; s<m_no_int_states; s++ )
+      {
+        for ( int n=-m_max_order; n<=m_max_order; n++ )
+        {
+          if ( seq.output_freq == freq::each || ( seq.output_freq == freq::last && i == Na ) )
+          {
+            sprintf( filename, "%.3f_%d_%d.bin", this->Get_t(), s+1, n );
+            Save_Phi( filename, s, n );
+          }
+          if ( seq.output_freq == freq::packed )
+          {
+            sprintf( filename, "Seq_%d_%d_%d.bin", seq_counter, s+1, n );
+            Append_Phi( filename, s, n );
+          }
+          if ( seq.compute_pn_freq == freq::each || ( seq.compute_pn_freq == freq::last && i == Na ) )
+          {
+            std::ostringstream line;
+            line << "N[" << s << "][" << n << "] = " << Get_Particle_Number(s,n) << "\n";
+            Solver_Progress().Post( line.str() );
+          }
+        }
+      }
+    }
+    Solver_Progress().End_Sequence();
+    seq_counter++;
+  }
+  Write_Timers();
+}
+#endif
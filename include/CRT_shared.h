@@ -25,10 +25,19 @@
 #include "my_structs.h"
 #include "CPoint.h"
 #include "fftw3.h"
+#include "phase_timer.h"
+#include "progress.h"
 #include <cmath>
 #include <fstream>
 #include <cassert>
 #include <array>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#ifdef TALISES_MPI
+#include <mpi.h>
+#endif
 
 /** Function pointer with a sequence_item
   */
@@ -45,12 +54,15 @@ public:
     */
   CRT_shared() :
     m_no_of_pts(0),
+    m_no_of_pts_k(0),
     m_no_of_pts_red(0),
     m_shift_x(0),
     m_shift_y(0),
     m_shift_z(0),
     m_ar(0),
-    m_ar_k(0)
+    m_ar_k(0),
+    m_local_x0(0),
+    m_distributed(false)
   {
     m_header = {};
     m_log.open("log.txt");
@@ -112,6 +124,11 @@ public:
   {
     return m_no_of_pts;
   };
+  /// Number of grid points of all processes
+  double Get_Global_Points() const
+  {
+    return double(m_header.nDimX)*m_header.nDimY*m_header.nDimZ;
+  };
 
   /// Change size of time steps to dt and call Init() to recalculate the kinetic operator
   void Set_dt( const double dt )
@@ -119,6 +136,32 @@ public:
     m_header.dt = dt;
     Init();
   };
+  /// Rank of this process (0 without MPI)
+  static int Get_Rank()
+  {
+    int rank = 0;
+#ifdef TALISES_MPI
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+#endif
+    return rank;
+  }
+
+  /** Writes the timings of the phases of the run (see Solver_Timers())
+    *
+    * The tables are written to the log file and stdout, the first process writes timers.json and, with TRACE=1 in
+    * section ALGORITHM, the timeline trace.json for chrome://tracing or Perfetto.
+    */
+  void Write_Timers()
+  {
+    Phase_Timers &timers = Solver_Timers();
+    if ( !timers.enabled ) return;
+    timers.Report( m_log );
+    timers.Report( std::cout );
+    if ( Get_Rank() != 0 ) return;
+    timers.Write_JSON( "timers.json" );
+    if ( timers.tracing ) timers.Write_Trace( "trace.json" );
+  }
+
   ///log file
   std::ofstream m_log;
 
@@ -136,6 +179,15 @@ protected:
     file1.read( (char *)&m_header, sizeof(generic_header) );
     file1.close();
 
+    Setup_Grid(dim);
+  }
+
+  /** Derive the number of points and the volume elements from #m_header
+    *
+    * @param dim Dimensions of the grid
+    */
+  void Setup_Grid(const int dim)
+  {
     switch ( dim )
     {
     //1D
@@ -169,12 +221,274 @@ protected:
       m_no_of_pts_red = m_header.nDimX*m_header.nDimY*(m_shift_z+1);
       break;
     }
+
+    m_no_of_pts_k = m_no_of_pts;
+    m_local_x0 = 0;
+    m_distributed = false;
+
+    const long long N[3] = { m_header.nDimX, m_header.nDimY, m_header.nDimZ };
+    const double d[3] = { m_header.dx, m_header.dy, m_header.dz };
+    const double dk[3] = { m_header.dkx, m_header.dky, m_header.dkz };
+    for ( int a=0; a<3; a++ )
+    {
+      const long long shift = N[a]/2;
+      m_axis_x[a].assign( N[a], 0.0 );
+      m_axis_k[a].assign( N[a], 0.0 );
+      if ( a >= dim ) continue;
+      for ( long long i=0; i<N[a]; i++ )
+      {
+        m_axis_x[a][i] = double(i-shift)*d[a];
+        m_axis_k[a][i] = dk[a]*double((i+shift)%N[a]-shift);
+      }
+    }
+  }
+
+  /** Adopt the part of the grid which is stored on this process
+    *
+    * For fields distributed along x over all MPI processes (see cft_2d_mpi, cft_3d_mpi) m_no_of_pts is the
+    * number of local points in real space, m_no_of_pts_k the number of local points in fourier space and
+    * m_axis_x[0] holds the local coordinates only. Without MPI nothing changes.
+    * @param field Any field on the grid
+    */
+  template <class F> void Setup_Local( F *field )
+  {
+    m_no_of_pts = field->Get_Dim_RS();
+    m_no_of_pts_k = field->Get_Dim_FS();
+    m_local_x0 = field->Get_Local_Start_X();
+    m_distributed = ( field->Get_Local_Dim_X() != m_header.nDimX );
+
+    const long long shift = m_header.nDimX/2;
+    m_axis_x[0].resize( field->Get_Local_Dim_X() );
+    for ( long long i=0; i<(long long)m_axis_x[0].size(); i++ )
+      m_axis_x[0][i] = double(i+m_local_x0-shift)*m_header.dx;
+  }
+
+  /** Upper bound of the number of complex values of a field on this process
+    *
+    * This is the whole grid, unless 2D and 3D grids are distributed over several MPI processes (see Setup_Local()).
+    * Only needs #m_header.
+    */
+  size_t Local_Points_Bound() const
+  {
+    size_t retval = m_header.nDimX*m_header.nDimY*m_header.nDimZ;
+#ifdef TALISES_MPI
+    int size = 1;
+    MPI_Comm_size( MPI_COMM_WORLD, &size );
+    if ( size > 1 && m_header.nDims > 1 )
+    {
+      const size_t NX = m_header.nDimX, NY = m_header.nDimY, NZ = m_header.nDimZ;
+      retval = std::max( (NX+size-1)/size*NY*NZ, (NY+size-1)/size*NX*NZ );
+    }
+#endif
+    return retval;
+  }
+
+  /** Sum values over all processes of a distributed grid
+    *
+    * @param val Array of local sums, replaced by the global sums
+    * @param n Number of elements of val
+    */
+  void Reduce_Sum( double *val, const int n )
+  {
+#ifdef TALISES_MPI
+    if ( m_distributed ) MPI_Allreduce( MPI_IN_PLACE, val, n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD );
+#endif
+  }
+
+  /** Write a header and a field to a binary file
+    *
+    * Distributed fields are written collectively with MPI-IO, every process writes its own slab.
+    * @param filename
+    * @param header Header of the whole grid
+    * @param data Local part of the field
+    * @param append Append to the file instead of overwriting it
+    */
+  void Write_Field( const std::string &filename, const generic_header &header, fftw_complex *data, const bool append=false )
+  {
+    Phase_Scope timer( ph_io );
+#ifdef TALISES_MPI
+    if ( m_distributed )
+    {
+      MPI_File fh;
+      MPI_Offset offset = 0;
+      if ( MPI_File_open( MPI_COMM_WORLD, filename.c_str(), MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL, &fh ) != MPI_SUCCESS )
+        throw std::string( "File " + filename + " could not be opened.\n" );
+      if ( append )
+      {
+        if ( Get_Rank() == 0 ) MPI_File_get_size( fh, &offset );
+        MPI_Bcast( &offset, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD );
+      }
+      else
+        MPI_File_set_size( fh, 0 );
+
+      if ( Get_Rank() == 0 ) MPI_File_write_at( fh, offset, &header, sizeof(generic_header), MPI_BYTE, MPI_STATUS_IGNORE );
+      offset += sizeof(generic_header) + MPI_Offset(m_local_x0)*m_header.nDimY*m_header.nDimZ*sizeof(fftw_complex);
+      MPI_File_write_at_all( fh, offset, data, 2*m_no_of_pts, MPI_DOUBLE, MPI_STATUS_IGNORE );
+      MPI_File_close( &fh );
+      return;
+    }
+    if ( Get_Rank() != 0 ) return;
+#endif
+    std::ofstream file1( filename, append ? std::ofstream::binary | std::ofstream::app : std::ofstream::binary );
+    if ( file1.fail() ) throw std::string( "File " + filename + " could not be opened.\n" );
+    file1.write( reinterpret_cast<const char *>(&header), sizeof(generic_header) );
+    file1.write( reinterpret_cast<const char *>(data), m_no_of_pts*sizeof(fftw_complex) );
+    file1.close();
+  }
+
+  /** Read a field from a binary file written by Write_Field()
+    *
+    * @param filename
+    * @param data Local part of the field
+    */
+  void Read_Field( const std::string &filename, fftw_complex *data )
+  {
+    Phase_Scope timer( ph_io );
+#ifdef TALISES_MPI
+    if ( m_distributed )
+    {
+      MPI_File fh;
+      if ( MPI_File_open( MPI_COMM_WORLD, filename.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh ) != MPI_SUCCESS )
+        throw std::string( "Could not open file " + filename + "\n" );
+      MPI_Offset offset = sizeof(generic_header) + MPI_Offset(m_local_x0)*m_header.nDimY*m_header.nDimZ*sizeof(fftw_complex);
+      MPI_File_read_at_all( fh, offset, data, 2*m_no_of_pts, MPI_DOUBLE, MPI_STATUS_IGNORE );
+      MPI_File_close( &fh );
+      return;
+    }
+#endif
+    std::ifstream in( filename, std::ifstream::binary );
+    if ( !in.is_open() ) throw std::string( "Could not open file " + filename + "\n" );
+    in.seekg( sizeof(generic_header), std::ifstream::beg );
+    in.read( (char *)data, sizeof(fftw_complex)*m_no_of_pts );
+    in.close();
+  }
+
+  /// Exponentials of the kinetic operator along each axis, real and imaginary parts interleaved
+  struct kinetic_table
+  {
+    std::vector<double> full[3];
+    std::vector<double> half[3];
+  };
+
+  /** Fill the kinetic tables of a time step from #m_axis_k
+    *
+    * The exponential of \f$ \Delta t \sum_a \alpha_a (k_a + \delta_{a0} k_x)^2 \f$ factorises into one factor per axis.
+    * @param tab Tables to be filled
+    * @param dt Time step including the sign of the exponent
+    * @param alpha Scaling factors of the kinetic operator for the first dim axes
+    * @param dim Dimensions of the grid
+    * @param kx Wave number added along x
+    * @param norm Factor included in the table of x, e.g. the normalisation of unnormalised transforms
+    */
+  void Fill_Kinetic_Table( kinetic_table &tab, const double dt, const double *alpha, const int dim, const double kx=0, const double norm=1 )
+  {
+    for ( int a=0; a<3; a++ )
+    {
+      const size_t N = m_axis_k[a].size();
+      const double c = ( a < dim ) ? dt*alpha[a] : 0;
+      const double k0 = ( a == 0 ) ? kx : 0;
+      const double f = ( a == 0 ) ? norm : 1;
+      tab.full[a].resize(2*N);
+      tab.half[a].resize(2*N);
+      for ( size_t i=0; i<N; i++ )
+      {
+        const double k = m_axis_k[a][i] + k0;
+        const double phi = c*k*k;
+        tab.half[a][2*i] = f*cos(0.5*phi);
+        tab.half[a][2*i+1] = f*sin(0.5*phi);
+        tab.full[a][2*i] = f*cos(phi);
+        tab.full[a][2*i+1] = f*sin(phi);
+      }
+    }
+  }
+
+  /** Factor of the outer axes of row r of a kinetic table (all axes but the innermost one)
+    *
+    * @param tab Full or half tables of a kinetic_table
+    * @param dim Dimensions of the grid (2 or 3)
+    * @param r Row index
+    * @param fr Real part of the factor
+    * @param fi Imaginary part of the factor
+    */
+  static void Kinetic_Row( const std::vector<double> *tab, const int dim, const long long r, double &fr, double &fi )
+  {
+    const double *Ex = tab[0].data();
+    if ( dim == 3 )
+    {
+      const double *Ey = tab[1].data();
+      const long long NY = tab[1].size()/2;
+      const long long i = r/NY, j = r%NY;
+      fr = Ex[2*i]*Ey[2*j] - Ex[2*i+1]*Ey[2*j+1];
+      fi = Ex[2*i]*Ey[2*j+1] + Ex[2*i+1]*Ey[2*j];
+    }
+    else
+    {
+      fr = Ex[2*r];
+      fi = Ex[2*r+1];
+    }
+  }
+
+  /** Multiply fields in momentum space by the product of the axis factors of a kinetic table
+    *
+    * The factor of the outer axes is formed once per row and the innermost axis is streamed.
+    * @param tab Full or half tables of a kinetic_table
+    * @param dim Dimensions of the grid
+    * @param Psi First field, the fields follow each other without gaps
+    * @param nB Number of fields
+    */
+  static void Apply_Kinetic_Table( const std::vector<double> *tab, const int dim, fftw_complex *Psi, const int nB=1 )
+  {
+    const double *Ein = tab[dim-1].data();
+    const long long NI = tab[dim-1].size()/2;
+    long long rows = 1;
+    for ( int a=0; a<dim-1; a++ )
+      rows *= tab[a].size()/2;
+    double *data = reinterpret_cast<double *>(Psi);
+
+    if ( dim == 1 )
+    {
+      #pragma omp parallel for collapse(2)
+      for ( int b=0; b<nB; b++ )
+      {
+        for ( long long l=0; l<NI; l++ )
+        {
+          double *P = data + 2*(b*NI+l);
+          const double re = P[0], im = P[1];
+          P[0] = re*Ein[2*l] - im*Ein[2*l+1];
+          P[1] = im*Ein[2*l] + re*Ein[2*l+1];
+        }
+      }
+      return;
+    }
+
+    #pragma omp parallel for collapse(2)
+    for ( int b=0; b<nB; b++ )
+    {
+      for ( long long r=0; r<rows; r++ )
+      {
+        double fr, fi;
+        Kinetic_Row( tab, dim, r, fr, fi );
+        double *P = data + 2*((b*rows+r)*NI);
+
+        #pragma omp simd
+        for ( long long l=0; l<NI; l++ )
+        {
+          const double er = fr*Ein[2*l] - fi*Ein[2*l+1];
+          const double ei = fr*Ein[2*l+1] + fi*Ein[2*l];
+          const double re = P[2*l], im = P[2*l+1];
+          P[2*l] = re*er - im*ei;
+          P[2*l+1] = im*er + re*ei;
+        }
+      }
+    }
   }
 
   /// The header of a file is read into this struct
   generic_header m_header;
-  /// Total number of points
+  /// Total number of points (on this process)
   int m_no_of_pts;
+  /// Number of points in fourier space (on this process)
+  int m_no_of_pts_k;
   int m_no_of_pts_red;
   /// Shift of x-axis
   int m_shift_x;
@@ -184,6 +498,14 @@ protected:
   double m_ar;
   /// Volume element in Fourierspace
   double m_ar_k;
+  /// Coordinates of the grid points along each direction (like Get_x of the fields)
+  std::vector<double> m_axis_x[3];
+  /// Wave numbers along each direction in the order of the transformed fields (like Get_k with SetFix(false)), always for the whole grid
+  std::vector<double> m_axis_k[3];
+  /// First index in x direction on this process
+  long long m_local_x0;
+  /// Whether the fields are distributed over several MPI processes
+  bool m_distributed;
   ///Calculates kinetic operator
   virtual void Init()=0;
 };
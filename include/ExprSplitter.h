@@ -0,0 +1,84 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+#include "muParser.h"
+#include <string>
+#include <map>
+#include <vector>
+
+#ifndef __class_ExprSplitter__
+#define __class_ExprSplitter__
+
+/** \file ExprSplitter.h */
+
+/// Variables an expression depends on (bit mask, see ExprSplitter::Classify), scalar parameters count as dep_t
+enum expr_dep { dep_x=1, dep_y=2, dep_z=4, dep_t=8, dep_other=16 };
+
+/** One term of a separated expression
+  *
+  * The term is the product of time, which depends at most on t and constants, and of all position_factors,
+  * which depend at most on x, y and z.
+  */
+struct separated_term
+{
+  std::string time; ///< time factor including the sign of the term
+  std::vector<std::string> position_factors; ///< empty if the term is constant in space
+  int position_dep; ///< union of the dependencies of the position factors
+};
+
+/** Splits muParser expressions into sums of products of position-only and time-only factors
+  *
+  * Products are split at the top level, sums are expanded as far as necessary and the arguments of
+  * cos, sin and exp are separated with the addition theorems, e.g.
+  * \f[
+  *   A \cos(kx + \omega t) = A\cos(\omega t) \cos(kx) - A\sin(\omega t) \sin(kx).
+  * \f]
+  * Expressions which contain factors depending on both position and time (or on psi) are not separable.
+  */
+class ExprSplitter
+{
+public:
+  ExprSplitter( const std::map<std::string,double> &, const std::vector<std::string> & = std::vector<std::string>() );
+
+  bool Separate( const std::string &, std::vector<separated_term> & );
+  int Classify( const std::string & );
+
+protected:
+  /// A signed product of factors
+  struct product
+  {
+    double sign;
+    std::vector<std::string> factors;
+  };
+
+  bool Expand( const std::string &, std::vector<product> & );
+  bool Expand_Factor( const std::string &, std::vector<product> & );
+
+  std::vector<std::pair<double,std::string>> Split_Sum( const std::string & );
+  std::vector<std::string> Split_Product( const std::string & );
+  bool Is_Wrapped( const std::string & );
+  bool Is_Binary_Sign( const std::string &, const size_t );
+
+  /// Parser with all constants defined, used to find the variables of an expression
+  mu::Parser m_parser;
+  /// Upper bound of the number of terms of an expanded expression
+  size_t m_max_terms;
+  /// Variables which are constant in space and are treated like t (e.g. the parameters of an ensemble)
+  std::vector<std::string> m_scalars;
+};
+
+#endif
@@ -28,6 +28,9 @@
 /** \file Parameterhandler.h */
 
 enum freq { none=0, each=1, last=2, packed=3 };
+enum frame { lab=0, comoving=1, trajectory=2 };
+/// Observables of the fused reduction (bit mask, see CRT_Base::Measure())
+enum observable { obs_N=1, obs_x=2, obs_x2=4, obs_p=8, obs_p2=16, obs_coherence=32, obs_E=64 };
 
 /** Contains elements for controlling a sequence */
 struct sequence_item
@@ -97,6 +100,14 @@ public:
   double Get_L();
   double Get_T();
   double Get_M();
+  int Get_Frame();
+  /** Returns the observables listed in OBSERVABLES in the ALGORITHM section of the xml file as a combination of enum observable */
+  int Get_Observables();
+  double Get_Algorithm( const std::string, const double );
+  /** Returns the contact interaction g_ij of the internal states i and j (starting at 1) in the Interactions section of the xml file, g_i_j above 9 states */
+  double Get_Interaction( const int, const int );
+  /** Returns the number of members of the ensemble in the Ensemble section of the xml file (0 without ensemble) */
+  int Get_Ensemble_Size();
 
   int Get_NX();
   int Get_NY();
@@ -107,12 +118,15 @@ public:
 
   void Setup_muParser( mu::Parser& );
   std::map<std::string,double> m_map_constants; ///< xml -> double (for constant scalar values)
+  std::map<std::string,std::vector<double>> m_map_ensemble; ///< xml -> double (values of a parameter for each member of the ensemble)
   std::vector<sequence_item> m_sequence; ///< vector of sequence_items ( Elements of the sequence )
   std::vector<analyze_item> m_analyze; ///< vector of analyze_items (for ana_tools)
 protected:
   void populate_constants(); ///< Read constant values from xml and populate m_map_constants
   void populate_vconstants(); ///< Read vconstants values from xml and populate m_map_vconstants
   void populate_algorithm(); ///< Read functions and save in m_map_algorithm
+  void populate_interactions(); ///< Read contact interactions from xml and populate m_map_interactions
+  void populate_ensemble(); ///< Read the parameters of the ensemble from xml and populate m_map_ensemble
   void populate_simulation(); ///< populate m_map_simulation
   void populate_sequence(); ///< Read from sequence node and save in m_sequence
   void populate_analyze();
@@ -120,6 +134,9 @@ protected:
   pugi::xml_document m_xml_doc; ///< load document here
   std::map<std::string,int> m_map_ai_type;
   std::map<std::string,int> m_map_freq; ///< xml -> int (options none, each and last e.g. for the frequency of computing particle numbers)
+  std::map<std::string,int> m_map_frame; ///< xml -> int (options lab, comoving and trajectory for the frame of reference)
+  std::map<std::string,int> m_map_observables; ///< xml -> int (options N, x, x2, p, p2, coherence and E for the observables)
+  std::map<std::string,double> m_map_interactions; ///< xml -> double (g_ij of the contact interactions)
   std::map<std::string,std::vector<double>> m_map_vconstants; ///< xml -> double (for constant vectors)
   std::map<std::string,std::string> m_map_algorithm; ///< xml -> string (function)
   std::map<std::string,std::string> m_map_simulation;
@@ -0,0 +1,66 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#ifndef CFT_2D_MPI_H
+#define CFT_2D_MPI_H
+
+#ifdef TALISES_MPI
+
+#include "cft_base.h"
+#include "fftw3-mpi.h"
+
+namespace Fourier
+{
+  /** Class for Fourier transform in 2 dimensions with complex valued data distributed along x over all MPI processes
+    *
+    * Each process holds a slab of local_n0 points in x-direction. The transforms are done with fftw-mpi plans
+    * with transposed output, i.e. in fourier space the process holds a slab of local_n1 points in y-direction
+    * and the data is ordered with y as the slowest index followed by x.
+    * Only in-place transforms with SetFix(false) are supported.
+    */
+  class cft_2d_mpi : public cft_base<2>
+  {
+  public:
+    cft_2d_mpi( const generic_header&, bool=true, bool=false );
+
+    void ft( int isign ); // -1 (forward) oder +1 (backward)
+
+    CPoint<2> Get_k(const int64_t) final;
+    CPoint<2> Get_x(const int64_t) final;
+  protected:
+    /// Local part of the grid as returned by fftw_mpi_local_size_2d_transposed
+    struct layout
+    {
+      ptrdiff_t alloc;
+      ptrdiff_t local_n0;
+      ptrdiff_t local_0_start;
+      ptrdiff_t local_n1;
+      ptrdiff_t local_1_start;
+    };
+
+    static layout Local_Size( const generic_header& );
+    cft_2d_mpi( const generic_header&, const layout& );
+
+    void scale( fftw_complex* data, const int64_t n, const double fak );
+
+    int m_local_ny; /// Number of sampling points in y-direction on this process (fourier space)
+    int64_t m_local_y0; /// First index in y-direction on this process (fourier space)
+  };
+}
+#endif
+#endif
@@ -21,8 +21,11 @@
 #include <cstring>
 #include "fftw3.h"
 #include <cmath>
+#include <vector>
 #include "CPoint.h"
 #include "my_structs.h"
+#include "field_alloc.h"
+#include "phase_timer.h"
 
 #pragma once
 
@@ -49,40 +52,60 @@ namespace Fourier
       }
 
       Setup(header);
+      m_diff_work = nullptr;
 
       if ( m_type == Fourier::TYPE::COMPLEX )
       {
         if( b )
         {
           m_in_real = nullptr;
-          m_in  = fftw_alloc_complex( m_dim );
-          assert(m_in != nullptr);
+          m_in  = Alloc_Complex( m_dim );
           m_out = m_in;
-          std::memset( m_in, 0, m_dim*sizeof(fftw_complex));
         }
         else
         {
           m_in_real = nullptr;
-          m_in  = fftw_alloc_complex( m_dim );
-          assert(m_in != nullptr);
-          m_out = fftw_alloc_complex( m_dim );
-          assert(m_out != nullptr);
-          std::memset( m_in, 0, m_dim*sizeof(fftw_complex));
-          std::memset( m_out, 0, m_dim*sizeof(fftw_complex));
+          m_in  = Alloc_Complex( m_dim );
+          m_out = Alloc_Complex( m_dim );
         }
       }
       else
       {
-          m_in_real = fftw_alloc_real( m_dim );;
-          assert(m_in_real != nullptr);
+          m_in_real = Alloc_Real( m_dim );
           m_in  = nullptr;
-          m_out = fftw_alloc_complex( m_dim_fs );
-          assert(m_out != nullptr);
-          std::memset( m_in_real, 0, m_dim*sizeof(double));
-          std::memset( m_out, 0, m_dim_fs*sizeof(fftw_complex));
+          m_out = Alloc_Complex( m_dim_fs );
       }
     }
 
+    /**
+    * \brief Constructor of cft_base for in-place complex data distributed along x (see cft_2d_mpi, cft_3d_mpi)
+    *
+    * @param header Header information of the whole grid
+    * @param alloc Number of complex values to allocate on this process
+    * @param local_nx Number of points in x-direction on this process
+    * @param local_x0 First index in x-direction on this process
+    * @param dim_fs Number of points in fourier space on this process
+    */
+    cft_base( const generic_header& header, const int64_t alloc, const int local_nx, const int64_t local_x0, const int64_t dim_fs ) : m_bInplace(true), m_bfix(false), m_type(Fourier::TYPE::COMPLEX)
+    {
+      if( header.nDims != dim )
+      {
+        std::cerr << "Critical error: header.nDims does not match template parameter dim" << std::endl;
+        throw;
+      }
+
+      Setup(header);
+      m_local_nx = local_nx;
+      m_local_x0 = local_x0;
+      m_dim      = int64_t(local_nx)*m_dim_y*m_dim_z;
+      m_dim_fs   = dim_fs;
+
+      m_in_real = nullptr;
+      m_in  = Alloc_Complex( alloc );
+      m_out = m_in;
+      m_diff_work = nullptr;
+    }
+
     /**
     * \brief Deconstructor of cft_base
     */
@@ -90,23 +113,30 @@ namespace Fourier
     {
       fftw_destroy_plan( m_forwardPlan );
       fftw_destroy_plan( m_backwardPlan );
+      if ( m_diff_work != nullptr )
+      {
+        fftw_destroy_plan( m_diff_forward );
+        fftw_destroy_plan( m_diff_backward );
+        Free_Buffer( m_diff_work );
+      }
+      if ( m_diff_scratch != nullptr ) Free_Buffer( m_diff_scratch );
 
       if ( m_type == Fourier::TYPE::COMPLEX )
       {
         if( !m_bInplace )
         {
-          fftw_free( m_in );
-          fftw_free( m_out );
+          Free_Buffer( m_in );
+          Free_Buffer( m_out );
         }
         else
         {
-          fftw_free( m_in );
+          Free_Buffer( m_in );
         }
       }
       else
       {
-        fftw_free( m_in_real );
-        fftw_free( m_out );
+        Free_Buffer( m_in_real );
+        Free_Buffer( m_out );
       }
     }
 
@@ -177,6 +207,70 @@ namespace Fourier
     int64_t Get_red_Dim() { return m_red_dim; };
     int64_t Get_Dim_RS() { return m_dim; }; /// total number of sampling points in real space
     int64_t Get_Dim_FS() { return m_dim_fs; }; /// total number of sampling points in fourier space
+    int Get_Local_Dim_X() { return m_local_nx; }; /// number of sampling points in x-dimension on this process
+    int64_t Get_Local_Start_X() { return m_local_x0; }; /// first index in x-dimension on this process
+
+    /**
+    * \brief Derivatives of the complex data in m_in with a single forward transform
+    *
+    * The data is transformed once into a work buffer, then the requested derivatives are formed in fourier space
+    * with the k values of each axis and transformed back into the buffers of the caller. m_in is not changed,
+    * hence m_in may also be one of the output buffers if no current is requested. Output buffers have to be
+    * allocated with Alloc_Complex() or fftw_malloc(). Not available for fields distributed over MPI processes.
+    *
+    * @param axes Axes to differentiate along, combination of 1 (x), 2 (y) and 4 (z)
+    * @param grad First derivative along each axis in axes (array of dim buffers, nullptr entries are skipped), may be nullptr
+    * @param laplace Sum of the second derivatives along the axes in axes, may be nullptr
+    * @param current Probability current Im(conj(psi) d_a psi) along each axis in axes (array of dim real buffers, nullptr entries are skipped), may be nullptr
+    */
+    void Derivatives( const int axes, fftw_complex * const *grad, fftw_complex *laplace, double * const *current )
+    {
+      if ( m_type != Fourier::TYPE::COMPLEX || m_local_nx != m_dim_x ) throw std::string("Error in " + std::string(__func__) + ": only for complex fields which are not distributed\n");
+
+      if ( m_diff_work == nullptr )
+      {
+        const int n[3] = { m_dim_x, m_dim_y, m_dim_z };
+        m_diff_work = Alloc_Complex( m_dim );
+        m_diff_forward = fftw_plan_dft( dim, n, m_diff_work, m_diff_work, FFTW_FORWARD, FFTW_ESTIMATE );
+        m_diff_backward = fftw_plan_dft( dim, n, m_diff_work, m_diff_work, FFTW_BACKWARD, FFTW_ESTIMATE );
+      }
+
+      fftw_complex * const in = m_in;
+      fftw_complex * const work = m_diff_work;
+      #pragma omp parallel for schedule(static)
+      for ( int64_t l=0; l<m_dim; l++ )
+      {
+        work[l][0] = in[l][0];
+        work[l][1] = in[l][1];
+      }
+      fftw_execute( m_diff_forward );
+
+      // the two transforms scale by 1/N in total
+      const double fak = 1.0/double(m_dim);
+
+      for ( int a=0; a<dim; a++ )
+      {
+        if ( !(axes & (1<<a)) ) continue;
+        fftw_complex *out = ( grad != nullptr ) ? grad[a] : nullptr;
+        if ( out == nullptr && current != nullptr && current[a] != nullptr ) out = Derivative_Buffer();
+        if ( out == nullptr ) continue;
+
+        Multiply_k( out, a, fak );
+        fftw_execute_dft( m_diff_backward, out, out );
+
+        if ( current == nullptr || current[a] == nullptr ) continue;
+        double * const j = current[a];
+        #pragma omp parallel for schedule(static)
+        for ( int64_t l=0; l<m_dim; l++ )
+          j[l] = in[l][0]*out[l][1] - in[l][1]*out[l][0];
+      }
+
+      if ( laplace != nullptr )
+      {
+        Multiply_k( laplace, -axes, fak );
+        fftw_execute_dft( m_diff_backward, laplace, laplace );
+      }
+    }
   protected:
 
     int m_dim_x; /// Number of sampling points in x-dimension
@@ -188,6 +282,8 @@ namespace Fourier
     int64_t m_red_dim;
     int64_t m_dim; /// Product of sampling points in real space for each spatial direction
     int64_t m_dim_fs; /// Product of sampling points in fourier space for each spatial direction
+    int m_local_nx; /// Number of sampling points in x-dimension on this process
+    int64_t m_local_x0; /// First index in x-dimension on this process
     int m_isign; /// Last Transformation direction
 
     bool m_bInplace; /// Whether inplace transformation is performed
@@ -208,6 +304,71 @@ namespace Fourier
     fftw_plan m_forwardPlan; /// Plan for forward transformation
     fftw_plan m_backwardPlan; /// Plan for backward transformation
 
+    std::vector<double> m_k_axis[3]; /// k values of each axis in the natural order of FFTW
+    fftw_complex * m_diff_work; /// Spectrum of m_in for Derivatives(), allocated on first use
+    fftw_complex * m_diff_scratch; /// Gradient needed for a current which the caller did not request, allocated on first use
+    fftw_plan m_diff_forward; /// In-place forward plan on m_diff_work
+    fftw_plan m_diff_backward; /// In-place backward plan with the alignment of m_diff_work, executed on the output buffers
+
+    /**
+    * \brief Returns a buffer for a gradient which is only needed for the current
+    *
+    * The buffer is kept until the field is destroyed, since buffers of the solver arena are never given back.
+    */
+    fftw_complex * Derivative_Buffer()
+    {
+      if ( m_diff_scratch == nullptr ) m_diff_scratch = Alloc_Complex( m_dim );
+      return m_diff_scratch;
+    }
+
+    /**
+    * \brief Writes the spectrum in m_diff_work times a derivative operator to out
+    *
+    * @param out Output buffer
+    * @param op Axis a for the factor i*k_a, or -axes for the factor -(sum of k_a^2 over the axes in axes)
+    * @param fak Additional real factor
+    */
+    void Multiply_k( fftw_complex *out, const int op, const double fak )
+    {
+      const fftw_complex * const work = m_diff_work;
+      const double *kx = m_k_axis[0].data(), *ky = m_k_axis[1].data(), *kz = m_k_axis[2].data();
+      const int64_t NX = m_dim_x, NY = m_dim_y, NZ = m_dim_z;
+      const double wx = ( op < 0 && ((-op) & 1) ) ? 1 : 0;
+      const double wy = ( op < 0 && ((-op) & 2) ) ? 1 : 0;
+      const double wz = ( op < 0 && ((-op) & 4) ) ? 1 : 0;
+
+      #pragma omp parallel for collapse(2) schedule(static)
+      for ( int64_t i=0; i<NX; i++ )
+      {
+        for ( int64_t j=0; j<NY; j++ )
+        {
+          const int64_t row = (i*NY+j)*NZ;
+          if ( op >= 0 )
+          {
+            // i k_a
+            for ( int64_t k=0; k<NZ; k++ )
+            {
+              const double ka = fak*( op == 0 ? kx[i] : ( op == 1 ? ky[j] : kz[k] ) );
+              const double re = work[row+k][0];
+              out[row+k][0] = -ka*work[row+k][1];
+              out[row+k][1] = ka*re;
+            }
+          }
+          else
+          {
+            // -sum k_a^2
+            const double kxy = wx*kx[i]*kx[i] + wy*ky[j]*ky[j];
+            for ( int64_t k=0; k<NZ; k++ )
+            {
+              const double f = -fak*(kxy + wz*kz[k]*kz[k]);
+              out[row+k][0] = f*work[row+k][0];
+              out[row+k][1] = f*work[row+k][1];
+            }
+          }
+        }
+      }
+    }
+
     generic_header m_header;
   private:
     /**
@@ -234,6 +395,20 @@ namespace Fourier
       m_dkz      = header.dkz;
       m_dim_fs   = m_dim;
       m_red_dim  = 0;
+      m_local_nx = m_dim_x;
+      m_local_x0 = 0;
+      m_diff_scratch = nullptr;
+
+      const int n[3] = { m_dim_x, m_dim_y, m_dim_z };
+      const int shift[3] = { m_shift_x, m_shift_y, m_shift_z };
+      const double dk[3] = { m_dkx, m_dky, m_dkz };
+      for ( int a=0; a<3; a++ )
+      {
+        m_k_axis[a].assign( n[a], 0.0 );
+        if ( a >= dim ) continue;
+        for ( int i=0; i<n[a]; i++ )
+          m_k_axis[a][i] = dk[a]*double((i+shift[a])%n[a]-shift[a]);
+      }
 
       assert( m_dim_x > 0 );
       assert( m_dim_y >= 0 );
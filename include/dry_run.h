@@ -0,0 +1,35 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#ifndef DRY_RUN_H
+#define DRY_RUN_H
+
+#include "ParameterHandler.h"
+
+/** \file dry_run.h
+  *
+  * Estimates the memory and the run time of a simulation without propagating anything (talises --dry-run).
+  *
+  * Only the header of the initial file is read. The Hamiltonian of each sequence is classified by the variables
+  * it uses, the number of transforms, Hamiltonian evaluations and matrix exponentials is counted and converted
+  * to a run time with short calibration runs of the kernels on this machine and with the current number of threads.
+  */
+
+void Dry_Run( ParameterHandler &, const int, const int );
+
+#endif
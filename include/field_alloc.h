@@ -0,0 +1,119 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#ifndef FIELD_ALLOC_H
+#define FIELD_ALLOC_H
+
+#include <string>
+#include <cstdint>
+#include <vector>
+#include <new>
+#include "fftw3.h"
+
+/** \file field_alloc.h
+  *
+  * Allocation of fields and tables with regard to NUMA nodes.
+  *
+  * Linux places a page on the NUMA node of the thread which touches it first. All buffers are therefore zeroed by
+  * the OpenMP threads with the static partitioning of the kernels (loops over the points with
+  * <tt>#pragma omp for</tt>), so that every thread finds its part of the data on its own node.
+  *
+  * If the solver arena is reserved (see Arena), the buffers are taken from one large mapping which is backed by
+  * huge pages where available.
+  */
+
+/// Regions of the solver arena
+enum arena_region { arena_persistent=0, arena_scratch=1 };
+
+/** One mapping for the whole working set of the solver
+  *
+  * The arena is split into a persistent region (fields, kinetic operators, potentials) and a scratch region for
+  * buffers which are only needed during a sequence (evaluated Hamiltonians, tables of position factors). Both
+  * are bump allocators with 64 byte alignment, buffers are never freed individually and the scratch region is
+  * reset at the start of each sequence. Requests which do not fit are served from the heap. The arena is
+  * not thread safe, buffers are allocated outside of parallel regions only.
+  */
+class Arena
+{
+public:
+  Arena();
+  ~Arena();
+
+  void Reserve( const size_t, const size_t, const int );
+  void *Allocate( const size_t, const int );
+  void Reset_Scratch();
+
+  /// Whether ptr points into the arena
+  bool Contains( const void *ptr ) const
+  {
+    return m_base != nullptr && ptr >= m_base && ptr < m_base+m_size;
+  };
+
+protected:
+  char *m_base;
+  size_t m_size;
+  /// Start, end and next free byte of each region (offsets into the mapping)
+  size_t m_begin[2];
+  size_t m_end[2];
+  size_t m_next[2];
+  /// Whether a request did not fit into a region
+  bool m_overflow[2];
+};
+
+Arena &Solver_Arena();
+size_t Available_Memory();
+void Free_Buffer( void * );
+
+/** STL allocator which takes memory from a region of the solver arena
+  *
+  * Falls back to the heap if the arena is not reserved or full.
+  */
+template <class T, int region=arena_persistent>
+struct arena_allocator
+{
+  typedef T value_type;
+  template <class U> struct rebind { typedef arena_allocator<U,region> other; };
+
+  arena_allocator() {};
+  template <class U> arena_allocator( const arena_allocator<U,region> & ) {};
+
+  T *allocate( const size_t n )
+  {
+    void *ptr = Solver_Arena().Allocate( n*sizeof(T), region );
+    if ( ptr == nullptr ) ptr = ::operator new( n*sizeof(T) );
+    return static_cast<T *>(ptr);
+  };
+  void deallocate( T *ptr, const size_t )
+  {
+    if ( !Solver_Arena().Contains(ptr) ) ::operator delete(ptr);
+  };
+};
+
+template <class T, class U, int region> bool operator==( const arena_allocator<T,region> &, const arena_allocator<U,region> & ) { return true; }
+template <class T, class U, int region> bool operator!=( const arena_allocator<T,region> &, const arena_allocator<U,region> & ) { return false; }
+
+/// std::vector in a region of the solver arena
+template <class T, int region=arena_persistent> using arena_vector = std::vector<T,arena_allocator<T,region>>;
+
+fftw_complex *Alloc_Complex( const int64_t );
+double *Alloc_Real( const int64_t );
+void First_Touch( void *, const size_t );
+bool Set_Thread_Affinity( const std::string & );
+void Report_Pages( const std::string &, const void *, const size_t );
+
+#endif
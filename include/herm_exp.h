@@ -0,0 +1,98 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#ifndef HERM_EXP_H
+#define HERM_EXP_H
+
+#include <vector>
+#include <string>
+#include "fftw3.h"
+
+/** \file herm_exp.h
+  *
+  * Exponentials of many small Hermitian matrices with the cyclic Jacobi method.
+  *
+  * The matrices of herm_block grid points are diagonalised together. Their elements are stored point-minor
+  * (element e of point b at e*herm_block+b), so every Jacobi rotation is applied to all points of the block in
+  * one vectorisable loop. This is used for Hamiltonians with a number of internal states which is only known
+  * at runtime, where the per point calls of gsl_eigen_hermv dominate the interaction step.
+  */
+
+/// Number of points whose matrices are diagonalised together
+const int herm_block = 8;
+/// Number of points multiplied at once by Apply_Matrix()
+const int herm_apply = 256;
+
+/** Workspace of Exp_Hermitian() for one thread
+  *
+  * re and im hold the matrices of a block, the element (i,j) of point b at (i*n+j)*herm_block+b.
+  */
+struct herm_workspace
+{
+  herm_workspace( const int );
+
+  void Set_Zero();
+  void Set( const int, const int, const int, const double, const double );
+
+  int n; ///< size of the matrices
+  std::vector<double> re; ///< real parts of the matrices, on return of the exponentials
+  std::vector<double> im; ///< imaginary parts of the matrices, on return of the exponentials
+  std::vector<double> vre; ///< eigenvectors (real parts)
+  std::vector<double> vim; ///< eigenvectors (imaginary parts)
+};
+
+void Exp_Hermitian( herm_workspace &, const int, const double );
+void Apply_Matrix( const herm_workspace &, fftw_complex * const *, const int, const int, const int, std::vector<double> & );
+
+/// Coupling of the states i and j, e is the index of H_ij in the upper triangle of the Hamiltonian
+struct coupling
+{
+  int i;
+  int j;
+  int e;
+};
+
+/** Coupling graph of a Hamiltonian given as the upper triangle of a matrix of expressions
+  *
+  * Off-diagonal elements whose real and imaginary parts are literal zeros do not couple two states. The states
+  * split into blocks (connected components of the graph) which are propagated independently: single states
+  * with a phase, pairs with the exact 2x2 exponential and larger blocks with Exp_Hermitian() of the block only.
+  * With pairwise set, blocks of more than two states are propagated with the symmetric product
+  * \f[
+  *   e^{i\,dt\,H} \approx e^{i\frac{dt}{2} H_1} \cdots e^{i\frac{dt}{2} H_E} e^{i\,dt\,D} e^{i\frac{dt}{2} H_E} \cdots e^{i\frac{dt}{2} H_1}
+  * \f]
+  * of exact exponentials of the single couplings \f$ H_e \f$ and of the diagonal \f$ D \f$ instead, which is
+  * of second order in dt like the splitting of the kinetic part. The cost then grows with the number of couplings.
+  */
+struct coupling_graph
+{
+  coupling_graph() : n(0), sparse(false), pairwise(false) {};
+
+  bool Setup( const std::vector<std::string> &, const std::vector<std::string> &, const int, const bool );
+  std::vector<herm_workspace> Workspaces() const;
+  void Propagate( fftw_complex * const *, const int, const int, const int, const double *, const int, const double *, const double, std::vector<herm_workspace> & ) const;
+
+  int n; ///< number of states
+  bool sparse; ///< true if the graph has more than one block or pairwise applies, else the dense exponential is cheaper
+  bool pairwise; ///< blocks of more than two states are propagated with the product of the single couplings
+  std::vector<int> diag; ///< index of H_ii in the upper triangle
+  std::vector<std::vector<int>> blocks; ///< states of each block in ascending order
+  std::vector<std::vector<coupling>> couplings; ///< couplings within each block
+};
+
+#endif
@@ -25,6 +25,14 @@
 
 typedef double (*TEF)(const double, const double);
 
+/// Slots of generic_header::nFuture and generic_header::dFuture used by the co-moving frame
+#define HDR_FRAME_MODE 0   // nFuture: frame the data is stored in (see enum frame)
+#define HDR_ENSEMBLE_MEMBER 1 // nFuture: member of the ensemble starting at 1 (0 outside of ensembles)
+#define HDR_FRAME_X 0      // dFuture[0..2]: lab position of the grid origin
+#define HDR_FRAME_K 3      // dFuture[3..5]: wave number removed by the Galilean boost
+#define HDR_FRAME_PHASE 6  // dFuture[6]: accumulated global Galilean phase
+#define HDR_LATTICE_K 7    // dFuture[7]: wave number of the momentum order (lattice engine)
+
 #pragma pack(push)
 #pragma pack(4)
 struct generic_header
@@ -0,0 +1,182 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#ifndef PHASE_TIMER_H
+#define PHASE_TIMER_H
+
+#include <omp.h>
+#include <string>
+#include <vector>
+#include <ostream>
+
+/** \file phase_timer.h
+  *
+  * Wall time and call counts of the phases of a run, per sequence and per thread.
+  *
+  * A Phase_Scope measures the time until it is destroyed. Scopes nest within a thread and the time of an inner
+  * scope is not counted for the outer one, so the phases add up to the measured time. Scopes are placed in
+  * serial code around whole kernels and inside parallel regions around the work of each thread (e.g. the loop
+  * over the points without its barrier), where the spread between the threads shows load imbalance.
+  *
+  * Optionally the hardware counters of each thread (cycles, instructions, last level cache references and
+  * misses) are read with perf_event_open at the start and end of each scope (see Enable_Counters()). Scopes in
+  * serial code count all threads of the team, scopes inside parallel regions their own thread. The memory
+  * traffic is estimated from the cache misses (one line per miss).
+  */
+
+/// Phases of the solver
+enum phase { ph_fft=0, ph_fix, ph_kinetic, ph_potential, ph_exp, ph_nonlinear, ph_observables, ph_io, ph_count };
+/// Hardware counters
+enum counter { pc_cycles=0, pc_instructions, pc_cache_refs, pc_cache_misses, pc_count };
+
+/** Accumulated timings of all phases, see Solver_Timers()
+  */
+class Phase_Timers
+{
+public:
+  Phase_Timers();
+
+  ~Phase_Timers();
+
+  void Enable( const bool, const bool );
+  bool Enable_Counters();
+  void Begin_Sequence( const std::string & );
+  void Add( const int, const double, const double, const double, const long long * );
+  void Read_Counters( long long *, const bool ) const;
+
+  void Report( std::ostream & ) const;
+  void Write_JSON( const std::string & ) const;
+  void Write_Trace( const std::string & ) const;
+
+  /// Whether the phases are timed
+  bool enabled;
+  /// Whether every call is recorded for the trace
+  bool tracing;
+  /// Whether the hardware counters are read
+  bool counting;
+
+protected:
+  /// Time and number of calls of one phase
+  struct entry
+  {
+    double seconds;
+    long long calls;
+    long long counts[pc_count];
+  };
+  /// One call for the trace
+  struct event
+  {
+    int phase;
+    int sequence;
+    double start;
+    double end;
+  };
+
+  /// Names of the sequences, the first one collects everything before the first sequence
+  std::vector<std::string> m_sequences;
+  /// Timings of sequence s, phase p and thread t at [s][p*m_threads+t]
+  std::vector<std::vector<entry>> m_data;
+  /// Calls of each thread for the trace
+  std::vector<std::vector<event>> m_events;
+  /// Group leaders of the counters of each thread (-1 if not open)
+  std::vector<int> m_fds;
+  int m_threads;
+  double m_t0;
+};
+
+Phase_Timers &Solver_Timers();
+
+/** Times the enclosing block as one call of a phase
+  */
+class Phase_Scope
+{
+public:
+  Phase_Scope( const int ph ) : m_phase(ph), m_elapsed(0), m_parent(nullptr)
+  {
+    Phase_Timers &timers = Solver_Timers();
+    if ( !timers.enabled ) return;
+    m_parent = current();
+    m_counting = timers.counting;
+    m_all = !omp_in_parallel();
+    if ( m_counting ) Pause_Counters( timers );
+    m_start = m_begin = omp_get_wtime();
+    if ( m_parent != nullptr ) m_parent->m_elapsed += m_start - m_parent->m_start;
+    current() = this;
+  };
+
+  ~Phase_Scope()
+  {
+    Phase_Timers &timers = Solver_Timers();
+    if ( !timers.enabled || current() != this ) return;
+    const double now = omp_get_wtime();
+    m_elapsed += now - m_start;
+    if ( m_counting ) Resume_Counters( timers );
+    timers.Add( m_phase, m_elapsed, m_begin, now, m_counting ? m_counts : nullptr );
+    current() = m_parent;
+    if ( m_parent != nullptr ) m_parent->m_start = now;
+  };
+
+protected:
+  /// Innermost active scope of the calling thread
+  static Phase_Scope *&current()
+  {
+    static thread_local Phase_Scope *ptr = nullptr;
+    return ptr;
+  };
+
+  /// Starts the counters of this scope and stops the ones of the parent
+  void Pause_Counters( const Phase_Timers &timers )
+  {
+    long long now[pc_count];
+    if ( m_parent != nullptr && m_parent->m_counting )
+    {
+      timers.Read_Counters( now, m_parent->m_all );
+      for ( int c=0; c<pc_count; c++ )
+        m_parent->m_counts[c] += now[c];
+    }
+    timers.Read_Counters( now, m_all );
+    for ( int c=0; c<pc_count; c++ )
+      m_counts[c] = -now[c];
+  };
+
+  /// Stops the counters of this scope and restarts the ones of the parent
+  void Resume_Counters( const Phase_Timers &timers )
+  {
+    long long now[pc_count];
+    timers.Read_Counters( now, m_all );
+    for ( int c=0; c<pc_count; c++ )
+      m_counts[c] += now[c];
+    if ( m_parent != nullptr && m_parent->m_counting )
+    {
+      timers.Read_Counters( now, m_parent->m_all );
+      for ( int c=0; c<pc_count; c++ )
+        m_parent->m_counts[c] -= now[c];
+    }
+  };
+
+  int m_phase;
+  double m_start; ///< start of the part which is not covered by inner scopes
+  double m_begin; ///< start of the scope
+  double m_elapsed; ///< time without inner scopes
+  long long m_counts[pc_count]; ///< counts without inner scopes
+  bool m_counting;
+  bool m_all; ///< count all threads
+  Phase_Scope *m_parent;
+};
+
+#endif
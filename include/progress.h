@@ -0,0 +1,101 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <string>
+#include <vector>
+#include <fstream>
+
+/** \file progress.h
+  *
+  * Progress of the run reported by a thread of its own, see Solver_Progress().
+  *
+  * The time loops only count their steps with Step(), which updates two atomics. The reporter wakes up every
+  * interval seconds and prints the sequence, the simulated time, the steps and grid points per second, the
+  * estimated time left and the resident memory. The same records are appended as JSON lines to progress.jsonl.
+  * Without a reporter (PROGRESS=0 in section ALGORITHM) Step() prints the classic "t = " lines instead.
+  */
+
+/** Reports the progress of the time loops
+  */
+class Progress_Reporter
+{
+public:
+  Progress_Reporter();
+  ~Progress_Reporter();
+
+  void Start( const double, const std::string & );
+  void Stop();
+  void Begin_Sequence( const std::string &, const int, const long long, const double, const double );
+  void End_Sequence();
+  void Post( const std::string & );
+
+  /** Counts steps of the current sequence, the only call in the time loops
+    *
+    * @param n Number of time steps done since the last call
+    * @param t Simulated time after the steps
+    */
+  void Step( const long long n, const double t )
+  {
+    m_time.store( t, std::memory_order_relaxed );
+    m_steps.fetch_add( n, std::memory_order_relaxed );
+    if ( !m_running ) Print_Time( t );
+  };
+
+protected:
+  void Run();
+  void Report( const bool );
+  void Print_Time( const double );
+  void Drain();
+
+  /// Steps of the current sequence
+  std::atomic<long long> m_steps;
+  /// Simulated time (in units of the solver)
+  std::atomic<double> m_time;
+
+  /// Guards everything below
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::thread m_thread;
+  bool m_running;
+  bool m_stop;
+  double m_interval;
+  std::ofstream m_json;
+
+  /// Lines posted to be printed by the reporter
+  std::vector<std::string> m_messages;
+
+  std::string m_sequence;
+  int m_sequence_no;
+  long long m_total_steps;
+  double m_points;
+  double m_seq_start;
+  double m_t0;
+  long long m_last_steps;
+  double m_last_report;
+};
+
+Progress_Reporter &Solver_Progress();
+
+#endif
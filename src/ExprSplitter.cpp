@@ -0,0 +1,302 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#include "ExprSplitter.h"
+#include <cctype>
+#include <cmath>
+#include <algorithm>
+
+/** Constructor
+  *
+  * @param constants Constants of the expressions
+  * @param scalars Further variables which are constant in space, their factors are separated like time factors
+  */
+ExprSplitter::ExprSplitter( const std::map<std::string,double> &constants, const std::vector<std::string> &scalars )
+{
+  m_max_terms = 64;
+  m_scalars = scalars;
+
+  for ( auto it : constants )
+    m_parser.DefineConst( it.first, it.second );
+  m_parser.DefineConst( "pi", (double)M_PI );
+  m_parser.DefineConst( "e", (double)M_E );
+}
+
+/** Returns the variables an expression depends on as a combination of expr_dep
+  *
+  * Unknown variables (e.g. psi_1_real) and invalid expressions give dep_other.
+  */
+int ExprSplitter::Classify( const std::string &expr )
+{
+  int retval = 0;
+  try
+  {
+    m_parser.SetExpr(expr);
+    for ( auto item : m_parser.GetUsedVar() )
+    {
+      if ( item.first == "x" ) retval |= dep_x;
+      else if ( item.first == "y" ) retval |= dep_y;
+      else if ( item.first == "z" ) retval |= dep_z;
+      else if ( item.first == "t" ) retval |= dep_t;
+      else if ( std::find( m_scalars.begin(), m_scalars.end(), item.first ) != m_scalars.end() ) retval |= dep_t;
+      else retval |= dep_other;
+    }
+  }
+  catch ( mu::Parser::exception_type &e )
+  {
+    retval = dep_other;
+  }
+  return retval;
+}
+
+/** Splits an expression into a sum of products of time factors and position factors
+  *
+  * @param expr muParser expression
+  * @param terms The separated terms, only valid if true is returned
+  * @return true if expr is separable
+  */
+bool ExprSplitter::Separate( const std::string &expr, std::vector<separated_term> &terms )
+{
+  std::string str = expr;
+  str.erase( std::remove_if( str.begin(), str.end(), ::isspace ), str.end() );
+
+  terms.clear();
+  if ( str.empty() || str.find_first_of("<>=!?&|") != std::string::npos ) return false;
+
+  std::vector<product> prods;
+  if ( !Expand( str, prods ) ) return false;
+
+  for ( auto p : prods )
+  {
+    separated_term term;
+    term.time = ( p.sign < 0 ) ? "(-1)" : "1";
+    term.position_dep = 0;
+
+    for ( auto f : p.factors )
+    {
+      int dep = Classify(f);
+      if ( dep & dep_other ) return false;
+      if ( dep & (dep_x|dep_y|dep_z) )
+      {
+        if ( dep & dep_t ) return false;
+        term.position_factors.push_back(f);
+        term.position_dep |= dep;
+      }
+      else
+        term.time += "*(" + f + ")";
+    }
+    terms.push_back(term);
+  }
+  return true;
+}
+
+/** Expands an expression into products which do not contain factors depending on both position and time
+  */
+bool ExprSplitter::Expand( const std::string &expr, std::vector<product> &out )
+{
+  for ( auto term : Split_Sum(expr) )
+  {
+    std::vector<product> prods(1);
+    prods[0].sign = term.first;
+
+    for ( auto f : Split_Product(term.second) )
+    {
+      int dep = Classify(f);
+      if ( dep & dep_other ) return false;
+
+      if ( (dep & (dep_x|dep_y|dep_z)) && (dep & dep_t) )
+      {
+        std::vector<product> sub, next;
+        if ( !Expand_Factor( f, sub ) ) return false;
+
+        for ( auto p : prods )
+        {
+          for ( auto q : sub )
+          {
+            product r = p;
+            r.sign *= q.sign;
+            r.factors.insert( r.factors.end(), q.factors.begin(), q.factors.end() );
+            next.push_back(r);
+          }
+        }
+        prods = next;
+        if ( prods.size() > m_max_terms ) return false;
+      }
+      else
+      {
+        for ( auto &p : prods )
+          p.factors.push_back(f);
+      }
+    }
+    out.insert( out.end(), prods.begin(), prods.end() );
+    if ( out.size() > m_max_terms ) return false;
+  }
+  return true;
+}
+
+/** Expands a single factor depending on both position and time
+  *
+  * Supported are parenthesised sums and cos, sin and exp of sums of position and time terms.
+  */
+bool ExprSplitter::Expand_Factor( const std::string &f, std::vector<product> &out )
+{
+  if ( f.empty() ) return false;
+
+  if ( f[0] == '+' || f[0] == '-' )
+  {
+    // -a^b is left to muParser, the precedence of the unary minus is version dependent
+    int depth = 0;
+    for ( auto c : f )
+    {
+      if ( c == '(' ) depth++;
+      if ( c == ')' ) depth--;
+      if ( c == '^' && depth == 0 ) return false;
+    }
+    if ( !Expand_Factor( f.substr(1), out ) ) return false;
+    if ( f[0] == '-' )
+      for ( auto &p : out )
+        p.sign = -p.sign;
+    return true;
+  }
+
+  if ( Is_Wrapped(f) ) return Expand( f.substr(1,f.size()-2), out );
+
+  size_t i = 0;
+  while ( i < f.size() && (isalnum(f[i]) || f[i] == '_') ) i++;
+  if ( i == 0 || i == f.size() || !Is_Wrapped(f.substr(i)) ) return false;
+
+  const std::string name = f.substr(0,i);
+  if ( name != "cos" && name != "sin" && name != "exp" ) return false;
+
+  std::vector<product> terms;
+  if ( !Expand( f.substr(i+1,f.size()-i-2), terms ) ) return false;
+
+  // a: position part, b: time part of the argument
+  std::string a, b;
+  for ( auto p : terms )
+  {
+    std::string str = ( p.sign < 0 ) ? "(-1)" : "1";
+    for ( auto g : p.factors )
+      str += "*(" + g + ")";
+
+    int dep = Classify(str);
+    if ( (dep & dep_other) || ((dep & (dep_x|dep_y|dep_z)) && (dep & dep_t)) ) return false;
+    std::string &part = ( dep & (dep_x|dep_y|dep_z) ) ? a : b;
+    part += ( part.empty() ? "" : "+" ) + str;
+  }
+  if ( a.empty() || b.empty() ) return false;
+
+  if ( name == "cos" )
+  {
+    out.push_back( { 1.0, { "cos(" + a + ")", "cos(" + b + ")" } } );
+    out.push_back( { -1.0, { "sin(" + a + ")", "sin(" + b + ")" } } );
+  }
+  else if ( name == "sin" )
+  {
+    out.push_back( { 1.0, { "sin(" + a + ")", "cos(" + b + ")" } } );
+    out.push_back( { 1.0, { "cos(" + a + ")", "sin(" + b + ")" } } );
+  }
+  else
+  {
+    out.push_back( { 1.0, { "exp(" + a + ")", "exp(" + b + ")" } } );
+  }
+  return true;
+}
+
+/** Splits an expression at the top level binary + and -
+  *
+  * @return pairs of sign and term
+  */
+std::vector<std::pair<double,std::string>> ExprSplitter::Split_Sum( const std::string &str )
+{
+  std::vector<std::pair<double,std::string>> retval;
+  int depth = 0;
+  size_t start = 0;
+  double sign = 1;
+
+  for ( size_t i=0; i<str.size(); i++ )
+  {
+    if ( str[i] == '(' ) depth++;
+    else if ( str[i] == ')' ) depth--;
+    else if ( depth == 0 && (str[i] == '+' || str[i] == '-') && Is_Binary_Sign(str,i) )
+    {
+      retval.push_back( std::make_pair( sign, str.substr(start,i-start) ) );
+      sign = ( str[i] == '-' ) ? -1 : 1;
+      start = i+1;
+    }
+  }
+  retval.push_back( std::make_pair( sign, str.substr(start) ) );
+  return retval;
+}
+
+/** Splits a term at the top level * and /
+  *
+  * Divisors are returned as 1/(divisor).
+  */
+std::vector<std::string> ExprSplitter::Split_Product( const std::string &str )
+{
+  std::vector<std::string> retval;
+  int depth = 0;
+  size_t start = 0;
+  bool divisor = false;
+
+  for ( size_t i=0; i<=str.size(); i++ )
+  {
+    if ( i < str.size() )
+    {
+      if ( str[i] == '(' ) depth++;
+      if ( str[i] == ')' ) depth--;
+      if ( depth != 0 || (str[i] != '*' && str[i] != '/') ) continue;
+    }
+    std::string f = str.substr(start,i-start);
+    retval.push_back( divisor ? "1/(" + f + ")" : f );
+    if ( i < str.size() ) divisor = ( str[i] == '/' );
+    start = i+1;
+  }
+  return retval;
+}
+
+/// Returns true if the whole string is enclosed by a pair of parentheses
+bool ExprSplitter::Is_Wrapped( const std::string &str )
+{
+  if ( str.size() < 2 || str.front() != '(' || str.back() != ')' ) return false;
+  int depth = 0;
+  for ( size_t i=0; i<str.size(); i++ )
+  {
+    if ( str[i] == '(' ) depth++;
+    if ( str[i] == ')' ) depth--;
+    if ( depth == 0 && i+1 < str.size() ) return false;
+  }
+  return true;
+}
+
+/// Returns true if the sign at position i is a binary operator (and not unary or part of a number like 1e-3)
+bool ExprSplitter::Is_Binary_Sign( const std::string &str, const size_t i )
+{
+  if ( i == 0 ) return false;
+  const char p = str[i-1];
+  if ( std::string("+-*/^(,<>=!&|?:").find(p) != std::string::npos ) return false;
+
+  if ( (p == 'e' || p == 'E') && i >= 2 )
+  {
+    long j = long(i)-2;
+    while ( j >= 0 && (isdigit(str[j]) || str[j] == '.') ) j--;
+    if ( j < long(i)-2 && (j < 0 || !(isalnum(str[j]) || str[j] == '_')) ) return false;
+  }
+  return true;
+}
@@ -42,9 +42,23 @@ ParameterHandler::ParameterHandler( const std::string filename )
   m_map_freq.insert(std::pair<std::string,int>("last",freq::last));
   m_map_freq.insert(std::pair<std::string,int>("packed",freq::packed));
 
+  m_map_frame.insert(std::pair<std::string,int>("lab",frame::lab));
+  m_map_frame.insert(std::pair<std::string,int>("comoving",frame::comoving));
+  m_map_frame.insert(std::pair<std::string,int>("trajectory",frame::trajectory));
+
+  m_map_observables.insert(std::pair<std::string,int>("N",observable::obs_N));
+  m_map_observables.insert(std::pair<std::string,int>("x",observable::obs_x));
+  m_map_observables.insert(std::pair<std::string,int>("x2",observable::obs_x2));
+  m_map_observables.insert(std::pair<std::string,int>("p",observable::obs_p));
+  m_map_observables.insert(std::pair<std::string,int>("p2",observable::obs_p2));
+  m_map_observables.insert(std::pair<std::string,int>("coherence",observable::obs_coherence));
+  m_map_observables.insert(std::pair<std::string,int>("E",observable::obs_E));
+
   //Read values from xml
   populate_constants();
   populate_vconstants();
+  populate_interactions();
+  populate_ensemble();
   populate_algorithm();
   populate_simulation();
   populate_sequence();
@@ -55,12 +69,31 @@ ParameterHandler::~ParameterHandler()
 {
   m_map_constants.clear();
   m_map_vconstants.clear();
+  m_map_interactions.clear();
+  m_map_ensemble.clear();
   m_map_algorithm.clear();
   m_map_simulation.clear();
   m_sequence.clear();
   m_analyze.clear();
 }
 
+/** Returns the name of the pair of internal states (i,j), e.g. g_12
+  *
+  * States above 9 are separated by an underscore, e.g. g_9_10 or V_10_10.
+  */
+static std::string Pair_Name( const std::string prefix, const int i, const int j )
+{
+  if ( i < 10 && j < 10 ) return prefix + "_" + std::to_string(i) + std::to_string(j);
+  return prefix + "_" + std::to_string(i) + "_" + std::to_string(j);
+}
+
+/** Returns the attribute name of the matrix element (i,j) of a sequence, e.g. V_12_real or V_9_10_real
+  */
+static std::string Element_Name( const int i, const int j, const std::string part )
+{
+  return Pair_Name("V", i, j) + "_" + part;
+}
+
 void ParameterHandler::populate_sequence()
 {
   m_sequence.clear();
@@ -102,16 +135,10 @@ void ParameterHandler::populate_sequence()
 		{
 			for (int j=i; j < internal_dim+1; j++)
 			{
-				char indices [20]; //with buffer
-				char V_real [] = "V_ij_real";
-				char V_imag [] = "V_ij_imag";
-				std::sprintf(indices, "%d%d", i, j);
-				V_real[2] = indices[0];
-				V_real[3] = indices[1];
-				V_imag[2] = indices[0];
-				V_imag[3] = indices[1];
-				const char *char_V_real = V_real;
-				const char *char_V_imag = V_imag;
+				const std::string V_real = Element_Name(i, j, "real");
+				const std::string V_imag = Element_Name(i, j, "imag");
+				const char *char_V_real = V_real.c_str();
+				const char *char_V_imag = V_imag.c_str();
 
 				if (std::strcmp(node.node().attribute(char_V_real).as_string(),"")==0)
 				{
@@ -133,16 +160,10 @@ void ParameterHandler::populate_sequence()
     {
 		for (int i=1; i < internal_dim+1; i++)
 		{
-			char indices [20]; //with buffer
-			char V_real [] = "V_ii_real";
-			char V_imag [] = "V_ii_imag";
-			std::sprintf(indices, "%d%d", i, i);
-			V_real[2] = indices[0];
-			V_real[3] = indices[1];
-			V_imag[2] = indices[0];
-			V_imag[3] = indices[1];
-			const char *char_V_real = V_real;
-			const char *char_V_imag = V_imag;
+			const std::string V_real = Element_Name(i, i, "real");
+			const std::string V_imag = Element_Name(i, i, "imag");
+			const char *char_V_real = V_real.c_str();
+			const char *char_V_imag = V_imag.c_str();
 
 			if (std::strcmp(node.node().attribute(char_V_real).as_string(),"")==0)
 			{
@@ -246,6 +267,72 @@ void ParameterHandler::populate_constants()
   }
 }
 
+// See populate_constants for more details
+void ParameterHandler::populate_interactions()
+{
+  m_map_interactions.clear();
+
+  double val;
+  std::string tmp, str;
+
+  std::string querystr = "/SIMULATION//INTERACTIONS//*";
+  pugi::xpath_node_set tools = m_xml_doc.select_nodes(querystr.c_str());
+
+  for (pugi::xpath_node_set::const_iterator it = tools.begin(); it != tools.end(); ++it)
+  {
+    pugi::xpath_node node = *it;
+
+    str = node.node().name();
+    tmp = node.node().child_value();
+
+    try
+    {
+      val = stod(tmp);
+    }
+    catch ( const std::invalid_argument &ia )
+    {
+      throw std::string( "Error Parsing xml file: Unable to convert " + tmp + " to double for element <" + str + "> in section INTERACTIONS\n" );
+    }
+    m_map_interactions.insert ( std::pair<std::string,double>(str,val) );
+  }
+}
+
+// See populate_vconstants for more details
+void ParameterHandler::populate_ensemble()
+{
+  m_map_ensemble.clear();
+
+  std::string tmp, str;
+  std::vector<std::string> vec;
+
+  std::string querystr = "/SIMULATION//ENSEMBLE//*";
+  pugi::xpath_node_set tools = m_xml_doc.select_nodes(querystr.c_str());
+
+  for (pugi::xpath_node_set::const_iterator it = tools.begin(); it != tools.end(); ++it)
+  {
+    pugi::xpath_node node = *it;
+
+    vec.clear();
+    str = node.node().name();
+    tmp = node.node().child_value();
+    strtk::parse(tmp,",",vec);
+
+    std::vector<double> data;
+    for ( auto i : vec )
+    {
+      try
+      {
+        data.push_back(stod(i));
+      }
+      catch ( const std::invalid_argument &ia )
+      {
+        throw std::string( "Error Parsing xml file: Unable to convert " + i + " to double for element <" + str + "> in section ENSEMBLE\n" );
+      }
+    }
+    m_map_ensemble.insert ( std::pair<std::string,std::vector<double>>(str,data) );
+  }
+}
+
 // See populate_constants for more details
 void ParameterHandler::populate_vconstants()
 {
@@ -343,6 +430,26 @@ std::string ParameterHandler::Get_simulation( const std::string k )
   return (*it).second;
 }
 
+double ParameterHandler::Get_Interaction( const int i, const int j )
+{
+  auto it = m_map_interactions.find(Pair_Name("g", i, j));
+  if ( it == m_map_interactions.end() ) it = m_map_interactions.find(Pair_Name("g", j, i));
+  if ( it == m_map_interactions.end() ) return 0;
+  return (*it).second;
+}
+
+int ParameterHandler::Get_Ensemble_Size()
+{
+  int retval = 0;
+  for ( auto it : m_map_ensemble )
+  {
+    if ( retval != 0 && int(it.second.size()) != retval )
+      throw std::string( "Error: All parameters in section ENSEMBLE need the same number of values (" + it.first + ")." );
+    retval = it.second.size();
+  }
+  return retval;
+}
+
 double ParameterHandler::Get_Constant( const std::string k )
 {
   auto it = m_map_constants.find(k);
@@ -486,6 +593,47 @@ double ParameterHandler::Get_M()
   return retval;
 }
 
+int ParameterHandler::Get_Frame()
+{
+  int retval=frame::lab;
+  auto it = m_map_algorithm.find("FRAME");
+  if ( it != m_map_algorithm.end() )
+  {
+    auto it2 = m_map_frame.find((*it).second);
+    if ( it2 == m_map_frame.end() ) throw std::string( "Error: Unknown frame " + (*it).second + " in section ALGORITHM." );
+    retval = (*it2).second;
+  }
+  return retval;
+}
+
+int ParameterHandler::Get_Observables()
+{
+  int retval=0;
+  auto it = m_map_algorithm.find("OBSERVABLES");
+  if ( it != m_map_algorithm.end() )
+  {
+    std::vector<std::string> vec;
+    strtk::parse((*it).second,",",vec);
+    for ( auto str : vec )
+    {
+      str.erase( std::remove_if( str.begin(), str.end(), ::isspace ), str.end() );
+      if ( str.empty() ) continue;
+      auto it2 = m_map_observables.find(str);
+      if ( it2 == m_map_observables.end() ) throw std::string( "Error: Unknown observable " + str + " in section ALGORITHM." );
+      retval |= (*it2).second;
+    }
+  }
+  return retval;
+}
+
+/** Returns value of a tag <string> in the ALGORITHM section of the xml file or the default value if the tag is missing */
+double ParameterHandler::Get_Algorithm( const std::string k, const double def )
+{
+  double retval=def;
+  auto it = m_map_algorithm.find(k);
+  if ( it != m_map_algorithm.end() ) retval = stod((*it).second);
+  return retval;
+}
 
 int ParameterHandler::Get_NX()
 {
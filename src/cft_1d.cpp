@@ -55,6 +55,7 @@ namespace Fourier
   */
   void cft_1d::ft( int isign )
   {
+    Phase_Scope timer( ph_fft );
     m_isign = isign;
     if ( abs(isign) != 1 ) return;
     if ( isign == -1 )
@@ -153,6 +154,7 @@ namespace Fourier
    */
   void cft_1d::fix( fftw_complex *data, const double d )
   {
+    Phase_Scope timer( ph_fix );
     double fak = d / sqrt(2.0*M_PI);
 
     fftw_complex tmp;
@@ -185,6 +187,7 @@ namespace Fourier
    */
   void cft_1d::scale( fftw_complex *data, const double sx )
   {
+    Phase_Scope timer( ph_fix );
     const double fak = sx / sqrt(2.0*M_PI);
 
     #pragma omp parallel for
@@ -52,6 +52,7 @@ namespace Fourier
   */
   void cft_2d::ft( int isign )
   {
+    Phase_Scope timer( ph_fft );
     m_isign = isign;
     if ( abs(isign) != 1 ) return;
     if ( isign == -1 )
@@ -221,156 +222,53 @@ namespace Fourier
   /**
    * \brief Calculate 1st derivative with respect to x of data in m_in
    *
-   *  Differentiation is done via fourier transformation method.
+   *  Differentiation is done via fourier transformation method, see cft_base::Derivatives().
    */
   void cft_2d::Diff_x()
   {
-    int ij, i2;
-    double kx, tmp1;
-
-    bool b_oldval = m_bfix;
-    m_bfix = true;
-
-    this->ft(-1);
-    #pragma omp parallel for schedule(dynamic,1) collapse(2) private(ij,i2,kx,tmp1)
-    for ( int i=0; i<m_dim_x; i++ )
-    {
-      for ( int j=0; j<m_dim_y; j++ )
-      {
-        this->Get_kx( i, i2, kx );
-        ij = j+m_dim_y*i;
-
-        tmp1 = m_out[ij][0];
-        m_out[ij][0] = -kx*m_out[ij][1];
-        m_out[ij][1] = kx*tmp1;
-      }
-    }
-    this->ft(1);
-    m_bfix = b_oldval;
+    fftw_complex *grad[2] = { m_in, nullptr };
+    Derivatives( 1, grad, nullptr, nullptr );
   }
 
   /**
    * \brief Calculate 1st derivative with respect to y of data in m_in
    *
-   *  Differentiation is done via fourier transformation method.
+   *  Differentiation is done via fourier transformation method, see cft_base::Derivatives().
    */
   void cft_2d::Diff_y()
   {
-    int ij, j2;
-    double ky, tmp1;
-
-    bool b_oldval = m_bfix;
-    m_bfix = false;
-
-    this->ft(-1);
-    #pragma omp parallel for schedule(dynamic,1) collapse(2) private(ij,j2,ky,tmp1)
-    for ( int i=0; i<m_dim_x; i++ )
-    {
-      for ( int j=0; j<m_dim_y; j++ )
-      {
-        this->Get_ky( j, j2, ky );
-        ij = j+m_dim_y*i;
-
-        tmp1 = m_out[ij][0];
-        m_out[ij][0] = -ky*m_out[ij][1];
-        m_out[ij][1] = ky*tmp1;
-      }
-    }
-    this->ft(1);
-    m_bfix = b_oldval;
+    fftw_complex *grad[2] = { nullptr, m_in };
+    Derivatives( 2, grad, nullptr, nullptr );
   }
 
   /**
    * \brief Calculate 2nd derivative with respect to x of data in m_in
    *
-   *  Differentiation is done via fourier transformation method.
+   *  Differentiation is done via fourier transformation method, see cft_base::Derivatives().
    */
   void cft_2d::Diff_xx()
   {
-    int ij, i2;
-    double kx;
-
-    bool b_oldval = m_bfix;
-    m_bfix = false;
-
-    this->ft(-1);
-    #pragma omp parallel for schedule(dynamic,1) collapse(2) private(ij,i2,kx)
-    for ( int i=0; i<m_dim_x; i++ )
-    {
-      for ( int j=0; j<m_dim_y; j++ )
-      {
-        this->Get_kx( i, i2, kx );
-        kx = -kx*kx;
-        ij = j+m_dim_y*i;
-
-        m_out[ij][0] *= kx;
-        m_out[ij][1] *= kx;
-      }
-    }
-    this->ft(1);
-    m_bfix = b_oldval;
+    Derivatives( 1, nullptr, m_in, nullptr );
   }
 
   /**
    * \brief Calculate 2nd derivative with respect to y of data in m_in
    *
-   *  Differentiation is done via fourier transformation method.
+   *  Differentiation is done via fourier transformation method, see cft_base::Derivatives().
    */
   void cft_2d::Diff_yy()
   {
-    int ij, j2;
-    double ky;
-
-    bool b_oldval = m_bfix;
-    m_bfix = false;
-
-    this->ft(-1);
-    #pragma omp parallel for schedule(dynamic,1) collapse(2) private(ij,j2,ky)
-    for ( int j=0; j<m_dim_y; j++ )
-    {
-      for ( int i=0; i<m_dim_x; i++ )
-      {
-        this->Get_ky( j, j2, ky );
-        ky = -ky*ky;
-        ij = j+m_dim_y*i;
-
-        m_out[ij][0] *= ky;
-        m_out[ij][1] *= ky;
-      }
-    }
-    this->ft(1);
-    m_bfix = b_oldval;
+    Derivatives( 2, nullptr, m_in, nullptr );
   }
 
   /**
    * \brief Applies Laplace Operator on data in m_in
    *
-   *  Differentiation is done via fourier transformation method.
+   *  Differentiation is done via fourier transformation method, see cft_base::Derivatives().
    */
   void cft_2d::Laplace()
   {
-    int ij, i2, j2;
-    double kx, ky, tmp1;
-
-    bool b_oldval = m_bfix;
-    m_bfix = true;
-
-    this->ft(-1);
-    #pragma omp parallel for schedule(dynamic,1) collapse(2) private(i2,j2,kx,ky,tmp1)
-    for ( int i=0; i<m_dim_x; i++ )
-    {
-      for ( int j=0; j<m_dim_y; j++ )
-      {
-        this->Get_k( i, j, i2, j2, kx, ky );
-        ij = j+m_dim_y*i;
-
-        tmp1 = -kx*kx-ky*ky;
-        m_out[ij][0] *= tmp1;
-        m_out[ij][1] *= tmp1;
-      }
-    }
-    this->ft(1);
-    m_bfix = b_oldval;
+    Derivatives( 3, nullptr, m_in, nullptr );
   }
 
   /**
@@ -382,6 +280,7 @@ namespace Fourier
    */
   void cft_2d::fix( fftw_complex *data, const double sx, const double sy )
   {
+    Phase_Scope timer( ph_fix );
     const double fak = 0.5 * sx * sy / M_PI;
 
     #pragma omp parallel
@@ -443,6 +342,7 @@ namespace Fourier
    */
   void cft_2d::scale( fftw_complex *data, const double sx, const double sy )
   {
+    Phase_Scope timer( ph_fix );
     const double fak = 0.5 * sx * sy / M_PI;
 
     #pragma omp parallel for
@@ -0,0 +1,138 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#ifdef TALISES_MPI
+
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include "cft_2d_mpi.h"
+
+namespace Fourier
+{
+  /**
+   * \brief Local part of the grid on this process
+   *
+   * @param header Header information of the whole grid
+   */
+  cft_2d_mpi::layout cft_2d_mpi::Local_Size( const generic_header &header )
+  {
+    layout retval;
+    retval.alloc = fftw_mpi_local_size_2d_transposed( header.nDimX, header.nDimY, MPI_COMM_WORLD, &retval.local_n0, &retval.local_0_start, &retval.local_n1, &retval.local_1_start );
+    return retval;
+  }
+
+  /**
+   * \brief cft_2d_mpi Constructor
+   *
+   * Complex Fourier Transformation in 2 dimension distributed over all MPI processes.
+   *
+   * @param header Header information of the whole grid
+   * @param b Whether inplace transformation is done (must be true)
+   * @param f Whether ordering is fixed (must be false)
+   */
+  cft_2d_mpi::cft_2d_mpi( const generic_header &header, bool b, bool f ) : cft_2d_mpi( header, Local_Size(header) )
+  {
+    if ( !b || f ) throw std::string("Error: cft_2d_mpi supports only inplace transformations without fixed ordering.\n");
+  }
+
+  cft_2d_mpi::cft_2d_mpi( const generic_header &header, const layout &l ) : cft_base( header, l.alloc, l.local_n0, l.local_0_start, int64_t(l.local_n1)*header.nDimX )
+  {
+    m_local_ny = l.local_n1;
+    m_local_y0 = l.local_1_start;
+
+    m_forwardPlan  = fftw_mpi_plan_dft_2d( m_dim_x, m_dim_y, m_in, m_out, MPI_COMM_WORLD, FFTW_FORWARD, FFTW_ESTIMATE | FFTW_MPI_TRANSPOSED_OUT );
+    m_backwardPlan = fftw_mpi_plan_dft_2d( m_dim_x, m_dim_y, m_out, m_in, MPI_COMM_WORLD, FFTW_BACKWARD, FFTW_ESTIMATE | FFTW_MPI_TRANSPOSED_IN );
+
+    assert( m_forwardPlan != nullptr );
+    assert( m_backwardPlan != nullptr );
+  }
+
+  /**
+   * \brief Performs Fourier Transformation
+   *
+   * Collective call of all processes, see cft_2d::ft.
+   *
+   * @param isign Whether forward [isign = -1] or backward [isign = 1]
+   fourier transformation is performed.
+  */
+  void cft_2d_mpi::ft( int isign )
+  {
+    Phase_Scope timer( ph_fft );
+    if ( m_bfix ) throw std::string("Error: cft_2d_mpi does not support fixed ordering.\n");
+
+    m_isign = isign;
+    if ( abs(isign) != 1 ) return;
+    if ( isign == -1 )
+    {
+      fftw_execute( m_forwardPlan );
+      scale( m_out, m_dim_fs, 0.5*m_dx*m_dy/M_PI );
+    }
+    else
+    {
+      fftw_execute( m_backwardPlan );
+      scale( m_in, m_dim, 0.5*m_dkx*m_dky/M_PI );
+    }
+  }
+
+  /**
+   * \brief Get x
+   *
+   * @param l Local array index in real space
+   */
+  CPoint<2> cft_2d_mpi::Get_x( const int64_t l )
+  {
+    CPoint<2> retval;
+    int64_t i = l / m_dim_y;
+    int64_t j = l - i*m_dim_y;
+    retval[0] = double(i+m_local_x0-m_shift_x)*m_dx;
+    retval[1] = double(j-m_shift_y)*m_dy;
+    return retval;
+  }
+
+  /**
+   * \brief Get k
+   *
+   * @param l Local array index in the transposed fourier space (y, x)
+   */
+  CPoint<2> cft_2d_mpi::Get_k( const int64_t l )
+  {
+    CPoint<2> retval;
+    int64_t j = l / m_dim_x;
+    int64_t i = l - j*m_dim_x;
+    i = (i+m_shift_x)%m_dim_x;
+    j = (j+m_local_y0+m_shift_y)%m_dim_y;
+
+    retval[0] = m_dkx*double(i-m_shift_x);
+    retval[1] = m_dky*double(j-m_shift_y);
+    return retval;
+  }
+
+  void cft_2d_mpi::scale( fftw_complex *data, const int64_t n, const double fak )
+  {
+    Phase_Scope timer( ph_fix );
+    #pragma omp parallel for
+    for ( int64_t i=0; i<n; i++ )
+    {
+      data[i][0] *= fak;
+      data[i][1] *= fak;
+    }
+  }
+}
+#endif
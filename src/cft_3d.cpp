@@ -52,6 +52,7 @@ namespace Fourier
   */
   void cft_3d::ft( int isign )
   {
+    Phase_Scope timer( ph_fft );
     m_isign = isign;
     if ( abs(isign) != 1 ) return;
     if ( isign == -1 )
@@ -262,240 +263,74 @@ namespace Fourier
   /**
    * \brief Calculate 1st derivative with respect to x of data in m_in
    *
-   *  Differentiation is done via fourier transformation method.
+   *  Differentiation is done via fourier transformation method, see cft_base::Derivatives().
    */
   void cft_3d::Diff_x()
   {
-    int ijk, i2;
-    double kx, tmp1;
-
-    bool b_oldval = m_bfix;
-    m_bfix = false;
-
-    this->ft(-1);
-    #pragma omp parallel for schedule(dynamic,1) collapse(3) private(ijk,i2,kx,tmp1)
-    for ( int i=0; i<m_dim_x; i++ )
-    {
-      for ( int j=0; j<m_dim_y; j++ )
-      {
-        for ( int k=0; k<m_dim_z; k++ )
-        {
-          this->Get_kx( i, i2, kx );
-          ijk = k+m_dim_z*(j+m_dim_y*i);
-
-          tmp1 = m_out[ijk][0];
-          m_out[ijk][0] = -kx*m_out[ijk][1];
-          m_out[ijk][1] = kx*tmp1;
-        }
-      }
-    }
-    this->ft(1);
-    m_bfix = b_oldval;
+    fftw_complex *grad[3] = { m_in, nullptr, nullptr };
+    Derivatives( 1, grad, nullptr, nullptr );
   }
 
   /**
    * \brief Calculate 1st derivative with respect to y of data in m_in
    *
-   *  Differentiation is done via fourier transformation method.
+   *  Differentiation is done via fourier transformation method, see cft_base::Derivatives().
    */
   void cft_3d::Diff_y()
   {
-    int ijk, j2;
-    double ky, tmp1;
-
-    bool b_oldval = m_bfix;
-    m_bfix = false;
-
-    this->ft(-1);
-    #pragma omp parallel for schedule(dynamic,1) collapse(3) private(ijk,j2,ky,tmp1)
-    for ( int i=0; i<m_dim_x; i++ )
-    {
-      for ( int j=0; j<m_dim_y; j++ )
-      {
-        for ( int k=0; k<m_dim_z; k++ )
-        {
-          this->Get_ky( j, j2, ky );
-          ijk = k+m_dim_z*(j+m_dim_y*i);
-
-          tmp1 = m_out[ijk][0];
-          m_out[ijk][0] = -ky*m_out[ijk][1];
-          m_out[ijk][1] = ky*tmp1;
-        }
-      }
-    }
-    this->ft(1);
-    m_bfix = b_oldval;
+    fftw_complex *grad[3] = { nullptr, m_in, nullptr };
+    Derivatives( 2, grad, nullptr, nullptr );
   }
 
   /**
    * \brief Calculate 1st derivative with respect to z of data in m_in
    *
-   *  Differentiation is done via fourier transformation method.
+   *  Differentiation is done via fourier transformation method, see cft_base::Derivatives().
    */
   void cft_3d::Diff_z()
   {
-    int ijk, k2;
-    double kz, tmp1;
-
-    bool b_oldval = m_bfix;
-    m_bfix = false;
-
-    this->ft(-1);
-    #pragma omp parallel for schedule(dynamic,1) collapse(3) private(ijk,k2,kz,tmp1)
-    for ( int i=0; i<m_dim_x; i++ )
-    {
-      for ( int j=0; j<m_dim_y; j++ )
-      {
-        for ( int k=0; k<m_dim_z; k++ )
-        {
-          this->Get_kz( k, k2, kz );
-          ijk = k+m_dim_z*(j+m_dim_y*i);
-
-          tmp1 = m_out[ijk][0];
-          m_out[ijk][0] = -kz*m_out[ijk][1];
-          m_out[ijk][1] = kz*tmp1;
-        }
-      }
-    }
-    this->ft(1);
-    m_bfix = b_oldval;
+    fftw_complex *grad[3] = { nullptr, nullptr, m_in };
+    Derivatives( 4, grad, nullptr, nullptr );
   }
 
   /**
    * \brief Calculate 2nd derivative with respect to x of data in m_in
    *
-   *  Differentiation is done via fourier transformation method.
+   *  Differentiation is done via fourier transformation method, see cft_base::Derivatives().
    */
   void cft_3d::Diff_xx()
   {
-    int ijk, i2;
-    double kx;
-
-    bool b_oldval = m_bfix;
-    m_bfix = false;
-
-    this->ft(-1);
-    #pragma omp parallel for schedule(dynamic,1) collapse(3) private(ijk,i2,kx)
-    for ( int i=0; i<m_dim_x; i++ )
-    {
-      for ( int j=0; j<m_dim_y; j++ )
-      {
-        for ( int k=0; k<m_dim_z; k++ )
-        {
-          this->Get_kx( i, i2, kx );
-          kx = -kx*kx;
-          ijk = k+m_dim_z*(j+m_dim_y*i);
-
-          m_out[ijk][0] *= kx;
-          m_out[ijk][1] *= kx;
-        }
-      }
-    }
-    this->ft(1);
-    m_bfix = b_oldval;
+    Derivatives( 1, nullptr, m_in, nullptr );
   }
 
   /**
    * \brief Calculate 2nd derivative with respect to y of data in m_in
    *
-   *  Differentiation is done via fourier transformation method.
+   *  Differentiation is done via fourier transformation method, see cft_base::Derivatives().
    */
   void cft_3d::Diff_yy()
   {
-    int ijk, j2;
-    double ky;
-
-    bool b_oldval = m_bfix;
-    m_bfix = false;
-
-    this->ft(-1);
-    #pragma omp parallel for schedule(dynamic,1) collapse(3) private(ijk,j2,ky)
-    for ( int i=0; i<m_dim_x; i++ )
-    {
-      for ( int j=0; j<m_dim_y; j++ )
-      {
-        for ( int k=0; k<m_dim_z; k++ )
-        {
-          this->Get_ky( j, j2, ky );
-          ky = -ky*ky;
-          ijk = k+m_dim_z*(j+m_dim_y*i);
-
-          m_out[ijk][0] *= ky;
-          m_out[ijk][1] *= ky;
-        }
-      }
-    }
-    this->ft(1);
-    m_bfix = b_oldval;
+    Derivatives( 2, nullptr, m_in, nullptr );
   }
 
   /**
    * \brief Calculate 2nd derivative with respect to z of data in m_in
    *
-   *  Differentiation is done via fourier transformation method.
+   *  Differentiation is done via fourier transformation method, see cft_base::Derivatives().
    */
   void cft_3d::Diff_zz()
   {
-    int ijk, k2;
-    double kz;
-
-    bool b_oldval = m_bfix;
-    m_bfix = false;
-
-    this->ft(-1);
-    #pragma omp parallel for schedule(dynamic,1) collapse(3) private(ijk,k2,kz)
-    for ( int i=0; i<m_dim_x; i++ )
-    {
-      for ( int j=0; j<m_dim_y; j++ )
-      {
-        for ( int k=0; k<m_dim_z; k++ )
-        {
-          this->Get_kz( k, k2, kz );
-          kz = -kz*kz;
-          ijk = k+m_dim_z*(j+m_dim_y*i);
-
-          m_out[ijk][0] *= kz;
-          m_out[ijk][1] *= kz;
-        }
-      }
-    }
-    this->ft(1);
-    m_bfix = b_oldval;
+    Derivatives( 4, nullptr, m_in, nullptr );
   }
 
   /**
    * \brief Applies Laplace Operator on data in m_in
    *
-   *  Differentiation is done via fourier transformation method.
+   *  Differentiation is done via fourier transformation method, see cft_base::Derivatives().
    */
   void cft_3d::Laplace()
   {
-    int ijk, i2, j2, k2;
-    double kx, ky, kz, tmp1;
-
-    bool b_oldval = m_bfix;
-    m_bfix = false;
-
-    this->ft(-1);
-    #pragma omp parallel for schedule(dynamic,1) collapse(3) private(i2,j2,k2,kx,ky,kz,tmp1)
-    for ( int i=0; i<m_dim_x; i++ )
-    {
-      for ( int j=0; j<m_dim_y; j++ )
-      {
-        for ( int k=0; k<m_dim_z; k++ )
-        {
-          this->Get_k( i, j, k, i2, j2, k2, kx, ky, kz );
-          ijk = k+m_dim_z*(j+m_dim_y*i);
-
-          tmp1 = -kx*kx-ky*ky-kz*kz;
-
-          m_out[ijk][0] *= tmp1;
-          m_out[ijk][1] *= tmp1;
-        }
-      }
-    }
-    this->ft(1);
-    m_bfix = b_oldval;
+    Derivatives( 7, nullptr, m_in, nullptr );
   }
 
   /**
@@ -508,6 +343,7 @@ namespace Fourier
    */
   void cft_3d::fix( fftw_complex *data, const double sx, const double sy, const double sz )
   {
+    Phase_Scope timer( ph_fix );
     int ijk_1, ijk_2;
     double fak2, tmp;
     const double fak = sx * sy * sz / pow(2*M_PI,1.5);
@@ -621,6 +457,7 @@ namespace Fourier
    */
   void cft_3d::scale( fftw_complex *data, const double sx, const double sy, const double sz )
   {
+    Phase_Scope timer( ph_fix );
     const double fak = sx * sy * sz / pow(2*M_PI,1.5);
 
     #pragma omp parallel for
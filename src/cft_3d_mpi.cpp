@@ -0,0 +1,143 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#ifdef TALISES_MPI
+
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include "cft_3d_mpi.h"
+
+namespace Fourier
+{
+  /**
+   * \brief Local part of the grid on this process
+   *
+   * @param header Header information of the whole grid
+   */
+  cft_3d_mpi::layout cft_3d_mpi::Local_Size( const generic_header &header )
+  {
+    layout retval;
+    retval.alloc = fftw_mpi_local_size_3d_transposed( header.nDimX, header.nDimY, header.nDimZ, MPI_COMM_WORLD, &retval.local_n0, &retval.local_0_start, &retval.local_n1, &retval.local_1_start );
+    return retval;
+  }
+
+  /**
+   * \brief cft_3d_mpi Constructor
+   *
+   * Complex Fourier Transformation in 3 dimension distributed over all MPI processes.
+   *
+   * @param header Header information of the whole grid
+   * @param b Whether inplace transformation is done (must be true)
+   * @param f Whether ordering is fixed (must be false)
+   */
+  cft_3d_mpi::cft_3d_mpi( const generic_header &header, bool b, bool f ) : cft_3d_mpi( header, Local_Size(header) )
+  {
+    if ( !b || f ) throw std::string("Error: cft_3d_mpi supports only inplace transformations without fixed ordering.\n");
+  }
+
+  cft_3d_mpi::cft_3d_mpi( const generic_header &header, const layout &l ) : cft_base( header, l.alloc, l.local_n0, l.local_0_start, int64_t(l.local_n1)*header.nDimX*header.nDimZ )
+  {
+    m_local_ny = l.local_n1;
+    m_local_y0 = l.local_1_start;
+
+    m_forwardPlan  = fftw_mpi_plan_dft_3d( m_dim_x, m_dim_y, m_dim_z, m_in, m_out, MPI_COMM_WORLD, FFTW_FORWARD, FFTW_ESTIMATE | FFTW_MPI_TRANSPOSED_OUT );
+    m_backwardPlan = fftw_mpi_plan_dft_3d( m_dim_x, m_dim_y, m_dim_z, m_out, m_in, MPI_COMM_WORLD, FFTW_BACKWARD, FFTW_ESTIMATE | FFTW_MPI_TRANSPOSED_IN );
+
+    assert( m_forwardPlan != nullptr );
+    assert( m_backwardPlan != nullptr );
+  }
+
+  /**
+   * \brief Performs Fourier Transformation
+   *
+   * Collective call of all processes, see cft_3d::ft.
+   *
+   * @param isign Whether forward [isign = -1] or backward [isign = 1]
+   fourier transformation is performed.
+  */
+  void cft_3d_mpi::ft( int isign )
+  {
+    Phase_Scope timer( ph_fft );
+    if ( m_bfix ) throw std::string("Error: cft_3d_mpi does not support fixed ordering.\n");
+
+    m_isign = isign;
+    if ( abs(isign) != 1 ) return;
+    if ( isign == -1 )
+    {
+      fftw_execute( m_forwardPlan );
+      scale( m_out, m_dim_fs, m_dx*m_dy*m_dz/pow(2*M_PI,1.5) );
+    }
+    else
+    {
+      fftw_execute( m_backwardPlan );
+      scale( m_in, m_dim, m_dkx*m_dky*m_dkz/pow(2*M_PI,1.5) );
+    }
+  }
+
+  /**
+   * \brief Get x
+   *
+   * @param l Local array index in real space
+   */
+  CPoint<3> cft_3d_mpi::Get_x( const int64_t l )
+  {
+    CPoint<3> retval;
+    int64_t i = l / m_dim_y / m_dim_z;
+    int64_t j = (l - i*m_dim_y*m_dim_z) / m_dim_z;
+    int64_t k = l - i*m_dim_y*m_dim_z - j*m_dim_z;
+    retval[0] = double(i+m_local_x0-m_shift_x)*m_dx;
+    retval[1] = double(j-m_shift_y)*m_dy;
+    retval[2] = double(k-m_shift_z)*m_dz;
+    return retval;
+  }
+
+  /**
+   * \brief Get k
+   *
+   * @param l Local array index in the transposed fourier space (y, x, z)
+   */
+  CPoint<3> cft_3d_mpi::Get_k( const int64_t l )
+  {
+    CPoint<3> retval;
+    int64_t j = l / m_dim_x / m_dim_z;
+    int64_t i = (l - j*m_dim_x*m_dim_z) / m_dim_z;
+    int64_t k = l - j*m_dim_x*m_dim_z - i*m_dim_z;
+    i = (i+m_shift_x)%m_dim_x;
+    j = (j+m_local_y0+m_shift_y)%m_dim_y;
+    k = (k+m_shift_z)%m_dim_z;
+
+    retval[0] = m_dkx*double(i-m_shift_x);
+    retval[1] = m_dky*double(j-m_shift_y);
+    retval[2] = m_dkz*double(k-m_shift_z);
+    return retval;
+  }
+
+  void cft_3d_mpi::scale( fftw_complex *data, const int64_t n, const double fak )
+  {
+    Phase_Scope timer( ph_fix );
+    #pragma omp parallel for
+    for ( int64_t i=0; i<n; i++ )
+    {
+      data[i][0] *= fak;
+      data[i][1] *= fak;
+    }
+  }
+}
+#endif
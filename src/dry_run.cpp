@@ -0,0 +1,374 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+#include "fftw3.h"
+#include "muParser.h"
+#include "my_structs.h"
+#include "dry_run.h"
+#include "herm_exp.h"
+#include "field_alloc.h"
+#ifdef TALISES_MPI
+#include <mpi.h>
+#endif
+
+// Largest number of internal states of the grid solver, see talises.cpp
+#ifndef TALISES_STATIC_STATES
+#define TALISES_STATIC_STATES 8
+#endif
+
+/// Largest grid used for the calibration of the transforms
+static const int64_t max_calibration_points = 1<<22;
+
+/// Costs of the kernels on this machine
+struct kernel_costs
+{
+  double fft; ///< seconds per transform of the grid
+  double point; ///< seconds per point of a phase factor multiplication
+  double parse; ///< seconds per evaluation of the Hamiltonian with the parser
+  double exp; ///< seconds per point of the matrix exponential
+};
+
+/// Memory size in readable units
+static std::string Bytes( const double bytes )
+{
+  const char *units[] = { "B", "kB", "MB", "GB", "TB" };
+  int u = 0;
+  double v = bytes;
+  while ( v >= 1024 && u < 4 )
+  {
+    v /= 1024;
+    u++;
+  }
+  std::ostringstream out;
+  out << std::fixed << std::setprecision( u == 0 ? 0 : 1 ) << v << " " << units[u];
+  return out.str();
+}
+
+/// Time in readable units
+static std::string Duration( const double seconds )
+{
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1);
+  if ( seconds < 120 ) out << seconds << " s";
+  else if ( seconds < 7200 ) out << seconds/60 << " min";
+  else if ( seconds < 172800 ) out << seconds/3600 << " h";
+  else out << seconds/86400 << " d";
+  return out.str();
+}
+
+/** Time of one transform of the grid
+  *
+  * Large grids are calibrated on a grid with fewer points along the longest axes, the time is scaled with N log N.
+  * @param n Points along each axis
+  * @param dim Dimensions
+  */
+static double Calibrate_FFT( const long long *n, const int dim )
+{
+  int m[3] = { int(n[0]), int(n[1]), int(n[2]) };
+  const double N = double(n[0])*n[1]*n[2];
+  while ( double(m[0])*m[1]*m[2] > max_calibration_points )
+  {
+    int *largest = std::max_element( m, m+dim );
+    *largest = std::max( 1, *largest/2 );
+  }
+  const double M = double(m[0])*m[1]*m[2];
+
+  fftw_complex *data = Alloc_Complex( int64_t(M) );
+  fftw_plan plan = fftw_plan_dft( dim, m, data, data, FFTW_FORWARD, FFTW_ESTIMATE );
+  #pragma omp parallel for
+  for ( int64_t l=0; l<int64_t(M); l++ )
+  {
+    data[l][0] = 1.0/(1+l%7);
+    data[l][1] = 0;
+  }
+
+  fftw_execute( plan );
+  int reps = 0;
+  const double t0 = omp_get_wtime();
+  do
+  {
+    fftw_execute( plan );
+    reps++;
+  } while ( omp_get_wtime() - t0 < 0.2 && reps < 100 );
+  const double t = ( omp_get_wtime() - t0 )/reps;
+
+  fftw_destroy_plan( plan );
+  Free_Buffer( data );
+  return t * ( N*std::log2(std::max(N,2.0)) )/( M*std::log2(std::max(M,2.0)) );
+}
+
+/// Time per point of the multiplication with a phase factor (kinetic and diagonal potential step)
+static double Calibrate_Point()
+{
+  const int64_t M = max_calibration_points;
+  fftw_complex *data = Alloc_Complex( M );
+  #pragma omp parallel for
+  for ( int64_t l=0; l<M; l++ )
+  {
+    data[l][0] = 1;
+    data[l][1] = 0;
+  }
+
+  int reps = 0;
+  const double t0 = omp_get_wtime();
+  do
+  {
+    #pragma omp parallel for
+    for ( int64_t l=0; l<M; l++ )
+    {
+      double re, im;
+      sincos( 1e-3*(l%1000), &im, &re );
+      const double tmp = data[l][0];
+      data[l][0] = data[l][0]*re - data[l][1]*im;
+      data[l][1] = data[l][1]*re + tmp*im;
+    }
+    reps++;
+  } while ( omp_get_wtime() - t0 < 0.2 && reps < 100 );
+  const double t = ( omp_get_wtime() - t0 )/(double(reps)*M);
+  Free_Buffer( data );
+  return t;
+}
+
+/** Time per point of the exponential of an n x n Hermitian matrix, shared by the threads
+  *
+  * @param n Size of the matrices
+  */
+static double Calibrate_Exp( const int n )
+{
+  const int threads = omp_get_max_threads();
+  herm_workspace ws(n);
+  int reps = 0;
+  const double t0 = omp_get_wtime();
+  do
+  {
+    for ( int b=0; b<herm_block; b++ )
+      for ( int i=0; i<n; i++ )
+        for ( int j=i; j<n; j++ )
+          ws.Set( b, i, j, std::cos(i+j+b+reps), ( i == j ) ? 0 : std::sin(i*j+b) );
+    Exp_Hermitian( ws, herm_block, 1e-3 );
+    reps++;
+  } while ( omp_get_wtime() - t0 < 0.1 && reps < 100000 );
+  return ( omp_get_wtime() - t0 )/(double(reps)*herm_block*threads);
+}
+
+/** Time of one evaluation of the Hamiltonian of a sequence with the parser
+  *
+  * The variables are set to arbitrary values, the evaluations run serially like in the solvers.
+  * @param parser Parser with the expression and all variables defined
+  * @param vars Values of the variables
+  */
+static double Calibrate_Parser( mu::Parser &parser, std::vector<double> &vars )
+{
+  int n, reps = 0;
+  const double t0 = omp_get_wtime();
+  try
+  {
+    do
+    {
+      for ( unsigned v=0; v<vars.size(); v++ )
+        vars[v] = 1e-6*(reps+v);
+      parser.Eval(n);
+      reps++;
+    } while ( omp_get_wtime() - t0 < 0.05 && reps < 1000000 );
+  }
+  catch (mu::Parser::exception_type &e)
+  {
+    std::cout << "FYI: the Hamiltonian could not be evaluated: " << e.GetMsg() << "\n";
+    return 0;
+  }
+  return ( omp_get_wtime() - t0 )/reps;
+}
+
+/** Predicts the memory, the number of operations and the run time of the simulation of an xml file
+  *
+  * Nothing is allocated except the buffers of the calibration runs and no output file is written.
+  * @param params Parameters of the simulation
+  * @param dim Dimensions of the grid
+  * @param internal_dim Number of internal states
+  */
+void Dry_Run( ParameterHandler &params, const int dim, const int internal_dim )
+{
+  generic_header header;
+  const std::string filename = params.Get_simulation("FILENAME");
+  std::ifstream file( filename, std::ifstream::binary );
+  if ( !file.is_open() ) throw std::string( "Could not open file " + filename + ".\n" );
+  file.read( (char *)&header, sizeof(generic_header) );
+  file.close();
+  if ( header.nDims != dim ) throw std::string( "Error: " + filename + " is a " + std::to_string(header.nDims) + "D file, DIM is " + std::to_string(dim) + ".\n" );
+
+  const long long n[3] = { header.nDimX, ( dim > 1 ) ? header.nDimY : 1, ( dim > 2 ) ? header.nDimZ : 1 };
+  const double N = double(n[0])*n[1]*n[2];
+
+  std::string engine = "grid";
+  try
+  {
+    engine = params.Get_simulation("ENGINE");
+  }
+  catch (std::string &str)
+  {
+  }
+  const int S = internal_dim;
+  const int members = std::max( 1, params.Get_Ensemble_Size() );
+  const int orders = ( engine == "lattice" ) ? 2*int(params.Get_Algorithm("LATTICE_ORDERS",3))+1 : 1;
+  const int fields = S*members*orders;
+  int processes = 1;
+#ifdef TALISES_MPI
+  if ( dim > 1 ) MPI_Comm_size( MPI_COMM_WORLD, &processes );
+#endif
+
+  std::cout << "Dry run: " << dim << "D grid";
+  for ( int a=0; a<dim; a++ )
+    std::cout << ( a == 0 ? " " : " x " ) << n[a];
+  std::cout << ", " << S << " internal states, " << engine << " engine";
+  if ( members > 1 ) std::cout << ", " << members << " members";
+  if ( orders > 1 ) std::cout << ", " << orders << " momentum orders";
+  std::cout << ", " << omp_get_max_threads() << " threads";
+  if ( processes > 1 ) std::cout << ", " << processes << " processes";
+  std::cout << "\n";
+
+  // memory of the fields, the kinetic operators, the external potentials and the evaluated Hamiltonian
+  size_t nNum = 0;
+  bool matrix = false;
+  for ( auto &seq : params.m_sequence )
+  {
+    nNum = std::max( nNum, 2*seq.V_real.size() );
+    if ( seq.name == "interact" ) matrix = true;
+  }
+  // interleaved internal states (LAYOUT=1) need one more field as scratch
+  const bool interleaved = ( engine == "grid" && members == 1 && processes == 1 && S > 1
+                             && params.Get_Algorithm("LAYOUT",0) == 1 && params.Get_Algorithm("REGRID",0) == 0 );
+  const double field_bytes = N*sizeof(fftw_complex)*( interleaved ? fields+1 : fields );
+  // all engines keep one table per axis and order unless the grid is distributed, which the ensemble engine never is
+  const bool distributed = ( processes > 1 && members == 1 && ( engine == "lattice" || S <= TALISES_STATIC_STATES ) );
+  const double kinetic_bytes = distributed ? 2*N*sizeof(fftw_complex)*orders : 4*sizeof(double)*double(n[0]+n[1]+n[2])*orders;
+  const double potential_bytes = ( engine == "grid" && members == 1 ) ? N*sizeof(double)*S : 0;
+  const double hamiltonian_bytes = N*sizeof(double)*nNum;
+  const double lattice_bytes = ( orders > 1 ) ? N*sizeof(fftw_complex)*double(fields)*fields : 0;
+  const double total_bytes = field_bytes + kinetic_bytes + potential_bytes + hamiltonian_bytes + lattice_bytes;
+
+  std::cout << "Memory" << ( processes > 1 ? " per process" : "" ) << ": fields " << Bytes(field_bytes/processes)
+            << ", kinetic operators " << Bytes(kinetic_bytes/processes);
+  if ( potential_bytes > 0 ) std::cout << ", potentials " << Bytes(potential_bytes/processes);
+  std::cout << ", Hamiltonian " << Bytes(hamiltonian_bytes/processes);
+  if ( lattice_bytes > 0 ) std::cout << ", lattice exponentials " << Bytes(lattice_bytes/processes) << " (position dependent)";
+  std::cout << "\nPeak memory (estimate): " << Bytes(total_bytes/processes) << "\n";
+
+  // calibration of the kernels
+  kernel_costs cost;
+  cost.fft = Calibrate_FFT( n, dim )/processes;
+  cost.point = Calibrate_Point()/processes;
+  const int D = S*orders;
+  cost.exp = ( matrix || orders > 1 ) ? Calibrate_Exp( D )/processes : 0;
+  std::cout << "Calibration: transform " << std::scientific << std::setprecision(2) << cost.fft << " s, phase factor "
+            << cost.point << " s/point";
+  if ( cost.exp > 0 ) std::cout << ", " << D << "x" << D << " matrix exponential " << cost.exp << " s/point";
+  std::cout << std::defaultfloat << "\n";
+  if ( processes > 1 ) std::cout << "FYI: the communication of the distributed transforms is not included\n";
+
+  std::cout << std::left << std::setw(4) << "seq" << std::setw(14) << "name" << std::right << std::setw(12) << "steps"
+            << std::setw(22) << "Hamiltonian depends on" << std::setw(12) << "transforms" << std::setw(14) << "evaluations"
+            << std::setw(14) << "matrix exps" << std::setw(12) << "output" << std::setw(12) << "time" << "\n";
+
+  double total_time = 0, total_output = 0;
+  int seq_no = 0;
+  for ( auto &seq : params.m_sequence )
+  {
+    seq_no++;
+    if ( seq.name == "set_momentum" || seq.V_real.empty() ) continue;
+
+    double max_duration = 0;
+    for ( double d : seq.duration )
+      max_duration = std::max( max_duration, d );
+    const long long Nk = std::max( 1, seq.Nk );
+    const long long Na = (long long)(max_duration/seq.dt)/Nk;
+    const double steps = double(Na)*Nk;
+
+    // classify the Hamiltonian by its variables
+    std::string expression;
+    for ( unsigned i=0; i<seq.V_real.size(); i++ )
+      expression += ( i == 0 ? "" : "," ) + seq.V_real[i] + "," + ( i < seq.V_imag.size() ? seq.V_imag[i] : std::string("0") );
+
+    mu::Parser parser;
+    params.Setup_muParser( parser );
+    parser.DefineConst( "pi", (double)M_PI );
+    parser.DefineConst( "e", (double)M_E );
+    std::vector<std::string> names;
+    bool position = false, time = false, nonlinear = false, member = false;
+    try
+    {
+      parser.SetExpr( expression );
+      for ( auto &var : parser.GetUsedVar() )
+      {
+        names.push_back( var.first );
+        if ( var.first == "x" || var.first == "y" || var.first == "z" ) position = true;
+        else if ( var.first == "t" ) time = true;
+        else if ( var.first.rfind("psi_",0) == 0 ) nonlinear = true;
+        else if ( params.m_map_ensemble.count(var.first) ) member = true;
+      }
+    }
+    catch (mu::Parser::exception_type &e)
+    {
+      std::cout << "FYI: sequence " << seq_no << ": " << e.GetMsg() << "\n";
+    }
+    std::vector<double> vars( names.size() );
+    for ( unsigned v=0; v<names.size(); v++ )
+      parser.DefineVar( names[v], &vars[v] );
+    cost.parse = Calibrate_Parser( parser, vars );
+
+    std::string depends;
+    if ( time ) depends += "t ";
+    if ( position ) depends += "x ";
+    if ( nonlinear ) depends += "psi ";
+    if ( member ) depends += "member ";
+    if ( depends.empty() ) depends = "constant";
+    else depends.pop_back();
+
+    // transforms: each block has Nk+1 kinetic steps, one transform forth and back per field
+    const double transforms = double(Na)*(Nk+1)*2*fields;
+    // the parser is evaluated at each point for position dependent or nonlinear Hamiltonians (once per step and member else)
+    const double evaluations = steps*members*( ( position || nonlinear ) ? N : 1 );
+    const bool interact = ( seq.name == "interact" || orders > 1 );
+    const double exps = interact ? steps*members*( ( position || nonlinear || orders == 1 ) ? N : 1 ) : 0;
+
+    double seconds = transforms*cost.fft + double(Na)*(Nk+1)*fields*N*cost.point + evaluations*cost.parse;
+    if ( interact ) seconds += exps*cost.exp + ( orders > 1 ? steps*N*D*cost.point : 0 );
+    else seconds += steps*fields*N*cost.point;
+
+    // output files: one per state (and member or order) after each block or at the end
+    double output = 0;
+    if ( seq.output_freq == freq::each || seq.output_freq == freq::packed ) output = double(Na)*fields*(N*sizeof(fftw_complex)+sizeof(generic_header));
+    else if ( seq.output_freq == freq::last ) output = fields*(N*sizeof(fftw_complex)+sizeof(generic_header));
+
+    std::cout << std::left << std::setw(4) << seq_no << std::setw(14) << seq.name.substr(0,13) << std::right << std::setw(12) << steps
+              << std::setw(22) << depends << std::setprecision(3) << std::setw(12) << transforms << std::setw(14) << evaluations
+              << std::setw(14) << exps << std::setw(12) << Bytes(output) << std::setw(12) << Duration(seconds) << "\n";
+    total_time += seconds;
+    total_output += output;
+  }
+
+  std::cout << "Total: " << Duration(total_time) << " (estimate), output files " << Bytes(total_output) << "\n";
+  std::cout << "FYI: separable Hamiltonians are tabulated and evaluated faster than estimated, nothing was propagated\n";
+}
@@ -0,0 +1,339 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#include "field_alloc.h"
+#include <iostream>
+#include <cstdio>
+#include <vector>
+#include <map>
+#include <cassert>
+#include <cstdlib>
+#include <omp.h>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+Arena::Arena() : m_base(nullptr), m_size(0)
+{
+  for ( int r=0; r<2; r++ )
+  {
+    m_begin[r] = m_end[r] = m_next[r] = 0;
+    m_overflow[r] = false;
+  }
+}
+
+Arena::~Arena()
+{
+  if ( m_base == nullptr ) return;
+#ifdef __linux__
+  munmap( m_base, m_size );
+#else
+  free( m_base );
+#endif
+}
+
+/** Map the arena
+  *
+  * The mapping is backed by explicit huge pages of the requested size if the kernel provides them, otherwise
+  * transparent huge pages are requested with madvise. Fails with an exception if the working set exceeds the
+  * available memory. Only the first call has an effect.
+  * @param persistent_bytes Size of the persistent region
+  * @param scratch_bytes Size of the scratch region
+  * @param hugepage_mb Size of the huge pages in MB (2 or 1024, 0 for normal pages)
+  */
+void Arena::Reserve( const size_t persistent_bytes, const size_t scratch_bytes, const int hugepage_mb )
+{
+  if ( m_base != nullptr ) return;
+
+  const size_t align = 64;
+  const size_t sizes[2] = { (persistent_bytes+align-1)/align*align, (scratch_bytes+align-1)/align*align };
+  const size_t total = sizes[0] + sizes[1];
+  const size_t available = Available_Memory();
+
+  if ( available > 0 && total > available )
+  {
+    std::ostringstream str;
+    str << "Error: the run needs " << (total>>20) << " MB of memory but only " << (available>>20) << " MB are available.\n";
+    throw str.str();
+  }
+
+  std::string backing;
+#ifdef __linux__
+  const size_t huge = size_t(( hugepage_mb >= 1024 ) ? 1024 : 2) << 20;
+  void *ptr = MAP_FAILED;
+  m_size = total;
+#ifdef MAP_HUGETLB
+  if ( hugepage_mb >= 1024 )
+  {
+    m_size = (total+huge-1)/huge*huge;
+    ptr = mmap( nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (30 << MAP_HUGE_SHIFT), -1, 0 );
+    backing = "1 GB huge pages";
+  }
+  if ( ptr == MAP_FAILED && hugepage_mb >= 2 )
+  {
+    m_size = (total+(size_t(2)<<20)-1)/(size_t(2)<<20)*(size_t(2)<<20);
+    ptr = mmap( nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0 );
+    backing = "2 MB huge pages";
+  }
+#endif
+  if ( ptr == MAP_FAILED )
+  {
+    m_size = ( hugepage_mb > 0 ) ? (total+huge-1)/huge*huge : total;
+    ptr = mmap( nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    backing = "normal pages";
+#ifdef MADV_HUGEPAGE
+    if ( ptr != MAP_FAILED && hugepage_mb > 0 && madvise( ptr, m_size, MADV_HUGEPAGE ) == 0 ) backing = "transparent huge pages";
+#endif
+  }
+  if ( ptr == MAP_FAILED )
+  {
+    std::ostringstream str;
+    str << "Error: could not map " << (total>>20) << " MB of memory for the solver arena.\n";
+    throw str.str();
+  }
+  m_base = static_cast<char *>(ptr);
+#else
+  m_size = total;
+  if ( posix_memalign( (void **)&m_base, align, m_size ) != 0 )
+    throw std::string( "Error: could not allocate memory for the solver arena.\n" );
+  backing = "normal pages";
+#endif
+
+  m_begin[arena_persistent] = 0;
+  m_end[arena_persistent] = sizes[0];
+  m_begin[arena_scratch] = sizes[0];
+  m_end[arena_scratch] = total;
+  for ( int r=0; r<2; r++ )
+  {
+    m_next[r] = m_begin[r];
+    m_overflow[r] = false;
+  }
+
+  char str[256];
+  snprintf( str, sizeof(str), "FYI: solver arena     : %.1f MB (%.1f MB persistent, %.1f MB scratch) on %s\n",
+            double(total)/1048576.0, double(sizes[0])/1048576.0, double(sizes[1])/1048576.0, backing.c_str() );
+  std::cout << str;
+}
+
+/** Take a buffer from a region of the arena
+  *
+  * @param bytes Size of the buffer
+  * @param region arena_persistent or arena_scratch (see arena_region)
+  * @return 64 byte aligned buffer or nullptr if the arena is not reserved or the region is full
+  */
+void *Arena::Allocate( const size_t bytes, const int region )
+{
+  if ( m_base == nullptr ) return nullptr;
+
+  const size_t offset = (m_next[region]+63)/64*64;
+  if ( offset + bytes > m_end[region] )
+  {
+    if ( !m_overflow[region] )
+      std::cout << "FYI: solver arena full, further " << ( region == arena_persistent ? "persistent" : "scratch" ) << " buffers are allocated on the heap\n";
+    m_overflow[region] = true;
+    return nullptr;
+  }
+  m_next[region] = offset + bytes;
+  return m_base + offset;
+}
+
+/** Release all buffers of the scratch region
+  *
+  * Buffers taken from the scratch region must not be used afterwards.
+  */
+void Arena::Reset_Scratch()
+{
+  m_next[arena_scratch] = m_begin[arena_scratch];
+}
+
+/// The arena shared by all solver buffers
+Arena &Solver_Arena()
+{
+  static Arena arena;
+  return arena;
+}
+
+/// Memory available for new allocations in bytes (MemAvailable of /proc/meminfo, 0 if unknown)
+size_t Available_Memory()
+{
+  std::ifstream meminfo( "/proc/meminfo" );
+  std::string key;
+  size_t value;
+  std::string unit;
+  while ( meminfo >> key >> value >> unit )
+  {
+    if ( key == "MemAvailable:" ) return value << 10;
+  }
+#ifdef _SC_AVPHYS_PAGES
+  const long pages = sysconf(_SC_AVPHYS_PAGES);
+  if ( pages > 0 ) return size_t(pages)*size_t(sysconf(_SC_PAGESIZE));
+#endif
+  return 0;
+}
+
+/** Free a buffer of Alloc_Complex() or Alloc_Real()
+  *
+  * Buffers in the arena are released with the arena.
+  */
+void Free_Buffer( void *ptr )
+{
+  if ( !Solver_Arena().Contains(ptr) ) fftw_free( ptr );
+}
+
+/** Allocates n complex values in the persistent region of the arena (or with fftw_alloc_complex) and zeroes them with First_Touch()
+  *
+  * @param n Number of complex values
+  */
+fftw_complex *Alloc_Complex( const int64_t n )
+{
+  fftw_complex *retval = static_cast<fftw_complex *>( Solver_Arena().Allocate( n*sizeof(fftw_complex), arena_persistent ) );
+  if ( retval == nullptr ) retval = fftw_alloc_complex( n );
+  assert( retval != nullptr );
+  First_Touch( retval, n*sizeof(fftw_complex) );
+  return retval;
+}
+
+/** Allocates n real values like Alloc_Complex()
+  *
+  * @param n Number of real values
+  */
+double *Alloc_Real( const int64_t n )
+{
+  double *retval = static_cast<double *>( Solver_Arena().Allocate( n*sizeof(double), arena_persistent ) );
+  if ( retval == nullptr ) retval = fftw_alloc_real( n );
+  assert( retval != nullptr );
+  First_Touch( retval, n*sizeof(double) );
+  return retval;
+}
+
+/** Zeroes a buffer in parallel with a static partitioning
+  *
+  * A kernel which processes element l of an array of N elements with <tt>#pragma omp for</tt> accesses the
+  * same bytes as First_Touch() on the same thread, independent of the size of the elements.
+  * @param ptr Start of the buffer
+  * @param bytes Size of the buffer in bytes (a multiple of sizeof(double))
+  */
+void First_Touch( void *ptr, const size_t bytes )
+{
+  double *data = static_cast<double *>(ptr);
+  const int64_t n = bytes/sizeof(double);
+
+  #pragma omp parallel for schedule(static)
+  for ( int64_t i=0; i<n; i++ )
+    data[i] = 0;
+}
+
+/** Binds each OpenMP thread to a single CPU of the ones available to the process
+  *
+  * Has to be called after omp_set_num_threads() and before the fields are allocated. Thread placement set with
+  * OMP_PROC_BIND or OMP_PLACES takes precedence.
+  * @param mode compact (thread i on the i-th CPU) or spread (threads distributed evenly over the CPUs),
+  *             anything else leaves the placement to the operating system
+  * @return true if the threads were bound
+  */
+bool Set_Thread_Affinity( const std::string &mode )
+{
+  if ( mode != "compact" && mode != "spread" ) return false;
+  if ( getenv("OMP_PROC_BIND") != nullptr || getenv("OMP_PLACES") != nullptr )
+  {
+    std::cout << "FYI: AFFINITY ignored, thread placement is set by OMP_PROC_BIND/OMP_PLACES\n";
+    return false;
+  }
+#ifdef __linux__
+  cpu_set_t allowed;
+  if ( sched_getaffinity( 0, sizeof(allowed), &allowed ) != 0 ) return false;
+
+  std::vector<int> cpus;
+  for ( int c=0; c<CPU_SETSIZE; c++ )
+    if ( CPU_ISSET( c, &allowed ) ) cpus.push_back(c);
+  if ( cpus.empty() ) return false;
+
+  bool retval = true;
+  #pragma omp parallel reduction(&&:retval)
+  {
+    const long long t = omp_get_thread_num();
+    const long long P = omp_get_num_threads();
+    const long long C = cpus.size();
+    const int cpu = ( mode == "compact" ) ? cpus[t % C] : cpus[(t*C)/P];
+
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    CPU_SET( cpu, &set );
+    retval = ( sched_setaffinity( 0, sizeof(set), &set ) == 0 );
+  }
+  std::cout << "FYI: threads bound to CPUs (" << mode << ")\n";
+  return retval;
+#else
+  std::cout << "FYI: AFFINITY is only supported on Linux\n";
+  return false;
+#endif
+}
+
+/** Prints the fraction of the pages of a buffer on each NUMA node
+  *
+  * The nodes are queried with move_pages(2) without moving the pages.
+  * @param name Name of the buffer in the output
+  * @param ptr Start of the buffer
+  * @param bytes Size of the buffer in bytes
+  */
+void Report_Pages( const std::string &name, const void *ptr, const size_t bytes )
+{
+#if defined(__linux__) && defined(SYS_move_pages)
+  const uintptr_t page = sysconf(_SC_PAGESIZE);
+  const uintptr_t first = reinterpret_cast<uintptr_t>(ptr) & ~(page-1);
+  const uintptr_t last = reinterpret_cast<uintptr_t>(ptr) + bytes;
+
+  std::vector<void *> pages;
+  for ( uintptr_t p=first; p<last; p+=page )
+    pages.push_back( reinterpret_cast<void *>(p) );
+  std::vector<int> status( pages.size(), -1 );
+
+  if ( pages.empty() || syscall( SYS_move_pages, 0, pages.size(), pages.data(), nullptr, status.data(), 0 ) != 0 )
+  {
+    std::cout << "FYI: NUMA placement of " << name << " unknown\n";
+    return;
+  }
+
+  std::map<int,size_t> count;
+  for ( auto s : status )
+    count[s]++;
+
+  std::cout << "FYI: NUMA placement of " << name << ":";
+  for ( auto it : count )
+  {
+    char str[64];
+    if ( it.first >= 0 )
+      snprintf( str, sizeof(str), " node %d %.1f%%", it.first, 100.0*double(it.second)/double(pages.size()) );
+    else
+      snprintf( str, sizeof(str), " not present %.1f%%", 100.0*double(it.second)/double(pages.size()) );
+    std::cout << str;
+  }
+  std::cout << "\n";
+#else
+  std::cout << "FYI: NUMA placement of " << name << " unknown\n";
+#endif
+}
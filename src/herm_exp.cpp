@@ -0,0 +1,519 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#include "herm_exp.h"
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+
+/** Constructor
+  *
+  * @param size Size of the matrices
+  */
+herm_workspace::herm_workspace( const int size ) : n(size)
+{
+  const size_t len = (size_t)n*n*herm_block;
+  re.assign( len, 0.0 );
+  im.assign( len, 0.0 );
+  vre.assign( len, 0.0 );
+  vim.assign( len, 0.0 );
+}
+
+/// Set all matrices of the block to zero
+void herm_workspace::Set_Zero()
+{
+  std::fill( re.begin(), re.end(), 0.0 );
+  std::fill( im.begin(), im.end(), 0.0 );
+}
+
+/** Set the elements (i,j) and (j,i) of the matrix of point b
+  *
+  * @param b Point in the block
+  * @param i Row
+  * @param j Column (the conjugate is stored at (j,i))
+  * @param r Real part
+  * @param c Imaginary part (ignored on the diagonal)
+  */
+void herm_workspace::Set( const int b, const int i, const int j, const double r, const double c )
+{
+  re[(i*n+j)*herm_block+b] = r;
+  re[(j*n+i)*herm_block+b] = r;
+  im[(i*n+j)*herm_block+b] = ( i == j ) ? 0.0 : c;
+  im[(j*n+i)*herm_block+b] = ( i == j ) ? 0.0 : -c;
+}
+
+/** Computes \f$ \exp(i\,dt\,H) \f$ for the Hermitian matrices of a block of points
+  *
+  * Each rotation of a sweep zeroes the element (p,q) of all matrices of the block. The phase of the element is
+  * removed first, which leaves a real symmetric 2x2 problem for the rotation angle. The sweeps end when the
+  * off-diagonal elements of all matrices are negligible. With \f$ H = V \Lambda V^\dagger \f$ the exponential
+  * is \f$ V \exp(i\,dt\,\Lambda) V^\dagger \f$.
+  * @param ws Workspace holding the matrices of the block on input and their exponentials on return
+  * @param count Number of valid points in the block, the matrices of the other points are set to zero
+  * @param dt Factor of the exponent
+  */
+void Exp_Hermitian( herm_workspace &ws, const int count, const double dt )
+{
+  const int n = ws.n;
+  const int B = herm_block;
+  double * const ar = ws.re.data();
+  double * const ai = ws.im.data();
+  double * const vr = ws.vre.data();
+  double * const vi = ws.vim.data();
+
+  for ( int e=0; e<n*n; e++ )
+  {
+    for ( int b=count; b<B; b++ )
+    {
+      ar[e*B+b] = 0;
+      ai[e*B+b] = 0;
+    }
+  }
+  std::fill( ws.vre.begin(), ws.vre.end(), 0.0 );
+  std::fill( ws.vim.begin(), ws.vim.end(), 0.0 );
+  for ( int i=0; i<n; i++ )
+    for ( int b=0; b<B; b++ )
+      vr[(i*n+i)*B+b] = 1;
+
+  double c[B], s[B], er[B], ei[B];
+
+  for ( int sweep=0; sweep<50; sweep++ )
+  {
+    double off = 0, norm = 0;
+    for ( int p=0; p<n; p++ )
+    {
+      for ( int b=0; b<B; b++ )
+        norm += ar[(p*n+p)*B+b]*ar[(p*n+p)*B+b];
+      for ( int q=p+1; q<n; q++ )
+        for ( int b=0; b<B; b++ )
+          off += ar[(p*n+q)*B+b]*ar[(p*n+q)*B+b] + ai[(p*n+q)*B+b]*ai[(p*n+q)*B+b];
+    }
+    if ( off <= 1e-30*(norm+off) ) break;
+
+    for ( int p=0; p<n; p++ )
+    {
+      for ( int q=p+1; q<n; q++ )
+      {
+        // rotation angle and phase e^{-i phi} of the element (p,q) of each point
+        for ( int b=0; b<B; b++ )
+        {
+          const double gr = ar[(p*n+q)*B+b];
+          const double gi = ai[(p*n+q)*B+b];
+          const double g = std::sqrt( gr*gr + gi*gi );
+          const bool rot = ( g > 0 );
+          const double inv = rot ? 1/g : 0;
+          const double theta = rot ? 0.5*std::atan2( 2*g, ar[(q*n+q)*B+b] - ar[(p*n+p)*B+b] ) : 0;
+          er[b] = rot ? gr*inv : 1;
+          ei[b] = rot ? -gi*inv : 0;
+          c[b] = std::cos(theta);
+          s[b] = std::sin(theta);
+        }
+
+        // columns p and q of the matrices and of the eigenvectors
+        for ( int k=0; k<n; k++ )
+        {
+          double *xr[2] = { ar + (k*n)*B, vr + (k*n)*B };
+          double *xi[2] = { ai + (k*n)*B, vi + (k*n)*B };
+          for ( int m=0; m<2; m++ )
+          {
+            double *pr = xr[m] + p*B, *pi = xi[m] + p*B, *qr = xr[m] + q*B, *qi = xi[m] + q*B;
+            #pragma omp simd
+            for ( int b=0; b<B; b++ )
+            {
+              const double tr = qr[b]*er[b] - qi[b]*ei[b];
+              const double ti = qr[b]*ei[b] + qi[b]*er[b];
+              const double ur = pr[b], ui = pi[b];
+              pr[b] = c[b]*ur - s[b]*tr;
+              pi[b] = c[b]*ui - s[b]*ti;
+              qr[b] = s[b]*ur + c[b]*tr;
+              qi[b] = s[b]*ui + c[b]*ti;
+            }
+          }
+        }
+
+        // rows p and q of the matrices
+        for ( int k=0; k<n; k++ )
+        {
+          double *pr = ar + (p*n+k)*B, *pi = ai + (p*n+k)*B, *qr = ar + (q*n+k)*B, *qi = ai + (q*n+k)*B;
+          #pragma omp simd
+          for ( int b=0; b<B; b++ )
+          {
+            const double tr = qr[b]*er[b] + qi[b]*ei[b];
+            const double ti = qi[b]*er[b] - qr[b]*ei[b];
+            const double ur = pr[b], ui = pi[b];
+            pr[b] = c[b]*ur - s[b]*tr;
+            pi[b] = c[b]*ui - s[b]*ti;
+            qr[b] = s[b]*ur + c[b]*tr;
+            qi[b] = s[b]*ui + c[b]*ti;
+          }
+        }
+
+        for ( int b=0; b<B; b++ )
+        {
+          ar[(p*n+q)*B+b] = ar[(q*n+p)*B+b] = 0;
+          ai[(p*n+q)*B+b] = ai[(q*n+p)*B+b] = 0;
+          ai[(p*n+p)*B+b] = ai[(q*n+q)*B+b] = 0;
+        }
+      }
+    }
+  }
+
+  // U = V exp(i dt Lambda) V^+
+  std::vector<double> phr( (size_t)n*B ), phi( (size_t)n*B );
+  for ( int k=0; k<n; k++ )
+  {
+    for ( int b=0; b<B; b++ )
+    {
+      phr[k*B+b] = std::cos( dt*ar[(k*n+k)*B+b] );
+      phi[k*B+b] = std::sin( dt*ar[(k*n+k)*B+b] );
+    }
+  }
+
+  for ( int i=0; i<n; i++ )
+  {
+    for ( int j=0; j<n; j++ )
+    {
+      double sr[B] = {}, si[B] = {};
+      for ( int k=0; k<n; k++ )
+      {
+        const double *v1r = vr + (i*n+k)*B, *v1i = vi + (i*n+k)*B;
+        const double *v2r = vr + (j*n+k)*B, *v2i = vi + (j*n+k)*B;
+        const double *fr = phr.data() + k*B, *fi = phi.data() + k*B;
+        #pragma omp simd
+        for ( int b=0; b<B; b++ )
+        {
+          // V_ik e_k conj(V_jk)
+          const double tr = v1r[b]*fr[b] - v1i[b]*fi[b];
+          const double ti = v1r[b]*fi[b] + v1i[b]*fr[b];
+          sr[b] += tr*v2r[b] + ti*v2i[b];
+          si[b] += ti*v2r[b] - tr*v2i[b];
+        }
+      }
+      for ( int b=0; b<B; b++ )
+      {
+        ar[(i*n+j)*B+b] = sr[b];
+        ai[(i*n+j)*B+b] = si[b];
+      }
+    }
+  }
+}
+
+/** Multiplies the wavefunction at consecutive points by the matrix of point 0 of a workspace
+  *
+  * Used if the exponential is the same for all points. If the states are stored in separate arrays, the
+  * product is formed as a sum over the columns, each of which is a vectorisable loop over the points. If they
+  * are interleaved, the values of each point are contiguous and multiplied by the matrix in place.
+  * @param E Workspace holding the matrix at point 0, e.g. an exponential from Exp_Hermitian()
+  * @param Psi Wavefunctions of all states
+  * @param st Offset between two points of a state (see CRT_Base::Field())
+  * @param l0 First point
+  * @param count Number of points (at most herm_apply)
+  * @param out Buffer of the calling thread
+  */
+void Apply_Matrix( const herm_workspace &E, fftw_complex * const *Psi, const int st, const int l0, const int count, std::vector<double> &out )
+{
+  const int n = E.n;
+
+  if ( st != 1 )
+  {
+    out.resize( 2*(size_t)n );
+    for ( int b=0; b<count; b++ )
+    {
+      const size_t l = (size_t)(l0+b)*st;
+      for ( int j=0; j<n; j++ )
+      {
+        out[2*j] = Psi[j][l][0];
+        out[2*j+1] = Psi[j][l][1];
+      }
+      for ( int i=0; i<n; i++ )
+      {
+        double re = 0, im = 0;
+        for ( int j=0; j<n; j++ )
+        {
+          const double ur = E.re[(i*n+j)*herm_block];
+          const double ui = E.im[(i*n+j)*herm_block];
+          re += ur*out[2*j] - ui*out[2*j+1];
+          im += ur*out[2*j+1] + ui*out[2*j];
+        }
+        Psi[i][l][0] = re;
+        Psi[i][l][1] = im;
+      }
+    }
+    return;
+  }
+
+  out.assign( 2*(size_t)n*count, 0.0 );
+
+  for ( int i=0; i<n; i++ )
+  {
+    double *o = out.data() + 2*(size_t)i*count;
+    for ( int j=0; j<n; j++ )
+    {
+      const double ur = E.re[(i*n+j)*herm_block];
+      const double ui = E.im[(i*n+j)*herm_block];
+      if ( ur == 0 && ui == 0 ) continue;
+      const double *in = Psi[j][l0];
+
+      #pragma omp simd
+      for ( int b=0; b<count; b++ )
+      {
+        o[2*b] += ur*in[2*b] - ui*in[2*b+1];
+        o[2*b+1] += ur*in[2*b+1] + ui*in[2*b];
+      }
+    }
+  }
+  for ( int i=0; i<n; i++ )
+    std::copy( out.data() + 2*(size_t)i*count, out.data() + 2*(size_t)(i+1)*count, Psi[i][l0] );
+}
+
+/// Returns true if an expression is a literal zero like "0", " 0.0 " or "-0"
+static bool Is_Zero( const std::string &expr )
+{
+  const char *str = expr.c_str();
+  char *end;
+  const double val = std::strtod( str, &end );
+  if ( end == str ) return false;
+  while ( *end == ' ' || *end == '\t' || *end == '\n' || *end == '\r' ) end++;
+  return ( *end == 0 && val == 0 );
+}
+
+/** Finds the blocks of a Hamiltonian from the zero pattern of its matrix elements
+  *
+  * @param V_real Real parts of the upper triangle (row by row)
+  * @param V_imag Imaginary parts of the upper triangle
+  * @param size Number of states
+  * @param pair Propagate blocks of more than two states with the product of the single couplings
+  * @return sparse
+  */
+bool coupling_graph::Setup( const std::vector<std::string> &V_real, const std::vector<std::string> &V_imag, const int size, const bool pair )
+{
+  n = size;
+  pairwise = pair;
+  sparse = false;
+  diag.clear();
+  blocks.clear();
+  couplings.clear();
+  if ( V_real.size() != size_t(n*(n+1)/2) || V_imag.size() != V_real.size() ) return false;
+
+  // union-find over the couplings
+  std::vector<int> root(n);
+  for ( int i=0; i<n; i++ )
+    root[i] = i;
+  auto find = [&root]( int i ) { while ( root[i] != i ) i = root[i] = root[root[i]]; return i; };
+
+  std::vector<coupling> all;
+  int e = 0;
+  for ( int i=0; i<n; i++ )
+  {
+    for ( int j=i; j<n; j++, e++ )
+    {
+      if ( i == j )
+      {
+        diag.push_back(e);
+        continue;
+      }
+      if ( Is_Zero(V_real[e]) && Is_Zero(V_imag[e]) ) continue;
+      all.push_back( { i, j, e } );
+      root[find(i)] = find(j);
+    }
+  }
+
+  std::vector<int> index( n, -1 );
+  size_t largest = 0;
+  for ( int i=0; i<n; i++ )
+  {
+    int &k = index[find(i)];
+    if ( k < 0 )
+    {
+      k = blocks.size();
+      blocks.emplace_back();
+      couplings.emplace_back();
+    }
+    blocks[k].push_back(i);
+    largest = std::max( largest, blocks[k].size() );
+  }
+  for ( auto c : all )
+    couplings[index[find(c.i)]].push_back(c);
+
+  sparse = ( blocks.size() > 1 || ( pairwise && largest > 2 ) );
+  if ( sparse )
+    std::cout << "FYI: " << all.size() << " couplings in " << blocks.size() << " blocks of at most " << largest << " states" << ( pairwise ? ", propagated pairwise\n" : "\n" );
+  return sparse;
+}
+
+/// Workspaces of Propagate() for one thread
+std::vector<herm_workspace> coupling_graph::Workspaces() const
+{
+  std::vector<herm_workspace> retval;
+  for ( auto &blk : blocks )
+    retval.emplace_back( ( blk.size() > 2 && !pairwise ) ? int(blk.size()) : 0 );
+  return retval;
+}
+
+/** Applies \f$ \exp(i\,dt\,H) \f$ to the wavefunction at up to herm_block consecutive points
+  *
+  * @param Psi Wavefunctions of all states
+  * @param st Offset between two points of a state (see CRT_Base::Field())
+  * @param l0 First point
+  * @param count Number of points (at most herm_block)
+  * @param V_eval Upper triangles of the Hamiltonian of all points (pairs of real and imaginary part)
+  * @param stride Offset between the Hamiltonians of two points (0 if the same for all points)
+  * @param phi Contact interactions added to the diagonal, phi[b*n+i] for point l0+b and state i (may be nullptr)
+  * @param dt Factor of the exponent
+  * @param ws Workspaces from Workspaces()
+  */
+void coupling_graph::Propagate( fftw_complex * const *Psi, const int st, const int l0, const int count, const double *V_eval, const int stride, const double *phi, const double dt, std::vector<herm_workspace> &ws ) const
+{
+  double re1, im1, tmp1;
+
+  for ( size_t k=0; k<blocks.size(); k++ )
+  {
+    const std::vector<int> &blk = blocks[k];
+    const int m = blk.size();
+
+    if ( m == 1 )
+    {
+      const int s = blk[0];
+      for ( int b=0; b<count; b++ )
+      {
+        const int l = l0+b;
+        const int lp = l*st;
+        const double a = V_eval[(size_t)l*stride + 2*diag[s]] + ( phi ? phi[b*n+s] : 0.0 );
+        sincos( dt*a, &im1, &re1 );
+        tmp1 = Psi[s][lp][0];
+        Psi[s][lp][0] = Psi[s][lp][0]*re1 - Psi[s][lp][1]*im1;
+        Psi[s][lp][1] = Psi[s][lp][1]*re1 + tmp1*im1;
+      }
+    }
+    else if ( m == 2 )
+    {
+      // exp(i dt H) = exp(i dt c) ( cos(dt W) + i sin(dt W)/W (H - c) ) with c the mean of the diagonal
+      const int i = blk[0], j = blk[1], e = couplings[k][0].e;
+      for ( int b=0; b<count; b++ )
+      {
+        const int l = l0+b;
+        const int lp = l*st;
+        const double *V = V_eval + (size_t)l*stride;
+        const double a = V[2*diag[i]] + ( phi ? phi[b*n+i] : 0.0 );
+        const double d = V[2*diag[j]] + ( phi ? phi[b*n+j] : 0.0 );
+        const double vr = V[2*e], vi = V[2*e+1];
+        const double c = 0.5*(a+d), h = 0.5*(a-d);
+        const double W = std::sqrt( h*h + vr*vr + vi*vi );
+        double cw, sw;
+        sincos( dt*W, &sw, &cw );
+        sw = ( W > 0 ) ? sw/W : dt;
+        sincos( dt*c, &im1, &re1 );
+
+        // U = [[cw + i sw h, i sw v],[i sw conj(v), cw - i sw h]]
+        const double pr = Psi[i][lp][0], pi = Psi[i][lp][1], qr = Psi[j][lp][0], qi = Psi[j][lp][1];
+        const double ur = cw*pr - sw*h*pi - sw*(vr*qi + vi*qr);
+        const double ui = cw*pi + sw*h*pr + sw*(vr*qr - vi*qi);
+        const double wr = cw*qr + sw*h*qi - sw*(vr*pi - vi*pr);
+        const double wi = cw*qi - sw*h*qr + sw*(vr*pr + vi*pi);
+        Psi[i][lp][0] = ur*re1 - ui*im1;
+        Psi[i][lp][1] = ui*re1 + ur*im1;
+        Psi[j][lp][0] = wr*re1 - wi*im1;
+        Psi[j][lp][1] = wi*re1 + wr*im1;
+      }
+    }
+    else if ( pairwise )
+    {
+      const std::vector<coupling> &cpl = couplings[k];
+      const int E = cpl.size();
+      for ( int b=0; b<count; b++ )
+      {
+        const int l = l0+b;
+        const int lp = l*st;
+        const double *V = V_eval + (size_t)l*stride;
+
+        // exp(i dt/2 H_e) = [[cos, i sin v/|v|],[i sin conj(v)/|v|, cos]]
+        auto rotate = [&]( const coupling &c )
+        {
+          const double vr = V[2*c.e], vi = V[2*c.e+1];
+          const double r = std::sqrt( vr*vr + vi*vi );
+          if ( r == 0 ) return;
+          double cr, sr;
+          sincos( 0.5*dt*r, &sr, &cr );
+          const double wr = sr*vr/r, wi = sr*vi/r;
+          const double pr = Psi[c.i][lp][0], pi = Psi[c.i][lp][1], qr = Psi[c.j][lp][0], qi = Psi[c.j][lp][1];
+          Psi[c.i][lp][0] = cr*pr - wr*qi - wi*qr;
+          Psi[c.i][lp][1] = cr*pi + wr*qr - wi*qi;
+          Psi[c.j][lp][0] = cr*qr - wr*pi + wi*pr;
+          Psi[c.j][lp][1] = cr*qi + wr*pr + wi*pi;
+        };
+
+        for ( int c=0; c<E; c++ )
+          rotate( cpl[c] );
+        for ( auto s : blk )
+        {
+          const double a = V[2*diag[s]] + ( phi ? phi[b*n+s] : 0.0 );
+          sincos( dt*a, &im1, &re1 );
+          tmp1 = Psi[s][lp][0];
+          Psi[s][lp][0] = Psi[s][lp][0]*re1 - Psi[s][lp][1]*im1;
+          Psi[s][lp][1] = Psi[s][lp][1]*re1 + tmp1*im1;
+        }
+        for ( int c=E-1; c>=0; c-- )
+          rotate( cpl[c] );
+      }
+    }
+    else
+    {
+      // exact exponential of the block, the states are renumbered within the block
+      herm_workspace &w = ws[k];
+      std::vector<int> local( n, -1 );
+      for ( int p=0; p<m; p++ )
+        local[blk[p]] = p;
+
+      w.Set_Zero();
+      for ( int b=0; b<count; b++ )
+      {
+        const double *V = V_eval + (size_t)(l0+b)*stride;
+        for ( int p=0; p<m; p++ )
+          w.Set( b, p, p, V[2*diag[blk[p]]] + ( phi ? phi[b*n+blk[p]] : 0.0 ), 0.0 );
+        for ( auto &c : couplings[k] )
+          w.Set( b, local[c.i], local[c.j], V[2*c.e], V[2*c.e+1] );
+      }
+      Exp_Hermitian( w, count, dt );
+
+      std::vector<double> in( 2*m );
+      for ( int b=0; b<count; b++ )
+      {
+        const int l = l0+b;
+        const int lp = l*st;
+        for ( int p=0; p<m; p++ )
+        {
+          in[2*p] = Psi[blk[p]][lp][0];
+          in[2*p+1] = Psi[blk[p]][lp][1];
+        }
+        for ( int p=0; p<m; p++ )
+        {
+          double sr = 0, si = 0;
+          for ( int q=0; q<m; q++ )
+          {
+            const size_t e = (size_t)(p*m+q)*herm_block + b;
+            sr += w.re[e]*in[2*q] - w.im[e]*in[2*q+1];
+            si += w.re[e]*in[2*q+1] + w.im[e]*in[2*q];
+          }
+          Psi[blk[p]][lp][0] = sr;
+          Psi[blk[p]][lp][1] = si;
+        }
+      }
+    }
+  }
+}
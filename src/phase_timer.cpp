@@ -0,0 +1,333 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#include "phase_timer.h"
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+/// Names of the phases in the reports
+static const char *phase_names[ph_count] = { "fft", "fix/scale", "kinetic", "potential", "matrix exp", "nonlinear", "observables", "io" };
+
+/// Upper bound of the number of calls recorded per thread for the trace
+static const size_t max_events = 1000000;
+
+/// Names of the hardware counters in the reports
+static const char *counter_names[pc_count] = { "cycles", "instructions", "cache_references", "cache_misses" };
+
+/// Bytes moved from memory per cache miss
+static const double line_size = 64;
+
+/// Constructor, the timers are enabled without trace and counters
+Phase_Timers::Phase_Timers() : enabled(true), tracing(false), counting(false)
+{
+  m_threads = std::max( omp_get_max_threads(), omp_get_num_procs() );
+  m_fds.assign( m_threads*pc_count, -1 );
+  m_sequences.push_back("setup");
+  m_data.emplace_back( ph_count*m_threads, entry{} );
+  m_events.resize( m_threads );
+  m_t0 = omp_get_wtime();
+}
+
+/// Destructor, closes the counters
+Phase_Timers::~Phase_Timers()
+{
+#ifdef __linux__
+  for ( int fd : m_fds )
+    if ( fd >= 0 ) close( fd );
+#endif
+}
+
+/** Switches the timers and the trace on or off
+  *
+  * @param timers Time the phases
+  * @param trace Record every call for Write_Trace()
+  */
+void Phase_Timers::Enable( const bool timers, const bool trace )
+{
+  enabled = timers;
+  tracing = timers && trace;
+}
+
+/** Opens the hardware counters for each thread of the OpenMP team
+  *
+  * Must be called after the number of threads is set and outside of parallel regions. If the counters are not
+  * available (no Linux, no PMU in a virtual machine or a restrictive /proc/sys/kernel/perf_event_paranoid),
+  * only the times are measured.
+  * @return true if the counters are read
+  */
+bool Phase_Timers::Enable_Counters()
+{
+  if ( !enabled ) return false;
+#ifdef __linux__
+  const uint64_t config[pc_count] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES };
+  int error = 0;
+
+  // counters of the calling thread, hence each thread opens its own group
+  #pragma omp parallel reduction(max:error)
+  {
+    const int t = omp_get_thread_num();
+    int leader = -1, failed = 0;
+    for ( int c=0; c<pc_count && t<m_threads; c++ )
+    {
+      int &fd = m_fds[t*pc_count+c];
+      struct perf_event_attr attr;
+      memset( &attr, 0, sizeof(attr) );
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = config[c];
+      attr.disabled = ( c == 0 );
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+      fd = syscall( __NR_perf_event_open, &attr, 0, -1, leader, 0 );
+      if ( fd < 0 )
+      {
+        failed = errno;
+        break;
+      }
+      if ( c == 0 ) leader = fd;
+    }
+    if ( leader >= 0 && failed == 0 ) ioctl( leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+    error = std::max( error, failed );
+  }
+
+  if ( error == 0 )
+  {
+    counting = true;
+    std::cout << "FYI: hardware counters enabled\n";
+    return true;
+  }
+  for ( int &fd : m_fds )
+  {
+    if ( fd >= 0 ) close( fd );
+    fd = -1;
+  }
+  std::cout << "FYI: hardware counters are not available (" << strerror(error) << "), only the times are measured\n";
+#else
+  std::cout << "FYI: hardware counters are only supported on Linux\n";
+#endif
+  return false;
+}
+
+/** Reads the hardware counters, scaled up if they were multiplexed
+  *
+  * @param counts Results
+  * @param all Sum of all threads instead of the calling thread only
+  */
+void Phase_Timers::Read_Counters( long long *counts, const bool all ) const
+{
+  std::fill( counts, counts+pc_count, 0LL );
+#ifdef __linux__
+  const int t0 = all ? 0 : std::min( omp_get_thread_num(), m_threads-1 );
+  const int t1 = all ? m_threads : t0+1;
+  for ( int t=t0; t<t1; t++ )
+  {
+    const int leader = m_fds[t*pc_count];
+    if ( leader < 0 ) continue;
+    uint64_t buf[3+pc_count];
+    if ( read( leader, buf, sizeof(buf) ) != sizeof(buf) || buf[2] == 0 ) continue;
+    const double scale = double(buf[1])/double(buf[2]);
+    for ( int c=0; c<pc_count; c++ )
+      counts[c] += (long long)( scale*buf[3+c] );
+  }
+#endif
+}
+
+/** Starts a new sequence, the following calls are counted for it
+  *
+  * Must not be called while a parallel region is active.
+  * @param name Name of the sequence
+  */
+void Phase_Timers::Begin_Sequence( const std::string &name )
+{
+  m_sequences.push_back( name );
+  m_data.emplace_back( ph_count*m_threads, entry{} );
+}
+
+/** Adds one call of a phase for the calling thread
+  *
+  * @param ph Phase
+  * @param seconds Time of the call without nested phases
+  * @param start Start of the call (omp_get_wtime())
+  * @param end End of the call
+  * @param counts Hardware counters of the call without nested phases (nullptr if not counted)
+  */
+void Phase_Timers::Add( const int ph, const double seconds, const double start, const double end, const long long *counts )
+{
+  const int t = std::min( omp_get_thread_num(), m_threads-1 );
+  const int s = m_data.size()-1;
+  entry &e = m_data[s][ph*m_threads+t];
+  e.seconds += seconds;
+  e.calls++;
+  if ( counts != nullptr )
+    for ( int c=0; c<pc_count; c++ )
+      e.counts[c] += counts[c];
+
+  if ( tracing && m_events[t].size() < max_events )
+    m_events[t].push_back( { ph, s, start, end } );
+}
+
+/** Writes a table of the time of each phase per sequence
+  *
+  * The times are summed over the threads, the last column gives the largest time of a single thread.
+  * @param out Stream to write to
+  */
+void Phase_Timers::Report( std::ostream &out ) const
+{
+  const double total = omp_get_wtime() - m_t0;
+  const std::ios_base::fmtflags flags = out.flags();
+  const std::streamsize precision = out.precision();
+  out << "Timers (wall time " << std::fixed << std::setprecision(3) << total << " s):\n";
+  out << std::left << std::setw(24) << "sequence" << std::setw(13) << "phase" << std::right << std::setw(12) << "time [s]" << std::setw(12) << "calls" << std::setw(9) << "% wall" << std::setw(14) << "max thread\n";
+
+  for ( size_t s=0; s<m_sequences.size(); s++ )
+  {
+    for ( int p=0; p<ph_count; p++ )
+    {
+      double sum = 0, max = 0;
+      long long calls = 0;
+      for ( int t=0; t<m_threads; t++ )
+      {
+        const entry &e = m_data[s][p*m_threads+t];
+        sum += e.seconds;
+        calls += e.calls;
+        max = std::max( max, e.seconds );
+      }
+      if ( calls == 0 ) continue;
+      const std::string name = std::to_string(s) + " " + m_sequences[s];
+      out << std::left << std::setw(24) << name.substr(0,23) << std::setw(13) << phase_names[p] << std::right << std::setw(12) << sum
+          << std::setw(12) << calls << std::setw(8) << std::setprecision(1) << 100*max/total << "%" << std::setw(13) << std::setprecision(3) << max << "\n";
+    }
+  }
+
+  if ( counting )
+  {
+    // roofline coordinates: instructions per byte of estimated memory traffic and the attained bandwidth
+    out << "Hardware counters (memory traffic estimated as " << int(line_size) << " bytes per cache miss):\n";
+    out << std::left << std::setw(24) << "sequence" << std::setw(13) << "phase" << std::right << std::setw(8) << "IPC"
+        << std::setw(14) << "miss/kinstr" << std::setw(10) << "miss %" << std::setw(10) << "GB/s" << std::setw(13) << "instr/byte\n";
+    for ( size_t s=0; s<m_sequences.size(); s++ )
+    {
+      for ( int p=0; p<ph_count; p++ )
+      {
+        long long n[pc_count] = {};
+        double max = 0;
+        for ( int t=0; t<m_threads; t++ )
+        {
+          const entry &e = m_data[s][p*m_threads+t];
+          for ( int c=0; c<pc_count; c++ )
+            n[c] += e.counts[c];
+          max = std::max( max, e.seconds );
+        }
+        if ( n[pc_cycles] == 0 ) continue;
+        const double bytes = line_size*n[pc_cache_misses];
+        const std::string name = std::to_string(s) + " " + m_sequences[s];
+        out << std::left << std::setw(24) << name.substr(0,23) << std::setw(13) << phase_names[p] << std::right << std::setprecision(2)
+            << std::setw(8) << double(n[pc_instructions])/n[pc_cycles]
+            << std::setw(14) << ( n[pc_instructions] > 0 ? 1000.0*n[pc_cache_misses]/n[pc_instructions] : 0.0 )
+            << std::setw(9) << std::setprecision(1) << ( n[pc_cache_refs] > 0 ? 100.0*n[pc_cache_misses]/n[pc_cache_refs] : 0.0 ) << "%"
+            << std::setw(10) << std::setprecision(2) << ( max > 0 ? 1e-9*bytes/max : 0.0 )
+            << std::setw(12) << ( bytes > 0 ? n[pc_instructions]/bytes : 0.0 ) << "\n";
+      }
+    }
+  }
+  out.flags( flags );
+  out.precision( precision );
+}
+
+/** Writes all timings as JSON
+  *
+  * @param filename
+  */
+void Phase_Timers::Write_JSON( const std::string &filename ) const
+{
+  std::ofstream out( filename );
+  out << "{\n  \"wall_time\": " << omp_get_wtime() - m_t0 << ",\n";
+  if ( counting ) out << "  \"bytes_per_cache_miss\": " << line_size << ",\n";
+  out << "  \"sequences\": [\n";
+  for ( size_t s=0; s<m_sequences.size(); s++ )
+  {
+    out << "    { \"index\": " << s << ", \"name\": \"" << m_sequences[s] << "\", \"phases\": [";
+    bool first = true;
+    for ( int p=0; p<ph_count; p++ )
+    {
+      long long calls = 0;
+      for ( int t=0; t<m_threads; t++ )
+        calls += m_data[s][p*m_threads+t].calls;
+      if ( calls == 0 ) continue;
+
+      out << ( first ? "\n" : ",\n" ) << "      { \"phase\": \"" << phase_names[p] << "\", \"threads\": [";
+      bool first_t = true;
+      for ( int t=0; t<m_threads; t++ )
+      {
+        const entry &e = m_data[s][p*m_threads+t];
+        if ( e.calls == 0 ) continue;
+        out << ( first_t ? "" : ", " ) << "{ \"thread\": " << t << ", \"seconds\": " << e.seconds << ", \"calls\": " << e.calls;
+        if ( counting )
+          for ( int c=0; c<pc_count; c++ )
+            out << ", \"" << counter_names[c] << "\": " << e.counts[c];
+        out << " }";
+        first_t = false;
+      }
+      out << "] }";
+      first = false;
+    }
+    out << ( first ? "] }" : "\n    ] }" ) << ( s+1 < m_sequences.size() ? ",\n" : "\n" );
+  }
+  out << "  ]\n}\n";
+}
+
+/** Writes the recorded calls in the trace event format of chrome://tracing and Perfetto
+  *
+  * @param filename
+  */
+void Phase_Timers::Write_Trace( const std::string &filename ) const
+{
+  std::ofstream out( filename );
+  out << "{ \"traceEvents\": [\n";
+  bool first = true;
+  for ( int t=0; t<m_threads; t++ )
+  {
+    for ( const event &e : m_events[t] )
+    {
+      out << ( first ? "" : ",\n" ) << "{ \"name\": \"" << phase_names[e.phase] << "\", \"cat\": \"" << m_sequences[e.sequence]
+          << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << t << ", \"ts\": " << std::fixed << std::setprecision(3) << 1e6*(e.start-m_t0)
+          << ", \"dur\": " << 1e6*(e.end-e.start) << " }" << std::defaultfloat;
+      first = false;
+    }
+  }
+  out << "\n] }\n";
+}
+
+/// The timers of the process
+Phase_Timers &Solver_Timers()
+{
+  static Phase_Timers timers;
+  return timers;
+}
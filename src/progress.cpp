@@ -0,0 +1,220 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#include "progress.h"
+#include <omp.h>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdio>
+#include <sys/resource.h>
+#include <unistd.h>
+
+/// Resident memory of the process in MB
+static double Resident_Memory()
+{
+  long pages = 0, resident = 0;
+  FILE *file = fopen( "/proc/self/statm", "r" );
+  if ( file != nullptr )
+  {
+    const int n = fscanf( file, "%ld %ld", &pages, &resident );
+    fclose( file );
+    if ( n == 2 ) return double(resident)*sysconf(_SC_PAGESIZE)/1048576.0;
+  }
+  // peak instead of current usage
+  struct rusage usage;
+  getrusage( RUSAGE_SELF, &usage );
+  return usage.ru_maxrss/1024.0;
+}
+
+/// Constructor, the reporter is not started
+Progress_Reporter::Progress_Reporter() :
+  m_steps(0),
+  m_time(0),
+  m_running(false),
+  m_stop(false),
+  m_interval(0),
+  m_sequence_no(0),
+  m_total_steps(0),
+  m_points(0),
+  m_seq_start(0),
+  m_last_steps(0),
+  m_last_report(0)
+{
+  m_t0 = omp_get_wtime();
+}
+
+Progress_Reporter::~Progress_Reporter()
+{
+  Stop();
+}
+
+/** Starts the reporter thread
+  *
+  * @param interval Seconds between two reports, the reporter is not started for interval <= 0
+  * @param filename File the JSON lines are appended to
+  */
+void Progress_Reporter::Start( const double interval, const std::string &filename )
+{
+  if ( interval <= 0 || m_running ) return;
+  m_interval = interval;
+  m_json.open( filename );
+  m_stop = false;
+  m_running = true;
+  m_thread = std::thread( &Progress_Reporter::Run, this );
+}
+
+/// Prints the pending lines and stops the reporter thread
+void Progress_Reporter::Stop()
+{
+  if ( !m_running ) return;
+  {
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_stop = true;
+  }
+  m_wake.notify_one();
+  m_thread.join();
+  Drain();
+  std::cout << std::flush;
+  m_json.close();
+  m_running = false;
+}
+
+/** Starts the reports of a new sequence
+  *
+  * @param name Name of the sequence
+  * @param no Number of the sequence
+  * @param total_steps Number of time steps of the sequence
+  * @param points Grid points updated per time step (all fields of all processes)
+  * @param t Simulated time at the start
+  */
+void Progress_Reporter::Begin_Sequence( const std::string &name, const int no, const long long total_steps, const double points, const double t )
+{
+  std::lock_guard<std::mutex> lock( m_mutex );
+  m_sequence = name;
+  m_sequence_no = no;
+  m_total_steps = total_steps;
+  m_points = points;
+  m_steps.store( 0 );
+  m_time.store( t );
+  m_seq_start = m_last_report = omp_get_wtime();
+  m_last_steps = 0;
+}
+
+/// Prints the pending lines and the final report of the current sequence
+void Progress_Reporter::End_Sequence()
+{
+  if ( !m_running ) return;
+  std::lock_guard<std::mutex> lock( m_mutex );
+  Drain();
+  Report( true );
+}
+
+/** Prints a line from the reporter thread, or at once if it is not running
+  *
+  * @param line Text including the line break
+  */
+void Progress_Reporter::Post( const std::string &line )
+{
+  if ( !m_running )
+  {
+    std::cout << line;
+    return;
+  }
+  std::lock_guard<std::mutex> lock( m_mutex );
+  m_messages.push_back( line );
+}
+
+/// Loop of the reporter thread
+void Progress_Reporter::Run()
+{
+  std::unique_lock<std::mutex> lock( m_mutex );
+  while ( !m_stop )
+  {
+    m_wake.wait_for( lock, std::chrono::duration<double>(m_interval) );
+    if ( m_stop ) break;
+    Drain();
+    if ( m_total_steps > 0 ) Report( false );
+  }
+}
+
+/// Prints the posted lines, the caller holds m_mutex
+void Progress_Reporter::Drain()
+{
+  if ( m_messages.empty() ) return;
+  std::string text;
+  for ( const std::string &line : m_messages )
+    text += line;
+  m_messages.clear();
+  std::cout << text << std::flush;
+}
+
+/** Prints one report and appends it to the JSON lines, the caller holds m_mutex
+  *
+  * @param final Report at the end of the sequence
+  */
+void Progress_Reporter::Report( const bool final )
+{
+  const double now = omp_get_wtime();
+  const long long steps = m_steps.load( std::memory_order_relaxed );
+  const double t = m_time.load( std::memory_order_relaxed );
+  const double elapsed = now - m_seq_start;
+
+  // the rate of the last interval, the average over the sequence for the final report and the ETA
+  const double span = final ? elapsed : now - m_last_report;
+  const double rate = ( span > 0 ) ? ( final ? steps : steps-m_last_steps )/span : 0;
+  const double average = ( elapsed > 0 ) ? steps/elapsed : 0;
+  const double eta = ( average > 0 ) ? std::max( 0LL, m_total_steps-steps )/average : -1;
+  const double memory = Resident_Memory();
+  m_last_report = now;
+  m_last_steps = steps;
+
+  std::ostringstream line;
+  line << ( final ? "done: " : "progress: " ) << "seq " << m_sequence_no << " " << m_sequence << " t = " << std::to_string(t)
+       << " steps " << steps << "/" << m_total_steps;
+  if ( m_total_steps > 0 ) line << " (" << std::fixed << std::setprecision(1) << 100.0*steps/m_total_steps << "%)";
+  line << std::defaultfloat << std::setprecision(4) << " " << rate << " steps/s " << rate*m_points << " points/s";
+  if ( final ) line << " in " << elapsed << " s";
+  else if ( eta >= 0 ) line << " ETA " << eta << " s";
+  line << " RSS " << std::fixed << std::setprecision(0) << memory << " MB\n";
+  std::cout << line.str() << std::flush;
+
+  if ( !m_json.is_open() ) return;
+  m_json << std::setprecision(10) << "{\"wall\": " << now-m_t0 << ", \"sequence\": " << m_sequence_no << ", \"name\": \"" << m_sequence
+         << "\", \"t\": " << t << ", \"steps\": " << steps << ", \"total_steps\": " << m_total_steps << ", \"steps_per_s\": " << rate
+         << ", \"points_per_s\": " << rate*m_points << ", \"eta_s\": " << eta << ", \"rss_mb\": " << memory
+         << ", \"final\": " << ( final ? "true" : "false" ) << "}\n";
+  m_json.flush();
+}
+
+/** Prints the simulated time like the solvers did before the reporter
+  *
+  * @param t Simulated time
+  */
+void Progress_Reporter::Print_Time( const double t )
+{
+  std::cout << "t = " << std::to_string(t) << std::endl;
+}
+
+/// The progress reporter of the process
+Progress_Reporter &Solver_Progress()
+{
+  static Progress_Reporter progress;
+  return progress;
+}
@@ -22,12 +22,35 @@
 #include "cft_1d.h"
 #include "cft_2d.h"
 #include "cft_3d.h"
+#include "cft_2d_mpi.h"
+#include "cft_3d_mpi.h"
 #include "muParser.h"
 #include "ParameterHandler.h"
 #include "CRT_Base_IF.h"
+#include "CRT_Lattice.h"
+#include "CRT_Ensemble.h"
+#include "field_alloc.h"
+#include "phase_timer.h"
+#include "progress.h"
+#include "dry_run.h"
 
 using namespace std;
 
+#ifdef TALISES_MPI
+// 2D and 3D grids are distributed along x over all MPI processes
+typedef Fourier::cft_2d_mpi field_2d;
+typedef Fourier::cft_3d_mpi field_3d;
+#else
+typedef Fourier::cft_2d field_2d;
+typedef Fourier::cft_3d field_3d;
+#endif
+
+// Largest number of internal states with a compile-time instantiation of the grid solver, more states run
+// with the runtime-sized CRT_Ensemble
+#ifndef TALISES_STATIC_STATES
+#define TALISES_STATIC_STATES 8
+#endif
+
 namespace RT_Solver
 {
   template<class T, int dim, int internal_dim>
@@ -54,14 +77,47 @@ namespace RT_Solver
   }
 }
 
+/** Runs the grid solver instantiated for internal_dim internal states
+  *
+  * @return false if internal_dim is larger than N
+  */
+template<class T, int dim, int N>
+bool Run_Static( ParameterHandler &params, const int internal_dim )
+{
+  if ( internal_dim != N ) return Run_Static<T,dim,N-1>( params, internal_dim );
+
+  RT_Solver::Raman_single<T,dim,N> rtsol( &params );
+  rtsol.run_sequence();
+  return true;
+}
+
+template<> bool Run_Static<Fourier::cft_1d,1,0>( ParameterHandler &, const int ) { return false; }
+template<> bool Run_Static<field_2d,2,0>( ParameterHandler &, const int ) { return false; }
+template<> bool Run_Static<field_3d,3,0>( ParameterHandler &, const int ) { return false; }
+
 int main( int argc, char *argv[] ){
-  if ( argc != 2 )
+  // talises [--dry-run] file.xml, see dry_run.h
+  bool dry_run = false;
+  std::string xml;
+  for ( int i=1; i<argc; i++ )
+  {
+    if ( std::string(argv[i]) == "--dry-run" ) dry_run = true;
+    else xml = argv[i];
+  }
+  if ( xml.empty() )
   {
     printf( "No parameter xml file specified.\n" );
     return EXIT_FAILURE;
   }
 
-  ParameterHandler params(argv[1]);
+#ifdef TALISES_MPI
+  int provided;
+  MPI_Init_thread( &argc, &argv, MPI_THREAD_FUNNELED, &provided );
+  // only the first process writes to stdout
+  if ( CRT_shared::Get_Rank() != 0 ) std::cout.rdbuf(nullptr);
+#endif
+
+  ParameterHandler params(xml);
   int dim=0;
   int internal_dim = 0;
   int no_of_threads = 1;
@@ -88,141 +144,106 @@ int main( int argc, char *argv[] ){
   if ( envstr != nullptr ) no_of_threads = atoi( envstr );
 
   fftw_init_threads();
+#ifdef TALISES_MPI
+  fftw_mpi_init();
+#endif
   fftw_plan_with_nthreads( no_of_threads );
   omp_set_num_threads( no_of_threads );
 
   std::cout << "FYI: Number of threads : " << no_of_threads << "\n";
 
-  try //TODO hardcode more options for internal levels lol
+  // TIMERS=0 in section ALGORITHM switches the phase timers off, TRACE=1 records a timeline (see phase_timer.h)
+  Solver_Timers().Enable( params.Get_Algorithm("TIMERS",1) != 0, params.Get_Algorithm("TRACE",0) != 0 );
+  // COUNTERS=1 adds the hardware counters of each phase (Linux perf_event_open)
+  if ( params.Get_Algorithm("COUNTERS",0) != 0 && !dry_run ) Solver_Timers().Enable_Counters();
+  // Progress reports every PROGRESS seconds on a thread of their own, PROGRESS=0 prints "t = " after each block
+  if ( CRT_shared::Get_Rank() == 0 && !dry_run ) Solver_Progress().Start( params.Get_Algorithm("PROGRESS",1), "progress.jsonl" );
+
+  // Bind the threads before the fields are allocated, see field_alloc.h
+  try
+  {
+    Set_Thread_Affinity( params.Get_simulation("AFFINITY") );
+  }
+  catch (std::string &str)
+  {
+  }
+
+  std::string engine = "grid";
+  try
+  {
+    engine = params.Get_simulation("ENGINE");
+  }
+  catch (std::string &str)
+  {
+  }
+
+  try
   {
-    if ( dim == 1 )
+    if ( internal_dim < 1 ) throw std::string("Error: INTERNAL_DIM must be at least 1.");
+    if ( dry_run )
+    {
+      Dry_Run( params, dim, internal_dim );
+    }
+    else if ( params.Get_Ensemble_Size() > 0 )
+    {
+      if ( engine != "grid" ) throw std::string("Error: section ENSEMBLE is not supported by the " + engine + " engine.\n");
+      if ( dim == 1 )
+      {
+        CRT_Ensemble<1> rtsol( &params );
+        rtsol.run_sequence();
+      }
+      else if ( dim == 2 )
+      {
+        CRT_Ensemble<2> rtsol( &params );
+        rtsol.run_sequence();
+      }
+      else if ( dim == 3 )
+      {
+        CRT_Ensemble<3> rtsol( &params );
+        rtsol.run_sequence();
+      }
+    }
+    else if ( engine == "lattice" )
+    {
+      if ( dim == 1 )
+      {
+        CRT_Lattice<Fourier::cft_1d,1> rtsol( &params );
+        rtsol.run_sequence();
+      }
+      else if ( dim == 2 )
+      {
+        CRT_Lattice<field_2d,2> rtsol( &params );
+        rtsol.run_sequence();
+      }
+      else if ( dim == 3 )
+      {
+        CRT_Lattice<field_3d,3> rtsol( &params );
+        rtsol.run_sequence();
+      }
+    }
+    else if ( dim == 1 )
     {
-		if (internal_dim == 1)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_1d,1,1> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	if (internal_dim == 2)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_1d,1,2> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 3)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_1d,1,3> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 4)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_1d,1,4> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 5)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_1d,1,5> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 6)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_1d,1,6> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 7)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_1d,1,7> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 8)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_1d,1,8> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
+      if ( !Run_Static<Fourier::cft_1d,1,TALISES_STATIC_STATES>( params, internal_dim ) )
+      {
+        CRT_Ensemble<1> rtsol( &params );
+        rtsol.run_sequence();
+      }
     }
     else if ( dim == 2 )
     {
-		if (internal_dim == 1)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_2d,2,1> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	if (internal_dim == 2)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_2d,2,2> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 3)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_2d,2,3> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 4)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_2d,2,4> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 5)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_2d,2,5> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 6)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_2d,2,6> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 7)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_2d,2,7> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 8)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_2d,2,8> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
+      if ( !Run_Static<field_2d,2,TALISES_STATIC_STATES>( params, internal_dim ) )
+      {
+        CRT_Ensemble<2> rtsol( &params );
+        rtsol.run_sequence();
+      }
     }
     else if ( dim == 3 )
     {
-		if (internal_dim == 1)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_3d,3,1> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	if (internal_dim == 2)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_3d,3,2> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 3)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_3d,3,3> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 4)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_3d,3,4> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 5)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_3d,3,5> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 6)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_3d,3,6> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 7)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_3d,3,7> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
-    	else if (internal_dim == 8)
-    	{
-		  RT_Solver::Raman_single<Fourier::cft_3d,3,8> rtsol( &params );
-		  rtsol.run_sequence();
-    	}
+      if ( !Run_Static<field_3d,3,TALISES_STATIC_STATES>( params, internal_dim ) )
+      {
+        CRT_Ensemble<3> rtsol( &params );
+        rtsol.run_sequence();
+      }
     }
     else
     {
@@ -241,7 +262,12 @@ int main( int argc, char *argv[] ){
   {
     cout << str << endl;
   }
+  Solver_Progress().Stop();
 
+#ifdef TALISES_MPI
+  fftw_mpi_cleanup();
+  MPI_Finalize();
+#endif
   fftw_cleanup_threads();
   return EXIT_SUCCESS;
 }
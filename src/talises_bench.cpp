@@ -0,0 +1,380 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+// Copyright (C) 2017 Želimir Marojević, Ertan Göklü, Claus Lämmerzahl - Original implementation in ATUS2
+
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <omp.h>
+#include "strtk.hpp"
+#include "cft_1d.h"
+#include "cft_2d.h"
+#include "cft_3d.h"
+#include "cft_2d_mpi.h"
+#include "cft_3d_mpi.h"
+#include "muParser.h"
+#include "ParameterHandler.h"
+#include "CRT_Base_IF.h"
+#include "field_alloc.h"
+#include "phase_timer.h"
+
+using namespace std;
+
+/** \file talises_bench.cpp
+  *
+  * Microbenchmarks of the kernels of the grid solver
+  *
+  * \code talises_bench [--dims 1,2,3] [--grid 64,256] [--states 1,2,4] [--threads 1,4] [--reps 20] [--out bench.json] \endcode
+  *
+  * Every combination of the options runs in a temporary directory with a generated xml file and Gaussian
+  * initial wavefunctions (grid points per direction given by --grid). The kernels are timed in isolation
+  * after one warm-up call. The results are written as JSON with the time per grid point and the bandwidth
+  * and arithmetic rate of a simple model of each kernel: every complex field is read and written once per
+  * pass, a complex transform of n points takes 5 n log2(n) flops and sincos counts as one flop. The
+  * eigen decomposition of the dense interaction step is not counted.
+  */
+
+#ifdef TALISES_MPI
+typedef Fourier::cft_2d_mpi field_2d;
+typedef Fourier::cft_3d_mpi field_3d;
+#else
+typedef Fourier::cft_2d field_2d;
+typedef Fourier::cft_3d field_3d;
+#endif
+
+#ifndef TALISES_STATIC_STATES
+#define TALISES_STATIC_STATES 8
+#endif
+
+/// One combination of the benchmark options
+struct bench_config
+{
+  int dim;
+  int grid;
+  int states;
+  int threads;
+  int reps;
+};
+
+/// Timing of one kernel
+struct bench_result
+{
+  std::string kernel;
+  bench_config config;
+  long long points; ///< grid points (all processes)
+  double seconds; ///< time per call
+  double bytes; ///< bytes moved per call (model)
+  double flops; ///< floating point operations per call (model)
+};
+
+/** Grid solver with public access to its kernels
+  */
+template<class T, int dim, int no_int_states>
+class Kernel_Bench : public CRT_Base_IF<T,dim,no_int_states>
+{
+public:
+  Kernel_Bench( ParameterHandler *p ) : CRT_Base_IF<T,dim,no_int_states>( p ) {};
+  virtual ~Kernel_Bench() {};
+
+  void Run( const bench_config &, std::vector<bench_result> & );
+
+protected:
+  bool run_custom_sequence( const sequence_item & ) { return false; };
+
+  /// Seconds per call of fct, after one warm-up call
+  template<class F> double Time( const int reps, F fct )
+  {
+    fct();
+    const double start = omp_get_wtime();
+    for ( int r=0; r<reps; r++ )
+      fct();
+    return (omp_get_wtime()-start)/reps;
+  };
+};
+
+/** Times all kernels and appends the results
+  *
+  * @param cfg Options of this run
+  * @param results Timings of all kernels
+  */
+template<class T, int dim, int no_int_states>
+void Kernel_Bench<T,dim,no_int_states>::Run( const bench_config &cfg, std::vector<bench_result> &results )
+{
+  const int S = no_int_states;
+  const double N = double(this->m_header.nDimX)*this->m_header.nDimY*this->m_header.nDimZ;
+  const double field = 16*N;
+  const double fft = 5*N*std::log2(N);
+  const int reps = cfg.reps;
+
+  auto add = [&]( const std::string kernel, const double sec, const double bytes, const double flops )
+  {
+    results.push_back( { kernel, cfg, (long long)N, sec, bytes, flops } );
+  };
+
+  T *psi = this->m_fields[0];
+  add( "ft", Time( reps, [&]() { psi->ft(-1); psi->ft(1); } ), 4*field, 2*fft );
+
+  psi->SetFix(true);
+  add( "ft_fix", Time( reps, [&]() { psi->ft(-1); psi->ft(1); } ), 4*field, 2*fft + 12*N );
+  psi->SetFix(false);
+
+  add( "Do_FT_Step_full", Time( reps, [&]() { this->Do_FT_Step_full(); } ), S*6*field, S*(2*fft + 6*N) );
+
+  this->Setup_Hamiltonian( this->m_params->m_sequence[0] );
+  add( "Do_NL_Step", Time( reps, [&]() { this->Do_NL_Step(); } ), S*(2*field + 8*N), S*7*N );
+
+  this->Setup_Hamiltonian( this->m_params->m_sequence[1] );
+  add( "Numerical_Diagonalization", Time( reps, [&]() { this->Numerical_Diagonalization(); } ), S*2*field + 8*N*S*(S+1), N*(16.0*S*S*S + 8.0*S*S) );
+
+  typename CRT_Base<T,dim,no_int_states>::observables obs;
+  add( "observables_x", Time( reps, [&]() { this->Measure( obs_N | obs_x | obs_x2 | obs_coherence, obs ); } ), S*field, N*(S*(3.0+4*dim) + 4.0*S*(S-1)) );
+  add( "observables_p", Time( reps, [&]() { this->Measure( obs_p | obs_p2, obs ); } ), S*5*field, S*(2*fft + (3.0+4*dim)*N) );
+
+  add( "Save_Phi", Time( reps, [&]() { for ( int s=0; s<S; s++ ) this->Save_Phi( "bench_" + std::to_string(s+1) + ".bin", s ); } ), S*(field + sizeof(generic_header)), 0 );
+}
+
+/** Runs the benchmark for internal_dim internal states
+  *
+  * @return false if internal_dim is larger than N
+  */
+template<class T, int dim, int N>
+bool Bench_Static( ParameterHandler &params, const bench_config &cfg, std::vector<bench_result> &results )
+{
+  if ( cfg.states != N ) return Bench_Static<T,dim,N-1>( params, cfg, results );
+
+  Kernel_Bench<T,dim,N> bench( &params );
+  bench.Run( cfg, results );
+  return true;
+}
+
+template<> bool Bench_Static<Fourier::cft_1d,1,0>( ParameterHandler &, const bench_config &, std::vector<bench_result> & ) { return false; }
+template<> bool Bench_Static<field_2d,2,0>( ParameterHandler &, const bench_config &, std::vector<bench_result> & ) { return false; }
+template<> bool Bench_Static<field_3d,3,0>( ParameterHandler &, const bench_config &, std::vector<bench_result> & ) { return false; }
+
+/** Writes the xml file and the initial wavefunctions of a run into the current directory
+  *
+  * The Hamiltonians are a harmonic potential (freeprop) and dense position dependent couplings (interact).
+  */
+void Write_Input( const bench_config &cfg )
+{
+  const double L = 10e-6;
+  const double sigma = 2e-6;
+
+  generic_header header = {};
+  header.nself = sizeof(generic_header);
+  header.nDatatyp = sizeof(fftw_complex);
+  header.nDims = cfg.dim;
+  header.nDimX = cfg.grid;
+  header.nDimY = ( cfg.dim >= 2 ) ? cfg.grid : 1;
+  header.nDimZ = ( cfg.dim == 3 ) ? cfg.grid : 1;
+  header.bAtom = 1;
+  header.bComplex = 1;
+  header.xMin = header.yMin = header.zMin = -L;
+  header.xMax = header.yMax = header.zMax = L;
+  header.dx = header.dy = header.dz = 2*L/cfg.grid;
+  header.dkx = header.dky = header.dkz = 2*M_PI/(2*L);
+  header.M = 1;
+  header.T_scale = 1e-6;
+  header.dt = 0.001;
+
+  const long long NX = header.nDimX, NY = header.nDimY, NZ = header.nDimZ;
+  std::vector<double> psi( 2*NX*NY*NZ );
+  for ( long long l=0; l<NX*NY*NZ; l++ )
+  {
+    const long long idx[3] = { l/(NY*NZ), (l/NZ)%NY, l%NZ };
+    double r2 = 0;
+    for ( int a=0; a<cfg.dim; a++ )
+    {
+      const double x = -L + idx[a]*header.dx;
+      r2 += x*x;
+    }
+    psi[2*l] = exp( -0.25*r2/(sigma*sigma) );
+  }
+
+  std::ostringstream xml;
+  xml << "<SIMULATION>\n";
+  xml << "  <DIM>" << cfg.dim << "</DIM>\n";
+  xml << "  <INTERNAL_DIM>" << cfg.states << "</INTERNAL_DIM>\n";
+  xml << "  <N_THREADS>" << cfg.threads << "</N_THREADS>\n";
+  for ( int s=0; s<cfg.states; s++ )
+  {
+    const std::string name = ( s == 0 ) ? "FILENAME" : "FILENAME_" + std::to_string(s+1);
+    const std::string file = "psi_" + std::to_string(s+1) + ".bin";
+    xml << "  <" << name << ">" << file << "</" << name << ">\n";
+
+    std::ofstream ofs( file, std::ofstream::binary );
+    ofs.write( reinterpret_cast<char *>(&header), sizeof(generic_header) );
+    ofs.write( reinterpret_cast<char *>(psi.data()), sizeof(double)*psi.size() );
+  }
+  xml << "  <ALGORITHM>\n    <T_SCALE>1e-6</T_SCALE>\n    <M>1.44466899e-25</M>\n    <ARENA>0</ARENA>\n  </ALGORITHM>\n";
+  xml << "  <CONSTANTS>\n    <omega>1e3</omega>\n    <Omega>1e5</Omega>\n  </CONSTANTS>\n";
+
+  auto element = []( const int i, const int j, const std::string part )
+  {
+    if ( i < 10 && j < 10 ) return "V_" + std::to_string(i) + std::to_string(j) + "_" + part;
+    return "V_" + std::to_string(i) + "_" + std::to_string(j) + "_" + part;
+  };
+
+  xml << "  <SEQUENCE>\n    <freeprop Nk=\"1\" dt=\"0.1\"";
+  for ( int i=1; i<=cfg.states; i++ )
+    xml << " " << element(i,i,"real") << "=\"omega*x*x*1e12\" " << element(i,i,"imag") << "=\"0\"";
+  xml << ">1</freeprop>\n    <interact Nk=\"1\" dt=\"0.1\"";
+  for ( int i=1; i<=cfg.states; i++ )
+    for ( int j=i; j<=cfg.states; j++ )
+    {
+      const std::string re = ( i == j ) ? "omega*x*x*1e12" : "Omega*cos(1e6*x)";
+      xml << " " << element(i,j,"real") << "=\"" << re << "\" " << element(i,j,"imag") << "=\"" << ( i == j ? "0" : "Omega*sin(1e6*x)" ) << "\"";
+    }
+  xml << ">1</interact>\n  </SEQUENCE>\n</SIMULATION>\n";
+
+  std::ofstream ofs( "bench.xml" );
+  ofs << xml.str();
+}
+
+/// Writes all results as JSON
+void Write_JSON( const std::string &filename, const std::vector<bench_result> &results )
+{
+  std::ofstream ofs( filename );
+  ofs << "{\n  \"benchmark\": \"talises_bench\",\n  \"results\": [\n";
+  for ( size_t i=0; i<results.size(); i++ )
+  {
+    const bench_result &r = results[i];
+    ofs << "    { \"kernel\": \"" << r.kernel << "\", \"dim\": " << r.config.dim << ", \"grid\": " << r.config.grid
+        << ", \"points\": " << r.points << ", \"states\": " << r.config.states << ", \"threads\": " << r.config.threads
+        << ", \"reps\": " << r.config.reps << ", \"seconds\": " << r.seconds
+        << ", \"ns_per_point\": " << 1e9*r.seconds/r.points
+        << ", \"gb_per_s\": " << 1e-9*r.bytes/r.seconds
+        << ", \"gflop_per_s\": " << 1e-9*r.flops/r.seconds << " }" << ( i+1 < results.size() ? "," : "" ) << "\n";
+  }
+  ofs << "  ]\n}\n";
+}
+
+/// Parses a comma separated list of integers
+std::vector<int> Parse_List( const std::string &str )
+{
+  std::vector<int> retval;
+  strtk::parse( str, ",", retval );
+  return retval;
+}
+
+int main( int argc, char *argv[] )
+{
+#ifdef TALISES_MPI
+  int provided;
+  MPI_Init_thread( &argc, &argv, MPI_THREAD_FUNNELED, &provided );
+#endif
+
+  std::vector<int> dims = { 1, 2, 3 };
+  std::vector<int> grids = { 64, 256 };
+  std::vector<int> states = { 1, 2 };
+  std::vector<int> threads = { omp_get_max_threads() };
+  int reps = 20;
+  std::string out = "bench.json";
+
+  // the kernels are timed here, the phase timers would only add their overhead
+  Solver_Timers().Enable( false, false );
+
+  for ( int i=1; i+1<argc; i+=2 )
+  {
+    const std::string opt = argv[i], val = argv[i+1];
+    if ( opt == "--dims" ) dims = Parse_List(val);
+    else if ( opt == "--grid" ) grids = Parse_List(val);
+    else if ( opt == "--states" ) states = Parse_List(val);
+    else if ( opt == "--threads" ) threads = Parse_List(val);
+    else if ( opt == "--reps" ) reps = std::stoi(val);
+    else if ( opt == "--out" ) out = val;
+    else
+    {
+      printf( "Unknown option %s.\n", opt.c_str() );
+      return EXIT_FAILURE;
+    }
+  }
+
+  char cwd[4096];
+  if ( getcwd( cwd, sizeof(cwd) ) == nullptr ) return EXIT_FAILURE;
+  if ( out[0] != '/' ) out = std::string(cwd) + "/" + out;
+
+  char tmpdir[] = "/tmp/talises_bench_XXXXXX";
+  if ( mkdtemp( tmpdir ) == nullptr || chdir( tmpdir ) != 0 )
+  {
+    printf( "Could not create a temporary directory.\n" );
+    return EXIT_FAILURE;
+  }
+
+  fftw_init_threads();
+#ifdef TALISES_MPI
+  fftw_mpi_init();
+#endif
+
+  std::vector<bench_result> results;
+  try
+  {
+    for ( int t : threads )
+    {
+      fftw_plan_with_nthreads( t );
+      omp_set_num_threads( t );
+      for ( int dim : dims )
+        for ( int grid : grids )
+          for ( int s : states )
+          {
+            const bench_config cfg = { dim, grid, s, t, reps };
+            Write_Input( cfg );
+            ParameterHandler params( "bench.xml" );
+
+            const size_t first = results.size();
+            bool ok = false;
+            if ( dim == 1 ) ok = Bench_Static<Fourier::cft_1d,1,TALISES_STATIC_STATES>( params, cfg, results );
+            else if ( dim == 2 ) ok = Bench_Static<field_2d,2,TALISES_STATIC_STATES>( params, cfg, results );
+            else if ( dim == 3 ) ok = Bench_Static<field_3d,3,TALISES_STATIC_STATES>( params, cfg, results );
+            if ( !ok )
+            {
+              printf( "Skipped dim %d with %d internal states.\n", dim, s );
+              continue;
+            }
+
+            for ( size_t i=first; i<results.size(); i++ )
+              printf( "%-26s dim %d grid %5d states %2d threads %3d : %10.3f ns/point %8.2f GB/s %8.2f GFLOP/s\n", results[i].kernel.c_str(), dim, grid, s, t,
+                      1e9*results[i].seconds/results[i].points, 1e-9*results[i].bytes/results[i].seconds, 1e-9*results[i].flops/results[i].seconds );
+          }
+    }
+  }
+  catch (mu::Parser::exception_type &e)
+  {
+    cout << "Message:  " << e.GetMsg() << "\n";
+    cout << "Formula:  " << e.GetExpr() << "\n";
+  }
+  catch (std::string &str)
+  {
+    cout << str << endl;
+  }
+
+  if ( CRT_shared::Get_Rank() == 0 ) Write_JSON( out, results );
+
+  if ( chdir( cwd ) == 0 )
+    std::system( ( "rm -rf " + std::string(tmpdir) ).c_str() );
+
+#ifdef TALISES_MPI
+  fftw_mpi_cleanup();
+  MPI_Finalize();
+#endif
+  fftw_cleanup_threads();
+  return EXIT_SUCCESS;
+}